@@ -0,0 +1,170 @@
+#include "Compression.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <zlib.h>
+
+const char Compression::Encoding[] = "gzip";
+const qint64 Compression::MinSize;
+
+static const int GzipWindowBits = 15 + 16;     // окно 32 КиБ, обёртка gzip
+static const int OutputChunk = 64 * 1024;
+static const int SampleSize = 64 * 1024;
+static const double MaxSampleRatio = 0.9;      // хуже — файл уже сжат
+
+GzipStream::GzipStream(Mode mode, int level)
+    : m_stream(new z_stream), m_mode(mode)
+{
+    m_stream->zalloc = Z_NULL;
+    m_stream->zfree = Z_NULL;
+    m_stream->opaque = Z_NULL;
+    m_stream->next_in = Z_NULL;
+    m_stream->avail_in = 0;
+
+    if (mode == Compress)
+        m_valid = deflateInit2(m_stream, level, Z_DEFLATED, GzipWindowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    else
+        m_valid = inflateInit2(m_stream, GzipWindowBits) == Z_OK;
+}
+
+GzipStream::~GzipStream()
+{
+    if (m_mode == Compress)
+        deflateEnd(m_stream);
+    else
+        inflateEnd(m_stream);
+    delete m_stream;
+}
+
+bool GzipStream::process(const char *data, qint64 size, QByteArray *out)
+{
+    if (!m_valid)
+        return false;
+    if (size <= 0)
+        return true;
+    // Данные после конца сжатого потока — ошибка отправителя
+    if (m_ended)
+        return false;
+
+    m_stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    m_stream->avail_in = uInt(size);
+    return run(Z_NO_FLUSH, out);
+}
+
+bool GzipStream::finish(QByteArray *out)
+{
+    if (!m_valid)
+        return false;
+    if (m_mode == Decompress)
+        return m_ended;
+    if (m_ended)
+        return true;
+
+    m_stream->next_in = Z_NULL;
+    m_stream->avail_in = 0;
+    return run(Z_FINISH, out);
+}
+
+bool GzipStream::run(int flush, QByteArray *out)
+{
+    char buffer[OutputChunk];
+
+    for (;;) {
+        m_stream->next_out = reinterpret_cast<Bytef *>(buffer);
+        m_stream->avail_out = OutputChunk;
+
+        const int rc = m_mode == Compress ? deflate(m_stream, flush) : inflate(m_stream, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            m_ended = true;
+        } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            m_valid = false;
+            return false;
+        }
+
+        const int produced = OutputChunk - int(m_stream->avail_out);
+        out->append(buffer, produced);
+
+        if (m_ended)
+            return m_stream->avail_in == 0;
+        // Вход исчерпан и выход не заполнен — продолжим со следующей порцией
+        if (flush != Z_FINISH && m_stream->avail_out != 0)
+            return true;
+        if (rc == Z_BUF_ERROR && produced == 0) {
+            m_valid = false;
+            return false;
+        }
+    }
+}
+
+bool Compression::accepts(const QByteArray &acceptEncoding)
+{
+    for (const QByteArray &item : acceptEncoding.split(',')) {
+        const QList<QByteArray> parts = item.split(';');
+        if (parts.value(0).trimmed().toLower() != Encoding)
+            continue;
+        // "gzip;q=0" — явный отказ
+        const QByteArray q = parts.value(1).trimmed();
+        return !q.startsWith("q=") || q.mid(2).toDouble() > 0;
+    }
+    return false;
+}
+
+// Уже сжатые форматы (архивы, медиа) узнаются по расширению
+static bool compressedFormat(const QString &fileName)
+{
+    static const QSet<QString> compressedSuffixes = {
+        "gz", "tgz", "bz2", "xz", "zst", "lz4", "zip", "7z", "rar", "jar", "apk", "rpm",
+        "jpg", "jpeg", "png", "gif", "webp", "heic",
+        "mp3", "ogg", "opus", "flac", "aac", "m4a",
+        "mp4", "mkv", "avi", "mov", "webm",
+        "docx", "xlsx", "pptx", "odt", "ods", "odp", "epub"
+    };
+    return compressedSuffixes.contains(QFileInfo(fileName).suffix().toLower());
+}
+
+// Проба: начало файла, сжатое быстрым уровнем, должно заметно уменьшиться
+static bool sampleShrinks(const QByteArray &sample)
+{
+    if (sample.isEmpty())
+        return false;
+
+    GzipStream stream(GzipStream::Compress, 1);
+    QByteArray packed;
+    if (!stream.process(sample.constData(), sample.size(), &packed) || !stream.finish(&packed))
+        return false;
+    return packed.size() < sample.size() * MaxSampleRatio;
+}
+
+bool Compression::worthCompressing(const QString &filePath)
+{
+    const QFileInfo info(filePath);
+    if (info.size() < MinSize || compressedFormat(filePath))
+        return false;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return sampleShrinks(file.read(SampleSize));
+}
+
+bool Compression::worthCompressing(const QString &fileName, const QByteArray &content)
+{
+    if (content.size() < MinSize || compressedFormat(fileName))
+        return false;
+    return sampleShrinks(QByteArray::fromRawData(content.constData(), qMin(content.size(), SampleSize)));
+}
+
+QByteArray Compression::compress(const QByteArray &data)
+{
+    GzipStream stream(GzipStream::Compress);
+    QByteArray out;
+    if (!stream.process(data.constData(), data.size(), &out) || !stream.finish(&out))
+        return QByteArray();
+    return out;
+}
+
+bool Compression::decompress(const QByteArray &data, QByteArray *out)
+{
+    GzipStream stream(GzipStream::Decompress);
+    return stream.process(data.constData(), data.size(), out) && stream.finish(out);
+}
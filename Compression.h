@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+struct z_stream_s;
+
+// Потоковое сжатие gzip (zlib): данные обрабатываются порциями,
+// результат дописывается в out, весь файл в памяти не нужен.
+class GzipStream
+{
+public:
+    enum Mode { Compress, Decompress };
+
+    explicit GzipStream(Mode mode, int level = 6);
+    ~GzipStream();
+
+    bool isValid() const { return m_valid; }
+    bool process(const char *data, qint64 size, QByteArray *out);
+    // Compress — дописывает хвост потока; Decompress — проверяет, что поток завершён
+    bool finish(QByteArray *out);
+
+private:
+    z_stream_s *m_stream;
+    Mode m_mode;
+    bool m_valid = false;
+    bool m_ended = false;
+
+    bool run(int flush, QByteArray *out);
+
+    GzipStream(const GzipStream &) = delete;
+    GzipStream &operator=(const GzipStream &) = delete;
+};
+
+// Согласование сжатия передач (Accept-Encoding / Content-Encoding)
+class Compression
+{
+public:
+    static const char Encoding[];       // "gzip"
+    static const qint64 MinSize = 1024; // меньшие тела выгоднее передать как есть
+
+    static bool accepts(const QByteArray &acceptEncoding);
+    // Уже сжатые форматы (архивы, медиа) определяются по расширению и по пробе начала файла
+    static bool worthCompressing(const QString &filePath);
+    // То же для уже прочитанного содержимого, без обращения к диску
+    static bool worthCompressing(const QString &fileName, const QByteArray &content);
+
+    static QByteArray compress(const QByteArray &data);
+    static bool decompress(const QByteArray &data, QByteArray *out);
+};
@@ -0,0 +1,352 @@
+#include "DeltaSync.h"
+#include "Log.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QMultiHash>
+#include <QFile>
+#include <QtMath>
+#include <QDebug>
+
+const qint64 DeltaSync::MinDeltaFileSize;
+
+static const quint32 SignatureMagic = 0x53534947; // "SSIG"
+static const quint32 DeltaMagic = 0x53444C54;     // "SDLT"
+static const int StrongSize = 16;                 // MD5
+static const int LiteralChunk = 64 * 1024;
+static const int ReadChunk = 1024 * 1024;
+
+enum DeltaOp : quint8 {
+    OpCopy = 'C',
+    OpLiteral = 'L',
+    OpEnd = 'E'
+};
+
+QByteArray DeltaSync::Signature::serialize() const
+{
+    QByteArray data;
+    data.reserve(20 + blocks.size() * (4 + StrongSize));
+
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << SignatureMagic << blockSize << fileSize << quint32(blocks.size());
+    for (const Block &block : blocks) {
+        stream << block.weak;
+        stream.writeRawData(block.strong.constData(), StrongSize);
+    }
+    return data;
+}
+
+bool DeltaSync::Signature::parse(const QByteArray &data, Signature *signature)
+{
+    QDataStream stream(data);
+    quint32 magic = 0;
+    quint32 count = 0;
+    stream >> magic >> signature->blockSize >> signature->fileSize >> count;
+
+    if (stream.status() != QDataStream::Ok || magic != SignatureMagic || signature->blockSize == 0)
+        return false;
+
+    // Защита от заведомо некорректного количества блоков
+    if (qint64(count) * (4 + StrongSize) > data.size())
+        return false;
+
+    signature->blocks.resize(int(count));
+    for (Block &block : signature->blocks) {
+        block.strong.resize(StrongSize);
+        stream >> block.weak;
+        if (stream.readRawData(block.strong.data(), StrongSize) != StrongSize)
+            return false;
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+quint32 DeltaSync::blockSizeFor(qint64 fileSize)
+{
+    // Как в rsync: порядка sqrt(size), с ограничениями и выравниванием на 8 байт
+    qint64 size = qint64(qSqrt(double(fileSize)));
+    size = qBound(qint64(2048), size, qint64(128 * 1024));
+    return quint32(size & ~qint64(7));
+}
+
+quint32 DeltaSync::weakChecksum(const char *data, int length)
+{
+    quint32 a = 0;
+    quint32 b = 0;
+    for (int i = 0; i < length; ++i) {
+        const quint32 x = uchar(data[i]);
+        a += x;
+        b += quint32(length - i) * x;
+    }
+    return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+QByteArray DeltaSync::strongChecksum(const char *data, int length)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, length), QCryptographicHash::Md5);
+}
+
+bool DeltaSync::computeSignature(const QString &path, Signature *signature)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    signature->fileSize = file.size();
+    signature->blockSize = blockSizeFor(signature->fileSize);
+    signature->blocks.clear();
+    signature->blocks.reserve(int(signature->fileSize / signature->blockSize) + 1);
+
+    QByteArray block(int(signature->blockSize), Qt::Uninitialized);
+    while (true) {
+        qint64 n = file.read(block.data(), block.size());
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+
+        Block b;
+        b.weak = weakChecksum(block.constData(), int(n));
+        b.strong = strongChecksum(block.constData(), int(n));
+        signature->blocks.append(b);
+    }
+
+    return true;
+}
+
+bool DeltaSync::writeDelta(const QString &path, const Signature &signature, QIODevice *out)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QVector<Block> &blocks = signature.blocks;
+    const int L = int(signature.blockSize ? signature.blockSize : blockSizeFor(file.size()));
+    const int lastBlockLength = blocks.isEmpty()
+            ? 0 : int(signature.fileSize - qint64(blocks.size() - 1) * L);
+
+    QMultiHash<quint32, int> weakIndex;
+    weakIndex.reserve(blocks.size());
+    for (int i = 0; i < blocks.size(); ++i)
+        weakIndex.insert(blocks[i].weak, i);
+
+    QDataStream stream(out);
+    stream << DeltaMagic << quint32(L) << file.size();
+
+    QCryptographicHash targetHash(QCryptographicHash::Md5);
+    QByteArray buffer;
+    int pos = 0;            // начало окна в buffer
+    bool eof = false;
+    bool readError = false;
+
+    // Гарантирует, что в буфере есть полное окно (или достигнут конец файла)
+    auto fill = [&]() {
+        while (!eof && buffer.size() - pos < L) {
+            buffer.remove(0, pos);
+            pos = 0;
+
+            QByteArray chunk = file.read(qMax(ReadChunk, 4 * L));
+            if (chunk.isEmpty()) {
+                readError = file.error() != QFileDevice::NoError;
+                eof = true;
+                break;
+            }
+            targetHash.addData(chunk);
+            buffer += chunk;
+        }
+    };
+
+    QByteArray literal;
+    int copyStart = -1;
+    int copyCount = 0;
+
+    auto flushLiteral = [&]() {
+        if (literal.isEmpty())
+            return;
+        stream << quint8(OpLiteral) << quint32(literal.size());
+        stream.writeRawData(literal.constData(), literal.size());
+        literal.clear();
+    };
+
+    auto flushCopy = [&]() {
+        if (copyStart < 0)
+            return;
+        stream << quint8(OpCopy) << quint32(copyStart) << quint32(copyCount);
+        copyStart = -1;
+        copyCount = 0;
+    };
+
+    // Ищет блок с совпадающим содержимым; предпочтение — продолжению текущей серии
+    auto findBlock = [&](quint32 weak, const char *data, int length) -> int {
+        auto it = weakIndex.constFind(weak);
+        if (it == weakIndex.constEnd())
+            return -1;
+
+        const QByteArray strong = strongChecksum(data, length);
+        const int expected = copyStart >= 0 ? copyStart + copyCount : -1;
+        int found = -1;
+        for (; it != weakIndex.constEnd() && it.key() == weak; ++it) {
+            const int index = it.value();
+            const int blockLength = index == blocks.size() - 1 ? lastBlockLength : L;
+            if (blockLength != length || blocks[index].strong != strong)
+                continue;
+            if (index == expected)
+                return index;
+            if (found < 0)
+                found = index;
+        }
+        return found;
+    };
+
+    quint32 a = 0;
+    quint32 b = 0;
+    bool rollingValid = false;
+
+    while (true) {
+        fill();
+        const int available = buffer.size() - pos;
+        if (available == 0)
+            break;
+
+        const char *window = buffer.constData() + pos;
+        int matched = -1;
+        int matchedLength = 0;
+
+        if (!blocks.isEmpty() && available >= L) {
+            if (!rollingValid) {
+                const quint32 weak = weakChecksum(window, L);
+                a = weak & 0xffff;
+                b = weak >> 16;
+                rollingValid = true;
+            }
+            matched = findBlock((a & 0xffff) | ((b & 0xffff) << 16), window, L);
+            matchedLength = L;
+        } else if (eof && available == lastBlockLength && lastBlockLength > 0 && lastBlockLength < L) {
+            // Хвост файла может совпасть с укороченным последним блоком
+            matched = findBlock(weakChecksum(window, available), window, available);
+            matchedLength = available;
+        }
+
+        if (matched >= 0) {
+            flushLiteral();
+            if (copyStart >= 0 && matched == copyStart + copyCount) {
+                ++copyCount;
+            } else {
+                flushCopy();
+                copyStart = matched;
+                copyCount = 1;
+            }
+            pos += matchedLength;
+            rollingValid = false;
+            continue;
+        }
+
+        // Совпадения нет — байт уходит в литерал, окно сдвигается на один байт
+        flushCopy();
+        const quint32 outByte = uchar(buffer.at(pos));
+        literal.append(buffer.at(pos));
+        ++pos;
+        if (literal.size() >= LiteralChunk)
+            flushLiteral();
+
+        if (rollingValid) {
+            fill();
+            if (buffer.size() - pos >= L) {
+                const quint32 inByte = uchar(buffer.at(pos + L - 1));
+                a = (a - outByte + inByte) & 0xffff;
+                b = (b - quint32(L) * outByte + a) & 0xffff;
+            } else {
+                rollingValid = false;
+            }
+        }
+    }
+
+    flushCopy();
+    flushLiteral();
+
+    const QByteArray digest = targetHash.result();
+    stream << quint8(OpEnd);
+    stream.writeRawData(digest.constData(), digest.size());
+
+    return !readError && stream.status() == QDataStream::Ok;
+}
+
+bool DeltaSync::applyDelta(const QString &basisPath, QIODevice *delta, QIODevice *out,
+                           QByteArray *resultHash)
+{
+    QDataStream stream(delta);
+    quint32 magic = 0;
+    quint32 blockSize = 0;
+    qint64 targetSize = 0;
+    stream >> magic >> blockSize >> targetSize;
+    if (stream.status() != QDataStream::Ok || magic != DeltaMagic || blockSize == 0)
+        return false;
+
+    QFile basis(basisPath);
+    const bool haveBasis = basis.open(QIODevice::ReadOnly);
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QByteArray chunk;
+    qint64 written = 0;
+
+    auto emitData = [&](const char *data, qint64 size) -> bool {
+        hash.addData(data, int(size));
+        written += size;
+        return out->write(data, size) == size;
+    };
+
+    while (true) {
+        quint8 op = 0;
+        stream >> op;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+
+        if (op == OpCopy) {
+            quint32 first = 0;
+            quint32 count = 0;
+            stream >> first >> count;
+            if (!haveBasis || stream.status() != QDataStream::Ok)
+                return false;
+
+            const qint64 offset = qint64(first) * blockSize;
+            if (offset > basis.size() || !basis.seek(offset))
+                return false;
+
+            qint64 remaining = qMin(qint64(count) * blockSize, basis.size() - offset);
+            while (remaining > 0) {
+                chunk.resize(int(qMin(qint64(ReadChunk), remaining)));
+                qint64 n = basis.read(chunk.data(), chunk.size());
+                if (n <= 0 || !emitData(chunk.constData(), n))
+                    return false;
+                remaining -= n;
+            }
+        } else if (op == OpLiteral) {
+            quint32 length = 0;
+            stream >> length;
+            if (stream.status() != QDataStream::Ok)
+                return false;
+
+            qint64 remaining = length;
+            while (remaining > 0) {
+                chunk.resize(int(qMin(qint64(ReadChunk), remaining)));
+                int n = stream.readRawData(chunk.data(), chunk.size());
+                if (n <= 0 || !emitData(chunk.constData(), n))
+                    return false;
+                remaining -= n;
+            }
+        } else if (op == OpEnd) {
+            QByteArray expected(StrongSize, Qt::Uninitialized);
+            if (stream.readRawData(expected.data(), StrongSize) != StrongSize)
+                return false;
+
+            if (written != targetSize || hash.result() != expected) {
+                qCWarning(lcDelta) << "Reconstructed file does not match, basis:" << basisPath;
+                return false;
+            }
+            if (resultHash)
+                *resultHash = expected;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
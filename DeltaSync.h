@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+// Дельта-передача в стиле rsync.
+// Получатель строит сигнатуру своей копии файла (слабый скользящий хэш + MD5 по блокам),
+// отправитель по ней формирует дельту: ссылки на совпавшие блоки и литеральные данные.
+class DeltaSync
+{
+public:
+    // Файлы меньше этого размера выгоднее передавать целиком
+    static const qint64 MinDeltaFileSize = 256 * 1024;
+
+    struct Block
+    {
+        quint32 weak;
+        QByteArray strong;
+    };
+
+    struct Signature
+    {
+        quint32 blockSize = 0;
+        qint64 fileSize = 0;
+        QVector<Block> blocks;
+
+        QByteArray serialize() const;
+        static bool parse(const QByteArray &data, Signature *signature);
+    };
+
+    static quint32 blockSizeFor(qint64 fileSize);
+
+    // Сигнатура файла; файл читается потоково
+    static bool computeSignature(const QString &path, Signature *signature);
+
+    // Дельта файла path относительно сигнатуры чужой копии
+    static bool writeDelta(const QString &path, const Signature &signature, QIODevice *out);
+
+    // Восстановление файла: basisPath + дельта -> out. Результат сверяется с MD5 из дельты,
+    // проверенный MD5 возвращается в resultHash.
+    static bool applyDelta(const QString &basisPath, QIODevice *delta, QIODevice *out,
+                           QByteArray *resultHash = nullptr);
+
+private:
+    static quint32 weakChecksum(const char *data, int length);
+    static QByteArray strongChecksum(const char *data, int length);
+};
@@ -2,6 +2,7 @@
 
 #include <QString>
 #include <QJsonObject>
+#include <QMetaType>
 
 struct FileDiff {
     QString path;
@@ -14,8 +15,9 @@ struct FileEntry
 {
     QString path;
     QString type; // "file", "directory", "deleted"
-    quint64 version;
+    quint64 version;  // mtime в миллисекундах
     int rootIndex;    // индекс в m_syncDirectories
+    QByteArray hash;  // MD5 содержимого; пустой, если ещё не посчитан
 
     FileEntry() = default;
     FileEntry(const QString &p, const QString &t, quint64 v, int i)
@@ -27,15 +29,28 @@ struct FileEntry
         obj["type"] = type;
         obj["version"] = QString::number(version);
         obj["rootIndex"] = rootIndex;
+        if (!hash.isEmpty())
+            obj["hash"] = QString::fromLatin1(hash.toHex());
         return obj;
     }
 
     static FileEntry fromJson(const QJsonObject &obj) {
-        return FileEntry(
+        FileEntry entry(
             obj["path"].toString(),
             obj["type"].toString(),
             obj["version"].toString().toLongLong(),
             obj["rootIndex"].toInt()
             );
+        entry.hash = QByteArray::fromHex(obj["hash"].toString().toLatin1());
+        return entry;
+    }
+
+    // Содержимое совпадает: по хэшу, если он известен с обеих сторон, иначе по версии
+    bool sameContent(const FileEntry &other) const {
+        if (!hash.isEmpty() && !other.hash.isEmpty())
+            return hash == other.hash;
+        return version == other.version;
     }
 };
+
+Q_DECLARE_METATYPE(FileEntry)
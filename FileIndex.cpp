@@ -0,0 +1,129 @@
+#include "FileIndex.h"
+
+FileIndex::Shard &FileIndex::shardFor(const Key &key)
+{
+    return m_shards[int(qHash(key) % uint(ShardCount))];
+}
+
+const FileIndex::Shard &FileIndex::shardFor(const Key &key) const
+{
+    return m_shards[int(qHash(key) % uint(ShardCount))];
+}
+
+bool FileIndex::contains(const Key &key) const
+{
+    const Shard &shard = shardFor(key);
+    QReadLocker locker(&shard.lock);
+    return shard.entries.contains(key);
+}
+
+FileEntry FileIndex::value(const Key &key, const FileEntry &defaultValue) const
+{
+    const Shard &shard = shardFor(key);
+    QReadLocker locker(&shard.lock);
+    return shard.entries.value(key, defaultValue);
+}
+
+void FileIndex::insert(const FileEntry &entry)
+{
+    const Key key = qMakePair(entry.rootIndex, entry.path);
+    Shard &shard = shardFor(key);
+    QWriteLocker locker(&shard.lock);
+    shard.entries.insert(key, entry);
+    m_merkle.insert(entry);
+    m_generation.ref();
+}
+
+bool FileIndex::remove(const Key &key)
+{
+    Shard &shard = shardFor(key);
+    QWriteLocker locker(&shard.lock);
+    if (shard.entries.remove(key) == 0)
+        return false;
+    m_merkle.remove(key.first, key.second);
+    m_generation.ref();
+    return true;
+}
+
+int FileIndex::size() const
+{
+    int total = 0;
+    for (const Shard &shard : m_shards) {
+        QReadLocker locker(&shard.lock);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+QList<FileEntry> FileIndex::values() const
+{
+    QList<FileEntry> result;
+    for (const Shard &shard : m_shards) {
+        QReadLocker locker(&shard.lock);
+        result += shard.entries.values();
+    }
+    return result;
+}
+
+QVector<FileDiff> FileIndex::diff(const QHash<Key, FileEntry> &clientEntries) const
+{
+    QVector<FileDiff> diffs;
+    auto addDiff = [&diffs](const Key &key, const char *type, quint64 version) {
+        FileDiff diff;
+        diff.path = key.second;
+        diff.rootIndex = key.first;
+        diff.type = type;
+        diff.version = version;
+        diffs.append(diff);
+    };
+
+    forEach([&](const Key &key, const FileEntry &serverEntry) {
+        auto clientIt = clientEntries.constFind(key);
+        if (clientIt == clientEntries.constEnd()) {
+            // Файл есть на сервере, но нет у клиента
+            addDiff(key, "download", serverEntry.version);
+        } else {
+            const FileEntry &clientEntry = clientIt.value();
+            if (!clientEntry.sameContent(serverEntry)) {
+                // Содержимое у сервера и клиента отличается. Нужно обновить;
+                // при равных версиях и разных хэшах побеждает копия сервера
+                addDiff(key, clientEntry.version <= serverEntry.version ? "download" : "upload",
+                        serverEntry.version);
+            }
+        }
+    });
+
+    // Теперь найдём удалённые файлы (были у клиента, но нет на сервере)
+    for (auto it = clientEntries.constBegin(); it != clientEntries.constEnd(); ++it) {
+        if (!contains(it.key())) {
+            // Файл есть у клиента, но нет на сервере
+            addDiff(it.key(), "delete", it.value().version);
+        }
+    }
+
+    return diffs;
+}
+
+bool FileIndex::commitIfNewer(const FileEntry &entry, const std::function<bool()> &commit,
+                              quint64 *currentVersion)
+{
+    const Key key = qMakePair(entry.rootIndex, entry.path);
+    Shard &shard = shardFor(key);
+    QWriteLocker locker(&shard.lock);
+
+    auto it = shard.entries.constFind(key);
+    const quint64 current = it != shard.entries.constEnd() ? it.value().version : 0;
+    if (currentVersion)
+        *currentVersion = current;
+
+    if (entry.version <= current)
+        return false;
+
+    if (!commit())
+        return false;
+
+    shard.entries.insert(key, entry);
+    m_merkle.insert(entry);
+    m_generation.ref();
+    return true;
+}
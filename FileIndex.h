@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+#include <functional>
+#include "FileEntry.h"
+#include "MerkleTree.h"
+
+// Потокобезопасный индекс файлов сервера.
+// Разбит на шарды с отдельными блокировками, чтобы рабочие потоки
+// не упирались в одну общую блокировку.
+class FileIndex
+{
+public:
+    typedef QPair<int, QString> Key;
+
+    bool contains(const Key &key) const;
+    FileEntry value(const Key &key, const FileEntry &defaultValue) const;
+    void insert(const FileEntry &entry);
+    bool remove(const Key &key);
+    int size() const;
+    QList<FileEntry> values() const;
+    // Отличия от полного списка клиента (/sync-list): что скачать, загрузить и удалить у клиента
+    QVector<FileDiff> diff(const QHash<Key, FileEntry> &clientEntries) const;
+    // Меняется при каждом изменении индекса
+    int generation() const { return m_generation.load(); }
+
+    // Дерево хэшей по содержимому индекса, обновляется вместе с ним
+    MerkleTree &merkle() { return m_merkle; }
+
+    // Атомарно: если entry новее текущей записи, выполняет commit() и обновляет индекс.
+    // Пока выполняется commit(), другие изменения этого ключа ждут.
+    bool commitIfNewer(const FileEntry &entry, const std::function<bool()> &commit,
+                       quint64 *currentVersion = nullptr);
+
+    // Обход без удержания блокировок: каждый шард копируется (implicit sharing) и
+    // перебирается уже после снятия блокировки
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (const Shard &shard : m_shards) {
+            shard.lock.lockForRead();
+            const QHash<Key, FileEntry> snapshot = shard.entries;
+            shard.lock.unlock();
+
+            for (auto it = snapshot.constBegin(); it != snapshot.constEnd(); ++it)
+                func(it.key(), it.value());
+        }
+    }
+
+private:
+    static const int ShardCount = 16;
+
+    struct Shard
+    {
+        mutable QReadWriteLock lock;
+        QHash<Key, FileEntry> entries;
+    };
+
+    Shard m_shards[ShardCount];
+    MerkleTree m_merkle; // блокировка дерева берётся только под блокировкой шарда
+    QAtomicInt m_generation;
+
+    Shard &shardFor(const Key &key);
+    const Shard &shardFor(const Key &key) const;
+};
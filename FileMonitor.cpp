@@ -1,16 +1,50 @@
 #include "FileMonitor.h"
+#include "Log.h"
 #include <QDirIterator>
 #include <QFileInfo>
 #include <QDateTime>
 #include <QDebug>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSet>
+#include <QElapsedTimer>
+#ifdef Q_OS_LINUX
+#include "InotifyWatcher.h"
+#endif
+
+static QString hashCachePath(const QStringList &directories)
+{
+    // Отдельный кэш для каждого набора каталогов (клиент и сервер на одной машине не мешают друг другу)
+    QByteArray id = QCryptographicHash::hash(directories.join('\n').toUtf8(), QCryptographicHash::Md5).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/hashcache-" + QString::fromLatin1(id) + ".bin";
+}
 
 FileMonitor::FileMonitor(const QStringList &directories, QObject *parent)
-    : QObject(parent), m_directories(directories)
+    : QObject(parent), m_directories(directories), m_watcher(this), m_rescanTimer(this),
+      m_hashCache(hashCachePath(directories)), m_hashCacheSaveTimer(this)
 {
     for (QString &dir : m_directories)
         dir = QDir(dir).absolutePath();
 
-    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &FileMonitor::onFileChanged);
+    m_hashCache.load();
+    m_hashCacheSaveTimer.setInterval(60 * 1000);
+    connect(&m_hashCacheSaveTimer, &QTimer::timeout, this, [this]() {
+        if (m_hashCache.isDirty())
+            m_hashCache.save();
+    });
+    m_hashCacheSaveTimer.start();
+
+#ifdef Q_OS_LINUX
+    // inotify сообщает о каждом изменении точно, периодический полный обход не нужен
+    m_inotify = new InotifyWatcher(this);
+    if (m_inotify->isValid()) {
+        connect(m_inotify, &InotifyWatcher::eventsReady, this, &FileMonitor::processEvents);
+        return;
+    }
+    delete m_inotify;
+    m_inotify = nullptr;
+#endif
+
     connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &FileMonitor::onDirectoryChanged);
 
     m_rescanTimer.setInterval(5000);
@@ -25,74 +59,170 @@ QList<FileEntry> FileMonitor::currentFiles() const
 
 void FileMonitor::start()
 {
+#ifdef Q_OS_LINUX
+    if (m_inotify) {
+        // Наблюдение ставится до обхода, чтобы не пропустить изменения между ними
+        for (const QString &dir : m_directories)
+            m_inotify->addTree(dir);
+        rescan();
+        return;
+    }
+#endif
+
     rescan();
-    updateWatchList();
 }
 
 void FileMonitor::rescan()
 {
-    QHash<QString, FileEntry> newFiles;
+    // Обходим дерево каталогов, но перечитываем только каталоги, у которых
+    // изменились метаданные; в остальных лишь сверяем размер и mtime известных файлов
+    QElapsedTimer timer;
+    timer.start();
+    QStringList changed;
+    QStringList pending = m_directories;
 
-    for (int rootIndex = 0; rootIndex < m_directories.size(); ++rootIndex) {
-        const QString &rootDir = m_directories[rootIndex];
-        QDirIterator it(rootDir, QDir::Files, QDirIterator::Subdirectories);
+    while (!pending.isEmpty()) {
+        const QString dirPath = pending.takeLast();
+        const QFileInfo dirInfo(dirPath);
+        if (!dirInfo.isDir()) {
+            forgetDirectory(dirPath);
+            continue;
+        }
 
-        while (it.hasNext()) {
-            QString fullPath = it.next();
-            FileEntry entry = getFileEntry(rootIndex, fullPath);
-            QString key = makeKey(rootIndex, entry.path);
-            newFiles[key] = entry;
+        const qint64 mtime = dirInfo.lastModified().toMSecsSinceEpoch();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        const qint64 ctime = dirInfo.metadataChangeTime().toMSecsSinceEpoch();
+#else
+        const qint64 ctime = dirInfo.created().toMSecsSinceEpoch(); // до 5.10 на Unix — ctime
+#endif
 
-            // Новый или обновлённый
-            if (!m_firstScan && (!m_currentFiles.contains(key) || m_currentFiles[key].version != entry.version)) {
-                emit fileChanged(entry);
+        DirState state = m_dirs.value(dirPath);
+        if (state.mtime < 0 && !m_inotify)
+            m_watchAdded.append(dirPath);
+
+        if (state.mtime == mtime && state.ctime == ctime) {
+            for (auto it = state.files.begin(); it != state.files.end(); ) {
+                const QFileInfo info(dirPath + '/' + it.key());
+                if (!info.exists()) {
+                    removeFile(info.filePath());
+                    it = state.files.erase(it);
+                    continue;
+                }
+                const FileStamp stamp = stampOf(info);
+                if (stamp != it.value()) {
+                    it.value() = stamp;
+                    changed.append(info.filePath());
+                }
+                ++it;
             }
+        } else {
+            relistDirectory(dirPath, &state, &changed);
+            state.mtime = mtime;
+            state.ctime = ctime;
         }
-    }
 
-    // Найдём удалённые
-    for (const QString &oldKey : m_currentFiles.keys()) {
-        if (!newFiles.contains(oldKey)) {
-            emit fileRemoved(m_currentFiles[oldKey]);
-        }
+        for (const QString &subdir : state.subdirs)
+            pending.append(dirPath + '/' + subdir);
+
+        m_dirs.insert(dirPath, state);
     }
 
-    m_currentFiles = std::move(newFiles);
+    // Хэши содержимого: неизменившиеся файлы берутся из кэша, остальные считаются параллельно
+    updateFiles(changed);
+
+    if (!m_inotify)
+        updateWatchList();
+
+    emit rescanFinished(timer.elapsed());
 
     if (m_firstScan) {
         m_firstScan = false;
+        emit initialScanFinished(m_currentFiles.values());
     }
 }
 
-void FileMonitor::updateWatchList()
+void FileMonitor::relistDirectory(const QString &dirPath, DirState *state, QStringList *changed)
+{
+    QHash<QString, FileStamp> files;
+    QStringList subdirs;
+
+    const QFileInfoList list = QDir(dirPath).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QFileInfo &info : list) {
+        if (info.isDir()) {
+            // По ссылкам на каталоги не ходим, как и QDirIterator без FollowSymlinks
+            if (!info.isSymLink())
+                subdirs.append(info.fileName());
+            continue;
+        }
+
+        const FileStamp stamp = stampOf(info);
+        auto old = state->files.constFind(info.fileName());
+        if (old == state->files.constEnd() || old.value() != stamp)
+            changed->append(info.filePath());
+        files.insert(info.fileName(), stamp);
+    }
+
+    // Исчезнувшие файлы и подкаталоги
+    for (auto it = state->files.constBegin(); it != state->files.constEnd(); ++it) {
+        if (!files.contains(it.key()))
+            removeFile(dirPath + '/' + it.key());
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QSet<QString> currentSubdirs(subdirs.begin(), subdirs.end());
+#else
+    const QSet<QString> currentSubdirs = subdirs.toSet();
+#endif
+    for (const QString &subdir : state->subdirs) {
+        if (!currentSubdirs.contains(subdir))
+            forgetDirectory(dirPath + '/' + subdir);
+    }
+
+    state->files = files;
+    state->subdirs = subdirs;
+}
+
+void FileMonitor::forgetDirectory(const QString &dirPath)
 {
-    m_watcher.removePaths(m_watcher.files());
-    m_watcher.removePaths(m_watcher.directories());
+    auto it = m_dirs.find(dirPath);
+    if (it == m_dirs.end())
+        return;
 
-    // Добавляем файлы и каталоги для отслеживания
-    for (const FileEntry &entry : m_currentFiles) {
-        QString fullPath = m_directories[entry.rootIndex] + "/" + entry.path;
-        m_watcher.addPath(fullPath);
+    const DirState state = it.value();
+    m_dirs.erase(it);
+    if (!m_inotify)
+        m_watchRemoved.append(dirPath);
+
+    for (auto file = state.files.constBegin(); file != state.files.constEnd(); ++file)
+        removeFile(dirPath + '/' + file.key());
+    for (const QString &subdir : state.subdirs)
+        forgetDirectory(dirPath + '/' + subdir);
+}
+
+FileMonitor::FileStamp FileMonitor::stampOf(const QFileInfo &info)
+{
+    FileStamp stamp;
+    if (info.exists()) {
+        stamp.size = info.size();
+        stamp.mtime = info.lastModified().toMSecsSinceEpoch();
     }
+    return stamp;
+}
 
-    // Добавляем все каталоги для отслеживания (родительские тоже)
-    QSet<QString> allDirs;
-    for (const FileEntry &entry : m_currentFiles) {
-        QFileInfo info(m_directories[entry.rootIndex] + "/" + entry.path);
-        QDir parent = info.dir();
-
-        while (true) {
-            QString parentPath = parent.absolutePath();
-            allDirs.insert(parentPath);
-            if (m_directories.contains(parentPath))
-                break;
-            if (!parent.cdUp())
-                break;
-        }
+void FileMonitor::updateWatchList()
+{
+    // Отслеживаются только каталоги: изменения файлов видны по mtime каталога
+    // или находятся периодическим rescan. Меняются только добавленные и исчезнувшие пути.
+    if (!m_watchRemoved.isEmpty()) {
+        m_watcher.removePaths(m_watchRemoved);
+        m_watchRemoved.clear();
     }
 
-    for (const QString &dirPath : allDirs) {
-        m_watcher.addPath(dirPath);
+    if (!m_watchAdded.isEmpty()) {
+        const QStringList failed = m_watcher.addPaths(m_watchAdded);
+        if (!failed.isEmpty())
+            qCWarning(lcMonitor) << "Cannot watch" << failed.size() << "directories";
+        m_watchAdded.clear();
     }
 }
 
@@ -101,7 +231,7 @@ FileEntry FileMonitor::getFileEntry(int rootIndex, const QString &fullPath) cons
     QFileInfo info(fullPath);
     QString relativePath = QDir(m_directories[rootIndex]).relativeFilePath(fullPath);
     QString type = info.suffix();
-    quint64 version = (info.lastModified().toMSecsSinceEpoch() / 1000);
+    quint64 version = info.lastModified().toMSecsSinceEpoch();
     return FileEntry(relativePath, type, version, rootIndex);
 }
 
@@ -110,35 +240,169 @@ QString FileMonitor::makeKey(int rootIndex, const QString &relativePath) const
     return QString::number(rootIndex) + ":" + relativePath;
 }
 
-void FileMonitor::onFileChanged(const QString &path)
+void FileMonitor::onDirectoryChanged(const QString &)
 {
-    // Определяем, из какой папки пришло событие
-    for (int rootIndex = 0; rootIndex < m_directories.size(); ++rootIndex) {
-        const QString &rootDir = m_directories[rootIndex];
-        if (path.startsWith(rootDir)) {
-            QFileInfo info(path);
-            if (!info.exists()) {
-                QString relative = QDir(rootDir).relativeFilePath(path);
-                QString key = makeKey(rootIndex, relative);
-                if (m_currentFiles.contains(key)) {
-                    emit fileRemoved(m_currentFiles[key]);
-                    m_currentFiles.remove(key);
-                    updateWatchList();
-                }
-                return;
-            }
+    rescan();
+}
+
+void FileMonitor::processEvents(const QVector<InotifyEvent> &events)
+{
+#ifdef Q_OS_LINUX
+    // Файлы перечитываются один раз после разбора всей пачки
+    QSet<QString> written;
+
+    auto forgetWrittenUnder = [&written](const QString &dirPath) {
+        const QString prefix = dirPath + '/';
+        for (auto it = written.begin(); it != written.end(); ) {
+            if (it->startsWith(prefix))
+                it = written.erase(it);
+            else
+                ++it;
+        }
+    };
+
+    auto addDirectory = [&](const QString &dirPath) {
+        if (isIgnored(dirPath))
+            return;
+        // Файлы могли появиться раньше, чем на каталог встало наблюдение
+        m_inotify->addTree(dirPath);
+        QDirIterator it(dirPath, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            written.insert(it.next());
+    };
 
-            FileEntry updated = getFileEntry(rootIndex, path);
-            QString key = makeKey(rootIndex, updated.path);
-            m_currentFiles[key] = updated;
-            emit fileChanged(updated);
+    for (const InotifyEvent &event : events) {
+        switch (event.type) {
+        case InotifyEvent::Overflow:
+            // Часть событий потеряна — сверяем деревья с известным состоянием
+            qCWarning(lcMonitor) << "inotify queue overflow, rescanning";
+            for (const QString &dir : m_directories)
+                m_inotify->addTree(dir);
+            rescan();
             return;
+        case InotifyEvent::FileWritten:
+            if (!isIgnored(event.path))
+                written.insert(event.path);
+            break;
+        case InotifyEvent::FileRemoved:
+            written.remove(event.path);
+            removeFile(event.path);
+            break;
+        case InotifyEvent::FileMoved:
+            written.remove(event.oldPath);
+            removeFile(event.oldPath);
+            if (!isIgnored(event.path))
+                written.insert(event.path);
+            break;
+        case InotifyEvent::DirCreated:
+            addDirectory(event.path);
+            break;
+        case InotifyEvent::DirRemoved:
+            m_inotify->removeTree(event.path);
+            forgetWrittenUnder(event.path);
+            removeUnder(event.path);
+            break;
+        case InotifyEvent::DirMoved:
+            m_inotify->removeTree(event.oldPath);
+            forgetWrittenUnder(event.oldPath);
+            removeUnder(event.oldPath);
+            addDirectory(event.path);
+            break;
         }
     }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    updateFiles(QStringList(written.begin(), written.end()));
+#else
+    updateFiles(written.toList());
+#endif
+#else
+    Q_UNUSED(events);
+#endif
 }
 
-void FileMonitor::onDirectoryChanged(const QString &)
+void FileMonitor::updateFiles(const QStringList &fullPaths)
 {
-    rescan();
-    updateWatchList();
+    QList<FileEntry> entries;
+    QStringList existing;
+    for (const QString &path : fullPaths) {
+        const int rootIndex = rootIndexFor(path);
+        if (rootIndex < 0 || !QFileInfo(path).isFile())
+            continue;
+        entries.append(getFileEntry(rootIndex, path));
+        existing.append(path);
+    }
+
+    const QVector<QByteArray> hashes = m_hashCache.hashFiles(existing);
+    for (int i = 0; i < entries.size(); ++i) {
+        FileEntry &entry = entries[i];
+        entry.hash = hashes[i];
+
+        const QString key = makeKey(entry.rootIndex, entry.path);
+        auto old = m_currentFiles.constFind(key);
+        const bool changed = old == m_currentFiles.constEnd() || !old.value().sameContent(entry);
+        m_currentFiles[key] = entry;
+        if (changed && !m_firstScan)
+            emit fileChanged(entry);
+    }
+}
+
+void FileMonitor::removeFile(const QString &fullPath)
+{
+    const int rootIndex = rootIndexFor(fullPath);
+    if (rootIndex < 0)
+        return;
+
+    auto it = m_currentFiles.find(makeKey(rootIndex, QDir(m_directories[rootIndex]).relativeFilePath(fullPath)));
+    if (it == m_currentFiles.end())
+        return;
+
+    const FileEntry entry = it.value();
+    m_currentFiles.erase(it);
+    emit fileRemoved(entry);
+}
+
+void FileMonitor::removeUnder(const QString &dirPath)
+{
+    const int rootIndex = rootIndexFor(dirPath);
+    if (rootIndex < 0)
+        return;
+
+    const QString relative = dirPath.mid(m_directories[rootIndex].size() + 1);
+    const QString prefix = makeKey(rootIndex, relative.isEmpty() ? relative : relative + '/');
+
+    QList<FileEntry> removed;
+    for (auto it = m_currentFiles.begin(); it != m_currentFiles.end(); ) {
+        if (it.key().startsWith(prefix)) {
+            removed.append(it.value());
+            it = m_currentFiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const FileEntry &entry : removed)
+        emit fileRemoved(entry);
+}
+
+int FileMonitor::rootIndexFor(const QString &fullPath) const
+{
+    for (int rootIndex = 0; rootIndex < m_directories.size(); ++rootIndex) {
+        const QString &rootDir = m_directories[rootIndex];
+        if (fullPath == rootDir || fullPath.startsWith(rootDir + '/'))
+            return rootIndex;
+    }
+    return -1;
+}
+
+bool FileMonitor::isIgnored(const QString &fullPath) const
+{
+    // Скрытые файлы и каталоги (в том числе временные .part) не синхронизируются,
+    // как и при обходе через QDirIterator
+    const int rootIndex = rootIndexFor(fullPath);
+    if (rootIndex < 0)
+        return true;
+
+    const QString relative = fullPath.mid(m_directories[rootIndex].size() + 1);
+    return relative.startsWith('.') || relative.contains("/.");
 }
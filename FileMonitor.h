@@ -4,35 +4,81 @@
 #include <QFileSystemWatcher>
 #include <QHash>
 #include <QDir>
+#include <QFileInfo>
 #include <QTimer>
 #include "FileEntry.h"
+#include "HashCache.h"
+
+class InotifyWatcher;
+struct InotifyEvent;
 
 class FileMonitor : public QObject
 {
     Q_OBJECT
 public:
+    // Монитор можно перенести в отдельный поток (moveToThread) до вызова start();
+    // сигналы тогда доставляются получателям через очередь
     explicit FileMonitor(const QStringList &directories, QObject *parent = nullptr);
 
     void start();
     QList<FileEntry> currentFiles() const;
+    HashCache *hashCache() { return &m_hashCache; }
 
 signals:
     void fileChanged(const FileEntry &entry);           // Изменён/добавлен
     void fileRemoved(const FileEntry &entry);      // Удалён
+    // Первый обход завершён: полный список файлов
+    void initialScanFinished(const QList<FileEntry> &files);
+    // Обход дерева завершён (для метрик)
+    void rescanFinished(qint64 elapsedMs);
 
 private slots:
-    void onFileChanged(const QString &path);
     void onDirectoryChanged(const QString &path);
+    // Слот, чтобы обход можно было запустить через QMetaObject::invokeMethod (bench/micro)
+    void rescan();
 
 private:
+    struct FileStamp
+    {
+        qint64 size = -1;
+        qint64 mtime = -1;
+
+        bool operator==(const FileStamp &other) const { return size == other.size && mtime == other.mtime; }
+        bool operator!=(const FileStamp &other) const { return !(*this == other); }
+    };
+
+    // Снимок каталога с прошлого обхода: пока mtime/ctime каталога не изменились,
+    // его состав тот же и перечитывать каталог не нужно
+    struct DirState
+    {
+        qint64 mtime = -1;
+        qint64 ctime = -1;
+        QHash<QString, FileStamp> files; // имя -> размер и mtime
+        QStringList subdirs;
+    };
+
     QStringList m_directories;
     QFileSystemWatcher m_watcher;
+    InotifyWatcher *m_inotify = nullptr; // на Linux вместо m_watcher и периодического rescan
     QHash<QString, FileEntry> m_currentFiles;
+    QHash<QString, DirState> m_dirs;     // полный путь каталога -> снимок
+    QStringList m_watchAdded;            // каталоги, появившиеся с прошлого updateWatchList
+    QStringList m_watchRemoved;          // и исчезнувшие
     QTimer m_rescanTimer;
     bool m_firstScan = true;
+    HashCache m_hashCache;
+    QTimer m_hashCacheSaveTimer;
 
-    void rescan();
+    void relistDirectory(const QString &dirPath, DirState *state, QStringList *changed);
+    void forgetDirectory(const QString &dirPath);
+    static FileStamp stampOf(const QFileInfo &info);
     void updateWatchList();
+    void processEvents(const QVector<InotifyEvent> &events);
+    void updateFiles(const QStringList &fullPaths);
+    void removeFile(const QString &fullPath);
+    void removeUnder(const QString &dirPath);
+    int rootIndexFor(const QString &fullPath) const;
+    bool isIgnored(const QString &fullPath) const;
     FileEntry getFileEntry(int rootIndex, const QString &fullPath) const;
     QString makeKey(int rootIndex, const QString &relativePath) const;
 };
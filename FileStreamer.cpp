@@ -0,0 +1,249 @@
+#include "FileStreamer.h"
+#include "Compression.h"
+#include "Log.h"
+#include <QTcpSocket>
+#include <QSocketNotifier>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+const qint64 FileStreamer::ChunkSize;
+const qint64 FileStreamer::HighWaterMark;
+const qint64 FileStreamer::SendfileBudget;
+
+FileStreamer::FileStreamer(QTcpSocket *socket, const QString &filePath,
+                           qint64 offset, qint64 length, QObject *parent)
+    : QObject(parent), m_socket(socket), m_file(filePath),
+      m_offset(offset), m_remaining(length)
+{
+}
+
+FileStreamer::~FileStreamer()
+{
+    stopSendfile();
+}
+
+bool FileStreamer::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    if (m_offset > 0 && !m_file.seek(m_offset)) {
+        m_file.close();
+        return false;
+    }
+
+    return true;
+}
+
+void FileStreamer::setCompressed(bool compressed)
+{
+    m_gzip.reset(compressed ? new GzipStream(GzipStream::Compress) : nullptr);
+}
+
+void FileStreamer::start()
+{
+#ifdef Q_OS_LINUX
+    // sendfile передаёт байты файла как есть — со сжатием не применим
+    // Отдельный дескриптор, чтобы наш notifier не конфликтовал с внутренним notifier'ом QTcpSocket
+    if (!m_gzip && m_socket->socketDescriptor() != -1) {
+        m_sendfileFd = ::dup(int(m_socket->socketDescriptor()));
+        if (m_sendfileFd != -1) {
+            m_useSendfile = true;
+            m_writeNotifier = new QSocketNotifier(m_sendfileFd, QSocketNotifier::Write, this);
+            m_writeNotifier->setEnabled(false);
+            connect(m_writeNotifier, &QSocketNotifier::activated, this, &FileStreamer::pump);
+        }
+    }
+#endif
+
+    connect(m_socket, &QTcpSocket::bytesWritten, this, &FileStreamer::pump);
+    connect(m_socket, &QTcpSocket::disconnected, this, &FileStreamer::onSocketDisconnected);
+
+    pump();
+}
+
+void FileStreamer::pump()
+{
+    if (m_done)
+        return;
+
+    if (m_gzip) {
+        pumpCompressed();
+        return;
+    }
+
+    if (m_remaining <= 0) {
+        finish(true);
+        return;
+    }
+
+    if (m_useSendfile)
+        pumpSendfile();
+    else
+        pumpBuffered();
+}
+
+void FileStreamer::pumpBuffered()
+{
+    // Дозаполняем буфер сокета, пока он не превысит порог; остальное — по bytesWritten
+    while (m_remaining > 0 && m_socket->bytesToWrite() < HighWaterMark) {
+        m_chunk.resize(int(qMin(ChunkSize, m_remaining)));
+        qint64 n = m_file.read(m_chunk.data(), m_chunk.size());
+        if (n <= 0) {
+            qCWarning(lcServer) << "FileStreamer: read error" << m_file.fileName() << m_file.errorString();
+            finish(false);
+            return;
+        }
+
+        if (m_socket->write(m_chunk.constData(), n) != n) {
+            finish(false);
+            return;
+        }
+
+        m_remaining -= n;
+        m_sent += n;
+    }
+
+    if (m_remaining <= 0)
+        finish(true);
+}
+
+void FileStreamer::pumpCompressed()
+{
+    // Итоговый размер заранее не известен: каждая сжатая порция — отдельный чанк
+    while (m_socket->bytesToWrite() < HighWaterMark) {
+        QByteArray packed;
+
+        if (m_remaining > 0) {
+            m_chunk.resize(int(qMin(ChunkSize, m_remaining)));
+            qint64 n = m_file.read(m_chunk.data(), m_chunk.size());
+            if (n <= 0) {
+                qCWarning(lcServer) << "FileStreamer: read error" << m_file.fileName() << m_file.errorString();
+                finish(false);
+                return;
+            }
+            m_remaining -= n;
+            m_sent += n;
+
+            if (!m_gzip->process(m_chunk.constData(), n, &packed)) {
+                finish(false);
+                return;
+            }
+        }
+
+        if (m_remaining <= 0 && !m_gzip->finish(&packed)) {
+            finish(false);
+            return;
+        }
+
+        if (!packed.isEmpty())
+            m_socket->write(QByteArray::number(packed.size(), 16) + "\r\n" + packed + "\r\n");
+
+        if (m_remaining <= 0) {
+            m_socket->write("0\r\n\r\n");
+            finish(true);
+            return;
+        }
+    }
+}
+
+void FileStreamer::pumpSendfile()
+{
+#ifdef Q_OS_LINUX
+    // Заголовки ещё в буфере QTcpSocket — ждём, пока он опустеет
+    if (m_socket->bytesToWrite() > 0) {
+        m_writeNotifier->setEnabled(false);
+        m_socket->flush();
+        return;
+    }
+
+    qint64 budget = SendfileBudget;
+    off_t offset = off_t(m_offset + m_sent);
+
+    while (m_remaining > 0 && budget > 0) {
+        size_t count = size_t(qMin(qMin(ChunkSize * 4, m_remaining), budget));
+        ssize_t n = ::sendfile(m_sendfileFd, m_file.handle(), &offset, count);
+
+        if (n > 0) {
+            m_remaining -= n;
+            m_sent += n;
+            m_sentDirectly += n;
+            budget -= n;
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Ядро не принимает данные — ждём готовности сокета на запись
+            m_writeNotifier->setEnabled(true);
+            return;
+        }
+
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS) && m_sent == 0) {
+            // Файловая система не поддерживает sendfile — переходим на буферизованную отправку
+            stopSendfile();
+            m_file.seek(m_offset);
+            pumpBuffered();
+            return;
+        }
+
+        qCWarning(lcServer) << "FileStreamer: sendfile failed for" << m_file.fileName() << "errno:" << errno;
+        finish(false);
+        return;
+    }
+
+    if (m_remaining <= 0) {
+        finish(true);
+        return;
+    }
+
+    // Бюджет исчерпан — отдаём управление циклу событий и продолжим по готовности сокета
+    m_writeNotifier->setEnabled(true);
+#else
+    pumpBuffered();
+#endif
+}
+
+void FileStreamer::stopSendfile()
+{
+    if (m_writeNotifier) {
+        m_writeNotifier->setEnabled(false);
+        m_writeNotifier->deleteLater();
+        m_writeNotifier = nullptr;
+    }
+
+#ifdef Q_OS_LINUX
+    if (m_sendfileFd != -1) {
+        ::close(m_sendfileFd);
+        m_sendfileFd = -1;
+    }
+#endif
+
+    m_useSendfile = false;
+}
+
+void FileStreamer::onSocketDisconnected()
+{
+    if (!m_done)
+        finish(m_remaining <= 0);
+}
+
+void FileStreamer::finish(bool ok)
+{
+    if (m_done)
+        return;
+
+    m_done = true;
+    stopSendfile();
+    m_file.close();
+    disconnect(m_socket, nullptr, this, nullptr);
+
+    emit finished(ok);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QObject>
+#include <QFile>
+#include <QByteArray>
+#include <QScopedPointer>
+
+class QTcpSocket;
+class QSocketNotifier;
+class GzipStream;
+
+// Потоковая отправка файла в сокет ограниченными порциями.
+// На Linux используется sendfile(2), иначе — чтение блоками с учётом
+// bytesWritten, так что расход памяти не зависит от размера файла.
+// Со сжатием файл передаётся через gzip порциями chunked-кодирования.
+class FileStreamer : public QObject
+{
+    Q_OBJECT
+public:
+    FileStreamer(QTcpSocket *socket, const QString &filePath,
+                 qint64 offset, qint64 length, QObject *parent = nullptr);
+    ~FileStreamer();
+
+    // false — файл не удалось открыть; вызывается до отправки заголовков
+    bool open();
+    // До start(): тело сжимается на лету и передаётся chunked-кодированием
+    void setCompressed(bool compressed);
+    void start();
+    qint64 bytesSent() const { return m_sent; }
+    // Отправлено через sendfile, мимо буфера QTcpSocket (bytesWritten об этом не сообщает)
+    qint64 bytesSentDirectly() const { return m_sentDirectly; }
+
+signals:
+    void finished(bool ok);
+
+private slots:
+    void pump();
+    void onSocketDisconnected();
+
+private:
+    static const qint64 ChunkSize = 256 * 1024;        // размер одной порции
+    static const qint64 HighWaterMark = 1024 * 1024;   // максимум в буфере сокета
+    static const qint64 SendfileBudget = 8 * 1024 * 1024; // байт за один проход цикла событий
+
+    QTcpSocket *m_socket;
+    QFile m_file;
+    qint64 m_offset;
+    qint64 m_remaining;
+    qint64 m_sent = 0;
+    qint64 m_sentDirectly = 0;
+    QByteArray m_chunk;
+    bool m_done = false;
+
+    bool m_useSendfile = false;
+    int m_sendfileFd = -1;
+    QSocketNotifier *m_writeNotifier = nullptr;
+
+    QScopedPointer<GzipStream> m_gzip;
+
+    void pumpBuffered();
+    void pumpCompressed();
+    void pumpSendfile();
+    void stopSendfile();
+    void finish(bool ok);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QString>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QStringList>
+#include "FileEntry.h"
+
+#ifdef Q_OS_UNIX
+#include <stdio.h>
+#endif
+
+// Скрытый временный файл рядом с целевым: FileMonitor его не видит,
+// а последующий rename остаётся атомарным (та же файловая система)
+static inline QString partFilePath(const QString &fullPath, const QString &tag)
+{
+    QFileInfo info(fullPath);
+    return info.absolutePath() + "/." + info.fileName() + "." + tag + ".part";
+}
+
+// Атомарная замена файла: читатели видят либо старую, либо новую версию целиком
+static inline bool replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#else
+    QFile::remove(to);
+    return QFile::rename(from, to);
+#endif
+}
+
+// Обход корневых каталогов синхронизации: записи без хэшей и полные пути
+// в том же порядке (хэши затем берутся из HashCache)
+static inline QList<FileEntry> listFiles(const QStringList &directories, QStringList *fullPaths)
+{
+    QList<FileEntry> entries;
+
+    for (int rootIndex = 0; rootIndex < directories.size(); ++rootIndex) {
+        const QString &dirPath = directories[rootIndex];
+        QDir root(dirPath);
+        QDirIterator it(dirPath, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        const int basePathLength = root.absolutePath().length() + 1;
+
+        while (it.hasNext()) {
+            it.next();
+            const QFileInfo file = it.fileInfo();
+
+            FileEntry entry;
+            entry.path = file.filePath().mid(basePathLength);
+            entry.rootIndex = rootIndex;
+            entry.version = file.lastModified().toMSecsSinceEpoch();
+            entry.type = "file";
+            entries.append(entry);
+            fullPaths->append(file.filePath());
+        }
+    }
+
+    return entries;
+}
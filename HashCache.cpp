@@ -0,0 +1,206 @@
+#include "HashCache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+static const quint32 CacheMagic = 0x53484331; // "SHC1"
+
+uint qHash(const HashCache::Key &key, uint seed)
+{
+    return qHash(key.inode, seed) ^ qHash(key.mtimeNs, seed) ^ qHash(key.size, seed) ^ uint(key.device);
+}
+
+HashCache::HashCache(const QString &storagePath)
+    : m_storagePath(storagePath)
+{
+}
+
+HashCache::~HashCache()
+{
+    if (m_dirty)
+        save();
+}
+
+bool HashCache::load()
+{
+    QFile file(m_storagePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 count = 0;
+    stream >> magic >> count;
+    if (magic != CacheMagic)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_entries.reserve(int(count));
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Key key;
+        Value value;
+        stream >> key.device >> key.inode >> key.size >> key.mtimeNs >> value.hash;
+        m_entries.insert(key, value);
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool HashCache::save()
+{
+    if (m_storagePath.isEmpty())
+        return false;
+
+    QDir().mkpath(QFileInfo(m_storagePath).absolutePath());
+
+    QSaveFile file(m_storagePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+
+    // Сохраняем только записи, встреченные в этом запуске: удалённые файлы не копятся
+    quint32 count = 0;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (it.value().used)
+            ++count;
+    }
+
+    QDataStream stream(&file);
+    stream << CacheMagic << count;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (!it.value().used)
+            continue;
+        const Key &key = it.key();
+        stream << key.device << key.inode << key.size << key.mtimeNs << it.value().hash;
+    }
+
+    m_dirty = false;
+    return file.commit();
+}
+
+bool HashCache::isDirty() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dirty;
+}
+
+bool HashCache::fileKey(const QString &path, Key *key)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+        return false;
+
+    key->device = quint64(st.st_dev);
+    key->inode = quint64(st.st_ino);
+    key->size = qint64(st.st_size);
+#ifdef Q_OS_LINUX
+    key->mtimeNs = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    key->mtimeNs = qint64(st.st_mtime) * 1000000000;
+#endif
+    return true;
+#else
+    QFileInfo info(path);
+    if (!info.exists())
+        return false;
+
+    key->device = 0;
+    key->inode = qHash(info.absoluteFilePath());
+    key->size = info.size();
+    key->mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    return true;
+#endif
+}
+
+QByteArray HashCache::computeHash(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    // MD5 — тот же алгоритм, что проверяет целостность в DeltaSync
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    if (!hash.addData(&file))
+        return QByteArray();
+    return hash.result();
+}
+
+QByteArray HashCache::hashFile(const QString &path)
+{
+    return hashFiles(QStringList() << path).value(0);
+}
+
+QVector<QByteArray> HashCache::hashFiles(const QStringList &paths)
+{
+    struct Job
+    {
+        QString path;
+        Key key;
+        QByteArray hash;
+    };
+
+    QVector<QByteArray> result(paths.size());
+    QVector<Job> misses;
+    QVector<int> missIndexes;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < paths.size(); ++i) {
+            Key key;
+            if (!fileKey(paths[i], &key))
+                continue;
+
+            auto it = m_entries.find(key);
+            if (it != m_entries.end()) {
+                if (!it.value().used) {
+                    it.value().used = true;
+                    m_dirty = true;
+                }
+                result[i] = it.value().hash;
+                continue;
+            }
+
+            Job job;
+            job.path = paths[i];
+            job.key = key;
+            misses.append(job);
+            missIndexes.append(i);
+        }
+    }
+
+    if (misses.isEmpty())
+        return result;
+
+    // Чтение и хэширование — в глобальном пуле потоков
+    QtConcurrent::blockingMap(misses, [](Job &job) {
+        job.hash = computeHash(job.path);
+    });
+
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < misses.size(); ++i) {
+        const Job &job = misses[i];
+        result[missIndexes[i]] = job.hash;
+        if (job.hash.isEmpty())
+            continue;
+
+        Value value;
+        value.hash = job.hash;
+        value.used = true;
+        m_entries.insert(job.key, value);
+        m_dirty = true;
+    }
+
+    return result;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Кэш хэшей содержимого файлов.
+// Ключ — (устройство, inode, размер, mtime в наносекундах): пока они не изменились,
+// файл повторно не читается. Кэш сохраняется на диск между запусками.
+class HashCache
+{
+public:
+    explicit HashCache(const QString &storagePath);
+    ~HashCache();
+
+    bool load();
+    bool save();
+    bool isDirty() const;
+
+    QByteArray hashFile(const QString &path);
+    // Хэши для списка файлов: промахи кэша считаются параллельно в пуле потоков
+    QVector<QByteArray> hashFiles(const QStringList &paths);
+
+    static QByteArray computeHash(const QString &path);
+
+private:
+    struct Key
+    {
+        quint64 device = 0;
+        quint64 inode = 0;
+        qint64 size = 0;
+        qint64 mtimeNs = 0;
+
+        bool operator==(const Key &other) const
+        {
+            return device == other.device && inode == other.inode
+                    && size == other.size && mtimeNs == other.mtimeNs;
+        }
+    };
+
+    struct Value
+    {
+        QByteArray hash;
+        bool used = false; // встречался в текущем запуске — сохраняется при save()
+    };
+
+    friend uint qHash(const Key &key, uint seed);
+
+    static bool fileKey(const QString &path, Key *key);
+
+    QString m_storagePath;
+    mutable QMutex m_mutex;
+    QHash<Key, Value> m_entries;
+    bool m_dirty = false;
+};
@@ -0,0 +1,161 @@
+#include "HotFileCache.h"
+#include <QObject>
+#include <QRunnable>
+#include <QTimer>
+
+class HotFileCache::LoadTask : public QRunnable
+{
+public:
+    LoadTask(HotFileCache *cache, const Key &key, const Loader &loader)
+        : m_cache(cache), m_key(key), m_loader(loader) {}
+
+    void run() override { m_cache->load(m_key, m_loader); }
+
+private:
+    HotFileCache *m_cache;
+    Key m_key;
+    Loader m_loader;
+};
+
+HotFileCache::HotFileCache(qint64 capacity, qint64 maxEntrySize)
+    : m_capacity(qMax<qint64>(0, capacity)), m_maxEntrySize(maxEntrySize)
+{
+}
+
+HotFileCache::~HotFileCache()
+{
+    waitForLoads();
+}
+
+void HotFileCache::setCapacity(qint64 capacity)
+{
+    QMutexLocker locker(&m_mutex);
+    m_capacity = qMax<qint64>(0, capacity);
+    evict();
+}
+
+void HotFileCache::fetch(const Key &key, QObject *context, const Loader &loader, const Callback &callback)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        ++m_stats.hits;
+        touch(key, *it);
+        // Копия разделяет данные с записью кэша (implicit sharing)
+        const QByteArray content = it->content;
+        const bool compressed = it->compressed;
+        locker.unlock();
+        callback(content, compressed, true);
+        return;
+    }
+
+    auto flight = m_flights.find(key);
+    if (flight != m_flights.end()) {
+        ++m_stats.shared;
+        flight->waiters.append(Waiter{ context, callback });
+        return;
+    }
+
+    ++m_stats.misses;
+    Flight &started = m_flights[key];
+    started.waiters.append(Waiter{ context, callback });
+    locker.unlock();
+
+    // Вызывающий поток не занят чтением: пока файл читается, он принимает
+    // следующие запросы, и те ждут эту же загрузку
+    m_loaders.start(new LoadTask(this, key, loader));
+}
+
+void HotFileCache::waitForLoads()
+{
+    m_loaders.waitForDone();
+}
+
+void HotFileCache::load(const Key &key, const Loader &loader)
+{
+    // Чтение идёт без блокировки: другие файлы обслуживаются параллельно
+    QByteArray content;
+    bool compressed = false;
+    const bool ok = loader(&content, &compressed);
+
+    QVector<Waiter> waiters;
+    {
+        QMutexLocker locker(&m_mutex);
+        const Flight flight = m_flights.take(key);
+        waiters = flight.waiters;
+
+        if (ok && !flight.invalidated && content.size() <= m_maxEntrySize && content.size() <= m_capacity) {
+            removeEntry(key);
+            Entry &entry = m_entries[key];
+            entry.content = content;
+            entry.compressed = compressed;
+            touch(key, entry);
+            m_byFile.insert(qMakePair(key.rootIndex, key.path), key);
+            m_stats.bytes += content.size();
+            evict();
+        }
+    }
+
+    for (const Waiter &waiter : waiters) {
+        // Соединение ожидавшего клиента уже закрыто — ответ некому отправлять
+        QObject *context = waiter.context.data();
+        if (!context)
+            continue;
+        const Callback waiterCallback = waiter.callback;
+        QTimer::singleShot(0, context, [waiterCallback, content, compressed, ok]() {
+            waiterCallback(content, compressed, ok);
+        });
+    }
+}
+
+void HotFileCache::invalidate(int rootIndex, const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const FileKey file = qMakePair(rootIndex, path);
+    const QList<Key> keys = m_byFile.values(file);
+    for (const Key &key : keys)
+        removeEntry(key);
+
+    for (auto it = m_flights.begin(); it != m_flights.end(); ++it) {
+        if (it.key().rootIndex == rootIndex && it.key().path == path)
+            it->invalidated = true;
+    }
+}
+
+HotFileCache::Stats HotFileCache::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats stats = m_stats;
+    stats.entries = m_entries.size();
+    return stats;
+}
+
+void HotFileCache::touch(const Key &key, Entry &entry)
+{
+    if (entry.tick)
+        m_lru.remove(entry.tick);
+    entry.tick = ++m_nextTick;
+    m_lru.insert(entry.tick, key);
+}
+
+void HotFileCache::removeEntry(const Key &key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+
+    m_lru.remove(it->tick);
+    m_byFile.remove(qMakePair(key.rootIndex, key.path), key);
+    m_stats.bytes -= it->content.size();
+    m_entries.erase(it);
+}
+
+void HotFileCache::evict()
+{
+    while (m_stats.bytes > m_capacity && !m_lru.isEmpty()) {
+        const Key key = m_lru.first();
+        removeEntry(key);
+    }
+}
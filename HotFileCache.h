@@ -0,0 +1,114 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QPointer>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+
+class QObject;
+
+// Кэш тел ответов /download для недавно изменённых файлов.
+// После уведомления все клиенты почти одновременно запрашивают один и тот же файл:
+// он читается (и сжимается) один раз, остальные запросы ждут ту же загрузку
+// (single-flight) и получают общую копию. Чтение идёт в собственном пуле потоков,
+// поэтому ожидание работает и тогда, когда все запросы обслуживает один поток
+// (--workers 0). Размер ограничен, вытесняются давно не запрошенные записи (LRU).
+// Потокобезопасен.
+class HotFileCache
+{
+public:
+    struct Key
+    {
+        int rootIndex;
+        QString path;
+        quint64 version;
+        qint64 modified;    // mtime файла: правка мимо индекса даёт новый ключ
+        bool gzip;          // клиент принимает gzip; сжимать ли, решает загрузка
+
+        bool operator==(const Key &other) const
+        {
+            return rootIndex == other.rootIndex && version == other.version && modified == other.modified
+                   && gzip == other.gzip && path == other.path;
+        }
+    };
+
+    struct Stats
+    {
+        qint64 bytes = 0;
+        int entries = 0;
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 shared = 0;  // дождались загрузки, начатой другим запросом
+    };
+
+    // Заполняет content и compressed (тело в gzip); false — файл прочитать не удалось
+    typedef std::function<bool(QByteArray *content, bool *compressed)> Loader;
+    typedef std::function<void(const QByteArray &content, bool compressed, bool ok)> Callback;
+
+    explicit HotFileCache(qint64 capacity = 256 * 1024 * 1024, qint64 maxEntrySize = 4 * 1024 * 1024);
+    ~HotFileCache();
+
+    void setCapacity(qint64 capacity);
+    qint64 maxEntrySize() const { return m_maxEntrySize; }
+
+    // Попадание вызывает callback сразу в вызывающем потоке. Иначе loader выполняется
+    // в пуле кэша, а callback доставляется в поток context (если тот ещё существует)
+    void fetch(const Key &key, QObject *context, const Loader &loader, const Callback &callback);
+    // Дожидается начатых загрузок: loader может ссылаться на объекты владельца кэша
+    void waitForLoads();
+    // Все версии файла (вызывается по событиям FileMonitor)
+    void invalidate(int rootIndex, const QString &path);
+
+    Stats stats() const;
+
+private:
+    typedef QPair<int, QString> FileKey;
+    class LoadTask;
+
+    struct Entry
+    {
+        QByteArray content;
+        bool compressed = false;
+        quint64 tick = 0;       // позиция в m_lru
+    };
+
+    struct Waiter
+    {
+        QPointer<QObject> context; // сокет клиента; обнуляется, если клиент отключился раньше
+        Callback callback;
+    };
+
+    struct Flight
+    {
+        QVector<Waiter> waiters;
+        bool invalidated = false; // файл изменился во время чтения — результат не кэшируем
+    };
+
+    mutable QMutex m_mutex;
+    qint64 m_capacity;
+    qint64 m_maxEntrySize;
+    QHash<Key, Entry> m_entries;
+    QMap<quint64, Key> m_lru;           // от давно запрошенных к недавним
+    QMultiHash<FileKey, Key> m_byFile;  // для invalidate
+    QHash<Key, Flight> m_flights;
+    quint64 m_nextTick = 0;
+    Stats m_stats;
+    QThreadPool m_loaders;
+
+    void load(const Key &key, const Loader &loader);
+    void touch(const Key &key, Entry &entry);
+    void removeEntry(const Key &key);
+    void evict();
+};
+
+inline uint qHash(const HotFileCache::Key &key, uint seed = 0)
+{
+    return qHash(key.path, seed) ^ qHash(key.version, seed) ^ qHash(key.modified, seed)
+           ^ uint(key.rootIndex) ^ (key.gzip ? 0x9e3779b9u : 0u);
+}
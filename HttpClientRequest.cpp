@@ -0,0 +1,396 @@
+#include "HttpClientRequest.h"
+#include "HttpConnection.h"
+#include "FileStreamer.h"
+#include "Compression.h"
+#include <QTcpSocket>
+#include <QDebug>
+#include <cstring>
+
+HttpClientRequest::HttpClientRequest(const QHostAddress &host, quint16 port, QObject *parent)
+    : QObject(parent), m_ownConnection(new HttpConnection(host, port, false, this))
+{
+}
+
+HttpClientRequest::HttpClientRequest(HttpConnectionPool *pool, QObject *parent)
+    : QObject(parent), m_pool(pool)
+{
+}
+
+HttpClientRequest::~HttpClientRequest()
+{
+    // Ответ удалённого запроса остался бы в соединении непрочитанным
+    if (!m_done && m_connection && m_connection != m_ownConnection)
+        m_connection->abandon(this);
+}
+
+void HttpClientRequest::setHeader(const QByteArray &name, const QByteArray &value)
+{
+    m_headers.append(qMakePair(name, value));
+}
+
+void HttpClientRequest::setBodyFile(const QString &filePath, qint64 offset, qint64 length)
+{
+    m_bodyFile = filePath;
+    m_bodyOffset = offset;
+    m_bodyLength = length;
+}
+
+void HttpClientRequest::limitResponseBody(qint64 length)
+{
+    // Граница задана в байтах файла — для раскодируемого тела она не имеет смысла
+    if (m_chunked || m_decoder)
+        return;
+    m_contentLength = m_contentLength < 0 ? length : qMin(m_contentLength, length);
+}
+
+void HttpClientRequest::start()
+{
+    if (m_pool)
+        m_pool->submit(this);
+    else
+        m_ownConnection->submit(this);
+}
+
+void HttpClientRequest::abort()
+{
+    if (m_done)
+        return;
+
+    m_errorString = "Aborted";
+    m_socketError = QAbstractSocket::OperationError;
+    // Остальные запросы соединения пул отправит заново по другому
+    QPointer<HttpConnection> connection = m_connection;
+    m_connection = nullptr;
+    if (connection)
+        connection->abandon(this);
+    finish(false);
+}
+
+QByteArray HttpClientRequest::responseHeader(const QByteArray &name) const
+{
+    return m_responseHeaders.value(name.toLower());
+}
+
+bool HttpClientRequest::send(QTcpSocket *socket, bool keepAlive)
+{
+    m_socket = socket;
+
+    // Сжатое тело из файла идёт потоком — длина заранее не известна
+    const bool streamCompressed = m_compressBody && !m_bodyFile.isEmpty();
+    if (!m_bodyPrepared) {
+        // При повторе тело уже подготовлено
+        m_bodyPrepared = true;
+        if (m_compressBody && m_bodyFile.isEmpty()) {
+            // Короткое тело дешевле отправить как есть
+            if (m_body.size() >= Compression::MinSize)
+                m_body = Compression::compress(m_body);
+            else
+                m_compressBody = false;
+        }
+    }
+
+    // Файл открывается до отправки заголовков: иначе соединение осталось бы с половиной запроса
+    if (!m_bodyFile.isEmpty()) {
+        m_streamer = new FileStreamer(socket, m_bodyFile, m_bodyOffset, m_bodyLength, this);
+        m_streamer->setCompressed(streamCompressed);
+        if (!m_streamer->open()) {
+            delete m_streamer;
+            m_streamer = nullptr;
+            m_errorString = "Cannot open " + m_bodyFile;
+            m_connection = nullptr;
+            finish(false);
+            return false;
+        }
+    }
+
+    const qint64 bodySize = m_bodyFile.isEmpty() ? m_body.size() : m_bodyLength;
+
+    QByteArray request;
+    request += m_method + " " + m_path + " HTTP/1.1\r\n";
+    request += "Host: syncserver\r\n";
+    for (const auto &header : m_headers)
+        request += header.first + ": " + header.second + "\r\n";
+    if (m_compressBody && bodySize > 0)
+        request += "Content-Encoding: " + QByteArray(Compression::Encoding) + "\r\n";
+    if (streamCompressed)
+        request += "Transfer-Encoding: chunked\r\n";
+    else if (bodySize > 0 || m_method == "POST")
+        request += "Content-Length: " + QByteArray::number(bodySize) + "\r\n";
+    request += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+    socket->write(request);
+
+    if (!m_streamer) {
+        if (!m_body.isEmpty())
+            socket->write(m_body);
+        m_bodySent = true;
+        return true;
+    }
+
+    // Тело из файла отправляется порциями, без чтения файла целиком
+    connect(m_streamer, &FileStreamer::finished, this, [this](bool ok) {
+        m_bodySent = ok;
+        if (!ok && !m_done) {
+            m_errorString = "Request body was not sent completely";
+            QPointer<HttpConnection> connection = m_connection;
+            m_connection = nullptr;
+            if (connection)
+                connection->abandon(this);
+            finish(false);
+        }
+    });
+    m_streamer->start();
+    return true;
+}
+
+qint64 HttpClientRequest::feed(const char *data, qint64 size)
+{
+    if (m_done)
+        return 0;
+
+    m_responseStarted = true;
+    qint64 used = 0;
+
+    if (!m_headersParsed) {
+        const int buffered = m_buffer.size();
+        m_buffer.append(data, int(size));
+
+        int from = qMax(0, m_headerScanPos - 3);
+        int headerEnd = m_buffer.indexOf("\r\n\r\n", from);
+        if (headerEnd == -1) {
+            m_headerScanPos = m_buffer.size();
+            return size;
+        }
+
+        if (!parseResponseHead(m_buffer.left(headerEnd + 4))) {
+            m_errorString = "Malformed response";
+            finish(false);
+            return -1;
+        }
+
+        m_headersParsed = true;
+        // Остаток порции — тело этого ответа и, возможно, следующие ответы
+        used = headerEnd + 4 - buffered;
+        m_buffer.clear();
+
+        emit headersReceived();
+        if (m_done)
+            return used;
+    }
+
+    const qint64 consumed = consumeBody(data + used, size - used);
+    if (consumed < 0) {
+        m_errorString = "Cannot store response body";
+        finish(false);
+        return -1;
+    }
+    used += consumed;
+
+    if (bodyComplete()) {
+        // Сжатый поток должен закончиться вместе с телом
+        QByteArray tail;
+        if (m_decoder && !m_decoder->finish(&tail)) {
+            m_errorString = "Truncated compressed response";
+            finish(false);
+            return -1;
+        }
+        finish(true);
+    }
+    return used;
+}
+
+bool HttpClientRequest::keepsConnection() const
+{
+    // Тело запроса ещё отправляется (сервер ответил раньше) — соединение занято
+    if (!m_bodySent || m_responseHeaders.value("connection").toLower().contains("close"))
+        return false;
+    if (m_chunked)
+        return m_chunkState == ChunkDone;
+    // Без Content-Length конец ответа — закрытие; после limitResponseBody остаток не прочитан
+    return m_declaredLength >= 0 && m_bodyReceived >= m_declaredLength;
+}
+
+bool HttpClientRequest::prepareRetry()
+{
+    if (m_retried)
+        return false;
+
+    m_retried = true;
+    if (m_streamer) {
+        m_streamer->disconnect(this);
+        m_streamer->deleteLater();
+        m_streamer = nullptr;
+    }
+    m_socket = nullptr;
+    m_bodySent = false;
+    return true;
+}
+
+bool HttpClientRequest::bodyComplete() const
+{
+    if (m_chunked)
+        return m_chunkState == ChunkDone;
+    return m_contentLength >= 0 && m_bodyReceived >= m_contentLength;
+}
+
+bool HttpClientRequest::parseResponseHead(const QByteArray &head)
+{
+    QList<QByteArray> lines = head.split('\n');
+    QList<QByteArray> statusLine = lines.value(0).trimmed().split(' ');
+    if (statusLine.size() < 2 || !statusLine[0].startsWith("HTTP/"))
+        return false;
+
+    bool ok = false;
+    m_statusCode = statusLine[1].toInt(&ok);
+    if (!ok)
+        return false;
+
+    for (int i = 1; i < lines.size(); ++i) {
+        QByteArray line = lines[i].trimmed();
+        int colonIndex = line.indexOf(':');
+        if (colonIndex > 0)
+            m_responseHeaders[line.left(colonIndex).trimmed().toLower()] = line.mid(colonIndex + 1).trimmed();
+    }
+
+    m_chunked = m_responseHeaders.value("transfer-encoding").toLower().contains("chunked");
+    if (!m_chunked && m_responseHeaders.contains("content-length"))
+        m_contentLength = m_responseHeaders.value("content-length").toLongLong();
+    else if (!m_chunked && (m_statusCode == 204 || m_statusCode == 304))
+        m_contentLength = 0;
+    m_declaredLength = m_contentLength;
+
+    const QByteArray encoding = m_responseHeaders.value("content-encoding").toLower();
+    if (encoding == Compression::Encoding)
+        m_decoder.reset(new GzipStream(GzipStream::Decompress));
+    else if (!encoding.isEmpty() && encoding != "identity")
+        return false;
+
+    return true;
+}
+
+qint64 HttpClientRequest::consumeBody(const char *data, qint64 size)
+{
+    if (m_chunked)
+        return consumeChunked(data, size);
+
+    // Байты после конца тела относятся к следующему ответу
+    if (m_contentLength >= 0)
+        size = qMin(size, m_contentLength - m_bodyReceived);
+    if (size <= 0)
+        return 0;
+
+    m_bodyReceived += size;
+    return storeBody(data, size) ? size : -1;
+}
+
+qint64 HttpClientRequest::consumeChunked(const char *data, qint64 size)
+{
+    const char *pos = data;
+    const char *end = data + size;
+
+    while (pos < end && m_chunkState != ChunkDone) {
+        if (m_chunkState == ChunkData) {
+            const qint64 take = qMin<qint64>(m_chunkRemaining, end - pos);
+            m_bodyReceived += take;
+            if (!storeBody(pos, take))
+                return -1;
+            pos += take;
+            m_chunkRemaining -= take;
+            if (m_chunkRemaining == 0)
+                m_chunkState = ChunkDataEnd;
+            continue;
+        }
+
+        // Служебные строки (размер, CRLF после данных, трейлер) собираются целиком
+        const char *lineEnd = static_cast<const char *>(memchr(pos, '\n', size_t(end - pos)));
+        if (!lineEnd) {
+            m_chunkBuffer.append(pos, int(end - pos));
+            return m_chunkBuffer.size() <= 1024 ? size : -1;
+        }
+        m_chunkBuffer.append(pos, int(lineEnd - pos));
+        pos = lineEnd + 1;
+        const QByteArray line = m_chunkBuffer.trimmed();
+        m_chunkBuffer.clear();
+
+        switch (m_chunkState) {
+        case ChunkSize: {
+            bool ok = false;
+            m_chunkRemaining = line.split(';').value(0).trimmed().toLongLong(&ok, 16);
+            if (!ok || m_chunkRemaining < 0)
+                return -1;
+            m_chunkState = m_chunkRemaining == 0 ? ChunkTrailer : ChunkData;
+            break;
+        }
+        case ChunkDataEnd:
+            if (!line.isEmpty())
+                return -1;
+            m_chunkState = ChunkSize;
+            break;
+        case ChunkTrailer:
+            if (line.isEmpty())
+                m_chunkState = ChunkDone;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return pos - data;
+}
+
+bool HttpClientRequest::storeBody(const char *data, qint64 size)
+{
+    QByteArray plain;
+    if (m_decoder) {
+        if (!m_decoder->process(data, size, &plain))
+            return false;
+        data = plain.constData();
+        size = plain.size();
+        if (size == 0)
+            return true;
+    }
+
+    if (m_responseDevice)
+        return m_responseDevice->write(data, size) == size;
+
+    m_responseBody.append(data, int(size));
+    return true;
+}
+
+void HttpClientRequest::connectionClosed()
+{
+    if (m_done)
+        return;
+
+    // Без Content-Length тело заканчивается закрытием соединения
+    QByteArray tail;
+    const bool complete = m_headersParsed
+            && (m_chunked ? m_chunkState == ChunkDone : (m_contentLength < 0 || m_bodyReceived >= m_contentLength))
+            && (!m_decoder || m_decoder->finish(&tail));
+    if (!complete) {
+        m_errorString = "Connection closed before response was complete";
+        m_socketError = QAbstractSocket::RemoteHostClosedError;
+    }
+    m_connection = nullptr;
+    finish(complete);
+}
+
+void HttpClientRequest::connectionFailed(QAbstractSocket::SocketError error, const QString &reason)
+{
+    if (m_done)
+        return;
+
+    m_socketError = error;
+    m_errorString = reason;
+    m_connection = nullptr;
+    finish(false);
+}
+
+void HttpClientRequest::finish(bool ok)
+{
+    if (m_done)
+        return;
+
+    m_done = true;
+    emit finished(ok);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QObject>
+#include <QHostAddress>
+#include <QAbstractSocket>
+#include <QByteArray>
+#include <QMap>
+#include <QPointer>
+#include <QScopedPointer>
+
+class QTcpSocket;
+class QIODevice;
+class FileStreamer;
+class GzipStream;
+class HttpConnection;
+class HttpConnectionPool;
+
+// Один HTTP-запрос клиента к серверу синхронизации.
+// Тело запроса может передаваться потоково из файла, тело ответа — писаться
+// сразу в устройство (например, во временный файл), без накопления в памяти.
+// Ответы с chunked-кодированием и Content-Encoding: gzip раскодируются на лету.
+// Запрос через пул идёт по постоянному соединению (keep-alive), иначе — по своему,
+// которое закрывается после ответа.
+class HttpClientRequest : public QObject
+{
+    Q_OBJECT
+public:
+    HttpClientRequest(const QHostAddress &host, quint16 port, QObject *parent = nullptr);
+    HttpClientRequest(HttpConnectionPool *pool, QObject *parent = nullptr);
+    ~HttpClientRequest();
+
+    void setMethod(const QByteArray &method) { m_method = method; }
+    void setPath(const QByteArray &path) { m_path = path; }
+    void setHeader(const QByteArray &name, const QByteArray &value);
+    void setBody(const QByteArray &body) { m_body = body; }
+    void setBodyFile(const QString &filePath, qint64 offset, qint64 length);
+    // Тело запроса сжимается gzip; тело из файла — потоково, chunked-кодированием
+    void setCompressBody(bool compress) { m_compressBody = compress; }
+    // Тело ответа пишется в device; устройство должно быть открыто на запись
+    void setResponseDevice(QIODevice *device) { m_responseDevice = device; }
+    // Принять только первые length байт тела (без chunked и сжатия), остаток ответа не читать
+    void limitResponseBody(qint64 length);
+    // Короткий запрос с коротким ответом: может идти по соединению вслед за другими
+    // такими же, не дожидаясь их ответов (конвейер). Тело из файла не допускается
+    void setPipelined(bool pipelined) { m_pipelined = pipelined; }
+    bool isPipelined() const { return m_pipelined && m_bodyFile.isEmpty(); }
+
+    void start();
+    void abort();
+
+    int statusCode() const { return m_statusCode; }
+    QByteArray responseHeader(const QByteArray &name) const;
+    const QByteArray &responseBody() const { return m_responseBody; }
+    qint64 bytesReceived() const { return m_bodyReceived; }
+    QString errorString() const { return m_errorString; }
+    // Ошибка сокета, если запрос не выполнен из-за соединения
+    QAbstractSocket::SocketError socketError() const { return m_socketError; }
+
+signals:
+    // Статус и заголовки ответа разобраны, тело ещё не принято: здесь можно выбрать
+    // устройство для тела (setResponseDevice) или прервать запрос
+    void headersReceived();
+    // ok — получен полный ответ (статус может быть любым)
+    void finished(bool ok);
+
+private:
+    friend class HttpConnection;
+
+    HttpConnectionPool *m_pool = nullptr;
+    HttpConnection *m_ownConnection = nullptr; // без пула
+    QPointer<HttpConnection> m_connection;     // соединение, по которому идёт запрос
+    QTcpSocket *m_socket = nullptr;
+    FileStreamer *m_streamer = nullptr;
+    bool m_bodySent = false;
+    bool m_pipelined = false;
+    bool m_bodyPrepared = false;
+    bool m_retried = false;
+
+    QByteArray m_method = "GET";
+    QByteArray m_path = "/";
+    QList<QPair<QByteArray, QByteArray>> m_headers;
+    QByteArray m_body;
+    QString m_bodyFile;
+    qint64 m_bodyOffset = 0;
+    qint64 m_bodyLength = 0;
+    bool m_compressBody = false;
+
+    QIODevice *m_responseDevice = nullptr;
+    QByteArray m_buffer;
+    int m_headerScanPos = 0;
+    bool m_headersParsed = false;
+    int m_statusCode = 0;
+    QMap<QByteArray, QByteArray> m_responseHeaders;
+    qint64 m_contentLength = -1;
+    qint64 m_declaredLength = -1;       // Content-Length ответа до limitResponseBody
+    qint64 m_bodyReceived = 0;
+    bool m_chunked = false;
+    enum ChunkState { ChunkSize, ChunkData, ChunkDataEnd, ChunkTrailer, ChunkDone };
+    ChunkState m_chunkState = ChunkSize;
+    qint64 m_chunkRemaining = 0;
+    QByteArray m_chunkBuffer;           // неполная строка размера или трейлера
+    QScopedPointer<GzipStream> m_decoder;
+    QByteArray m_responseBody;
+    QString m_errorString;
+    QAbstractSocket::SocketError m_socketError = QAbstractSocket::UnknownSocketError;
+    bool m_responseStarted = false;
+    bool m_done = false;
+
+    // Вызовы HttpConnection
+    bool send(QTcpSocket *socket, bool keepAlive);
+    // Разбирает начало данных; возвращает число байт, относящихся к этому ответу, или -1
+    qint64 feed(const char *data, qint64 size);
+    void connectionClosed();
+    void connectionFailed(QAbstractSocket::SocketError error, const QString &reason);
+    bool responseStarted() const { return m_responseStarted; }
+    bool isDone() const { return m_done; }
+    // Соединение пригодно для следующего запроса: ответ дочитан, тело запроса отправлено
+    bool keepsConnection() const;
+    // Один повтор после закрытия соединения сервером до начала ответа
+    bool prepareRetry();
+
+    bool parseResponseHead(const QByteArray &head);
+    // Число байт, относящихся к телу этого ответа, или -1
+    qint64 consumeBody(const char *data, qint64 size);
+    qint64 consumeChunked(const char *data, qint64 size);
+    bool storeBody(const char *data, qint64 size);
+    bool bodyComplete() const;
+    void finish(bool ok);
+};
@@ -0,0 +1,230 @@
+#include "HttpConnection.h"
+#include "HttpClientRequest.h"
+#include <QTcpSocket>
+
+HttpConnection::HttpConnection(const QHostAddress &host, quint16 port, bool keepAlive, QObject *parent)
+    : QObject(parent), m_host(host), m_port(port), m_keepAlive(keepAlive), m_socket(new QTcpSocket(this))
+{
+    connect(m_socket, &QTcpSocket::connected, this, &HttpConnection::onConnected);
+    connect(m_socket, &QTcpSocket::readyRead, this, &HttpConnection::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &HttpConnection::onDisconnected);
+    connect(m_socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+            this, &HttpConnection::onError);
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(IdleTimeoutMs);
+    connect(&m_idleTimer, &QTimer::timeout, this, &HttpConnection::close);
+}
+
+bool HttpConnection::canPipeline() const
+{
+    if (m_closing || !m_keepAlive || m_queue.isEmpty() || m_queue.size() >= MaxPipelineDepth)
+        return false;
+
+    // Вслед за передачей файла не отправляем ничего: её ответ может идти долго
+    for (const QPointer<HttpClientRequest> &request : m_queue) {
+        if (!request || !request->isPipelined())
+            return false;
+    }
+    return true;
+}
+
+void HttpConnection::submit(HttpClientRequest *request)
+{
+    m_idleTimer.stop();
+    m_queue.append(request);
+    request->m_connection = this;
+
+    if (m_socket->state() == QAbstractSocket::UnconnectedState) {
+        m_socket->connectToHost(m_host, m_port);
+        return;
+    }
+
+    // Ещё не подключились — запрос отправится в onConnected вместе с остальными
+    if (m_socket->state() == QAbstractSocket::ConnectedState && !request->send(m_socket, m_keepAlive)) {
+        if (m_closing)
+            return;
+        m_queue.removeAll(request);
+        if (m_queue.isEmpty()) {
+            m_idleTimer.start();
+            emit idle();
+        }
+    }
+}
+
+void HttpConnection::abandon(HttpClientRequest *request)
+{
+    if (!m_queue.contains(request))
+        return;
+
+    m_queue.removeAll(request);
+    shutdown(false, true, QAbstractSocket::OperationError, "Another request on the connection was aborted");
+}
+
+void HttpConnection::close()
+{
+    shutdown(true, true, QAbstractSocket::RemoteHostClosedError, "Connection closed");
+}
+
+void HttpConnection::onConnected()
+{
+    // Запросы, поставленные во время подключения, уходят одним пакетом по порядку
+    const QList<QPointer<HttpClientRequest>> queue = m_queue;
+    for (const QPointer<HttpClientRequest> &request : queue) {
+        // Неудачная отправка могла закрыть соединение вместе с остальной очередью
+        if (m_closing)
+            return;
+        if (request && !request->send(m_socket, m_keepAlive))
+            m_queue.removeAll(request);
+    }
+
+    if (m_queue.isEmpty() && !m_closing) {
+        m_idleTimer.start();
+        emit idle();
+    }
+}
+
+void HttpConnection::onReadyRead()
+{
+    const QByteArray data = m_socket->readAll();
+    const char *pos = data.constData();
+    qint64 left = data.size();
+
+    // В одной порции данных может быть конец одного ответа и начало следующего
+    while (left > 0 && !m_closing) {
+        if (m_queue.isEmpty() || !m_queue.first()) {
+            shutdown(false, false, QAbstractSocket::UnknownSocketError, "Unexpected data from server");
+            return;
+        }
+
+        HttpClientRequest *request = m_queue.first();
+        const qint64 used = request->feed(pos, left);
+        // Обработчик ответа мог прервать запрос, а с ним и соединение
+        if (m_closing)
+            return;
+        if (used < 0) {
+            shutdown(false, false, QAbstractSocket::UnknownSocketError, request->errorString());
+            return;
+        }
+
+        pos += used;
+        left -= used;
+        if (!request->isDone())
+            break;
+
+        m_queue.removeFirst();
+        ++m_completed;
+        if (!m_keepAlive || !request->keepsConnection()) {
+            // Сервер закрывает соединение или остаток ответа не прочитан
+            shutdown(true, true, QAbstractSocket::RemoteHostClosedError, "Server closed the connection");
+            return;
+        }
+    }
+
+    if (!m_closing && m_queue.isEmpty()) {
+        m_idleTimer.start();
+        emit idle();
+    }
+}
+
+void HttpConnection::onDisconnected()
+{
+    if (m_closing)
+        return;
+
+    // Ответ без Content-Length заканчивается закрытием соединения
+    if (!m_queue.isEmpty() && m_queue.first() && m_queue.first()->responseStarted()) {
+        HttpClientRequest *request = m_queue.takeFirst();
+        request->connectionClosed();
+    }
+
+    // Закрытое по keep-alive соединение: остальные запросы сервер не получил
+    shutdown(false, m_completed > 0, QAbstractSocket::RemoteHostClosedError,
+             "Connection closed before response was complete");
+}
+
+void HttpConnection::onError(QAbstractSocket::SocketError error)
+{
+    // Закрытие соединения сервером обрабатывается в onDisconnected
+    if (error == QAbstractSocket::RemoteHostClosedError || m_closing)
+        return;
+
+    shutdown(false, m_completed > 0, error, m_socket->errorString());
+}
+
+void HttpConnection::shutdown(bool graceful, bool retry, QAbstractSocket::SocketError error, const QString &reason)
+{
+    if (m_closing)
+        return;
+
+    m_closing = true;
+    m_idleTimer.stop();
+    const QList<QPointer<HttpClientRequest>> queue = m_queue;
+    m_queue.clear();
+
+    if (graceful)
+        m_socket->disconnectFromHost();
+    else
+        m_socket->abort();
+
+    // Повторить можно только через пул; одиночное соединение запрос не переотправит
+    const bool canRetry = retry && m_keepAlive;
+    for (const QPointer<HttpClientRequest> &request : queue) {
+        if (!request || request->isDone())
+            continue;
+        request->m_connection = nullptr;
+        if (canRetry && !request->responseStarted() && request->prepareRetry())
+            emit requeue(request);
+        else
+            request->connectionFailed(error, reason);
+    }
+
+    emit closed();
+}
+
+HttpConnectionPool::HttpConnectionPool(const QHostAddress &host, quint16 port, QObject *parent)
+    : QObject(parent), m_host(host), m_port(port)
+{
+}
+
+void HttpConnectionPool::submit(HttpClientRequest *request)
+{
+    HttpConnection *target = nullptr;
+    for (HttpConnection *connection : m_connections) {
+        if (connection->isIdle()) {
+            target = connection;
+            break;
+        }
+    }
+
+    // Короткий запрос встаёт в самый короткий конвейер, а не открывает соединение
+    if (!target && request->isPipelined()) {
+        for (HttpConnection *connection : m_connections) {
+            if (connection->canPipeline() && (!target || connection->queueSize() < target->queueSize()))
+                target = connection;
+        }
+    }
+
+    if (!target) {
+        target = new HttpConnection(m_host, m_port, true, this);
+        m_connections.append(target);
+        connect(target, &HttpConnection::idle, this, &HttpConnectionPool::trimIdle);
+        connect(target, &HttpConnection::requeue, this, &HttpConnectionPool::submit);
+        connect(target, &HttpConnection::closed, this, [this, target]() {
+            m_connections.removeAll(target);
+            target->deleteLater();
+        });
+    }
+
+    target->submit(request);
+}
+
+void HttpConnectionPool::trimIdle()
+{
+    int idle = 0;
+    const QList<HttpConnection *> connections = m_connections;
+    for (HttpConnection *connection : connections) {
+        if (connection->isIdle() && ++idle > MaxIdleConnections)
+            connection->close();
+    }
+}
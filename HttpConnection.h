@@ -0,0 +1,87 @@
+#pragma once
+
+#include <QObject>
+#include <QHostAddress>
+#include <QAbstractSocket>
+#include <QList>
+#include <QPointer>
+#include <QTimer>
+
+class QTcpSocket;
+class HttpClientRequest;
+
+// Одно TCP-соединение клиента с сервером, по которому запросы идут друг за другом.
+// Короткие запросы (HttpClientRequest::setPipelined) отправляются, не дожидаясь ответов
+// на предыдущие (конвейер HTTP/1.1); ответы разбираются строго по порядку.
+// Передача файла занимает соединение целиком до своего окончания.
+class HttpConnection : public QObject
+{
+    Q_OBJECT
+public:
+    HttpConnection(const QHostAddress &host, quint16 port, bool keepAlive, QObject *parent = nullptr);
+
+    bool isIdle() const { return m_queue.isEmpty() && !m_closing; }
+    bool isClosing() const { return m_closing; }
+    int queueSize() const { return m_queue.size(); }
+    // Можно отправить ещё один короткий запрос вслед за уже отправленными
+    bool canPipeline() const;
+
+    void submit(HttpClientRequest *request);
+    // Запрос прерван или удалён посреди обмена: поток ответов больше не разобрать,
+    // остальные запросы соединения повторяются по другому
+    void abandon(HttpClientRequest *request);
+    // Закрытие свободного соединения
+    void close();
+
+signals:
+    // Очередь опустела, соединение можно отдать следующему запросу
+    void idle();
+    void closed();
+    // Запрос отправлен по ранее использованному соединению, но сервер закрыл его,
+    // не начав ответа (истёк keep-alive) — запрос стоит повторить по новому
+    void requeue(HttpClientRequest *request);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError error);
+
+private:
+    static const int MaxPipelineDepth = 8;
+    static const int IdleTimeoutMs = 10 * 1000; // меньше keep-alive сервера (15 с)
+
+    QHostAddress m_host;
+    quint16 m_port;
+    bool m_keepAlive;
+    QTcpSocket *m_socket;
+    QList<QPointer<HttpClientRequest>> m_queue;  // отправлены или ждут соединения, по порядку ответов
+    QTimer m_idleTimer;
+    int m_completed = 0;        // ответов получено по этому соединению
+    bool m_closing = false;
+
+    // graceful — ответы получены, соединение закрывается штатно; retry — запросы без
+    // начатого ответа повторяются (requeue), иначе завершаются ошибкой error
+    void shutdown(bool graceful, bool retry, QAbstractSocket::SocketError error, const QString &reason);
+};
+
+// Постоянные соединения с одним сервером. Запрос получает свободное соединение,
+// короткий запрос может встать в конвейер занятого, и только при их отсутствии
+// открывается новое. Свободные соединения закрываются по таймауту.
+class HttpConnectionPool : public QObject
+{
+    Q_OBJECT
+public:
+    HttpConnectionPool(const QHostAddress &host, quint16 port, QObject *parent = nullptr);
+
+    void submit(HttpClientRequest *request);
+
+private:
+    static const int MaxIdleConnections = 4;
+
+    QHostAddress m_host;
+    quint16 m_port;
+    QList<HttpConnection *> m_connections;
+
+    void trimIdle();
+};
@@ -0,0 +1,118 @@
+#include "IndexStore.h"
+#include "Log.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+
+static const quint32 IndexMagic = 0x58444953; // "SIDX"
+static const quint32 IndexFormatVersion = 1;
+static const int HeaderSize = 16;             // magic, формат, число записей (u64)
+static const int RecordHeaderSize = 17;       // rootIndex u32, version u64, длины пути u16, типа u16, хэша u8
+static const int WriteChunk = 1024 * 1024;
+
+bool IndexStore::save(const QString &path, const QList<FileEntry> &entries)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QByteArray buffer;
+    buffer.reserve(WriteChunk + 4096);
+
+    uchar header[HeaderSize];
+    qToLittleEndian<quint32>(IndexMagic, header);
+    qToLittleEndian<quint32>(IndexFormatVersion, header + 4);
+    qToLittleEndian<quint64>(quint64(entries.size()), header + 8);
+    buffer.append(reinterpret_cast<const char *>(header), HeaderSize);
+
+    for (const FileEntry &entry : entries) {
+        const QByteArray path = entry.path.toUtf8();
+        const QByteArray type = entry.type.toUtf8().left(0xffff);
+        if (path.size() > 0xffff || entry.hash.size() > 0xff)
+            continue;
+
+        uchar record[RecordHeaderSize];
+        qToLittleEndian<quint32>(quint32(entry.rootIndex), record);
+        qToLittleEndian<quint64>(entry.version, record + 4);
+        qToLittleEndian<quint16>(quint16(path.size()), record + 12);
+        qToLittleEndian<quint16>(quint16(type.size()), record + 14);
+        record[16] = uchar(entry.hash.size());
+
+        buffer.append(reinterpret_cast<const char *>(record), RecordHeaderSize);
+        buffer.append(path);
+        buffer.append(type);
+        buffer.append(entry.hash);
+
+        if (buffer.size() >= WriteChunk) {
+            if (file.write(buffer) != buffer.size())
+                return false;
+            buffer.clear();
+        }
+    }
+
+    if (file.write(buffer) != buffer.size())
+        return false;
+    return file.commit();
+}
+
+int IndexStore::load(const QString &path, const std::function<void(const FileEntry &)> &func)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < HeaderSize)
+        return -1;
+
+    const qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+    if (!data)
+        return -1;
+
+    const uchar *pos = data;
+    const uchar *end = data + size;
+
+    if (qFromLittleEndian<quint32>(pos) != IndexMagic
+            || qFromLittleEndian<quint32>(pos + 4) != IndexFormatVersion) {
+        qCWarning(lcServer) << "IndexStore: unknown index format in" << path;
+        return -1;
+    }
+
+    const quint64 count = qFromLittleEndian<quint64>(pos + 8);
+    pos += HeaderSize;
+
+    FileEntry entry;
+    quint64 loaded = 0;
+    for (; loaded < count; ++loaded) {
+        if (end - pos < RecordHeaderSize)
+            break;
+
+        const int pathSize = qFromLittleEndian<quint16>(pos + 12);
+        const int typeSize = qFromLittleEndian<quint16>(pos + 14);
+        const int hashSize = pos[16];
+        if (end - pos < RecordHeaderSize + pathSize + typeSize + hashSize)
+            break;
+
+        entry.rootIndex = int(qFromLittleEndian<quint32>(pos));
+        entry.version = qFromLittleEndian<quint64>(pos + 4);
+        pos += RecordHeaderSize;
+        entry.path = QString::fromUtf8(reinterpret_cast<const char *>(pos), pathSize);
+        pos += pathSize;
+        entry.type = QString::fromUtf8(reinterpret_cast<const char *>(pos), typeSize);
+        pos += typeSize;
+        entry.hash = QByteArray(reinterpret_cast<const char *>(pos), hashSize);
+        pos += hashSize;
+
+        func(entry);
+    }
+
+    file.unmap(const_cast<uchar *>(data));
+
+    if (loaded != count) {
+        // Усечённый файл: загруженное остаётся, фоновая проверка досчитает остальное
+        qCWarning(lcServer) << "IndexStore: index truncated," << loaded << "of" << count << "entries loaded";
+    }
+    return int(loaded);
+}
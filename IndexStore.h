@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <functional>
+#include "FileEntry.h"
+
+// Файл с сохранённым индексом сервера.
+// Записи фиксированного формата (little-endian) читаются прямо из отображённого
+// в память файла, поэтому загрузка занимает доли секунды даже на больших деревьях.
+class IndexStore
+{
+public:
+    static bool save(const QString &path, const QList<FileEntry> &entries);
+    // Возвращает число загруженных записей или -1, если файла нет или он повреждён
+    static int load(const QString &path, const std::function<void(const FileEntry &)> &func);
+};
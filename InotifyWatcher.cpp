@@ -0,0 +1,171 @@
+#include "InotifyWatcher.h"
+#include "Log.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QDebug>
+#include <sys/inotify.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static const uint32_t WatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+        | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONTFOLLOW | IN_EXCL_UNLINK;
+
+InotifyWatcher::InotifyWatcher(QObject *parent)
+    : QObject(parent)
+{
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        qCWarning(lcMonitor) << "inotify_init1 failed:" << strerror(errno);
+        return;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &InotifyWatcher::readEvents);
+}
+
+InotifyWatcher::~InotifyWatcher()
+{
+    delete m_notifier;
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+bool InotifyWatcher::addDirectory(const QString &path)
+{
+    if (m_fd < 0)
+        return false;
+
+    const int wd = ::inotify_add_watch(m_fd, QFile::encodeName(path).constData(), WatchMask);
+    if (wd < 0) {
+        // ENOSPC — исчерпан лимит fs.inotify.max_user_watches
+        qCWarning(lcMonitor) << "inotify_add_watch failed for" << path << ":" << strerror(errno);
+        return false;
+    }
+
+    // Тот же каталог мог быть добавлен под другим путём
+    const QString previous = m_paths.value(wd);
+    if (!previous.isEmpty() && previous != path)
+        m_watches.remove(previous);
+
+    m_paths[wd] = path;
+    m_watches[path] = wd;
+    return true;
+}
+
+void InotifyWatcher::addTree(const QString &path)
+{
+    addDirectory(path);
+
+    QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        addDirectory(it.next());
+}
+
+void InotifyWatcher::removeTree(const QString &path)
+{
+    const QString prefix = path + '/';
+    QVector<int> removed;
+    for (auto it = m_watches.constBegin(); it != m_watches.constEnd(); ++it) {
+        if (it.key() == path || it.key().startsWith(prefix))
+            removed.append(it.value());
+    }
+
+    for (int wd : removed) {
+        ::inotify_rm_watch(m_fd, wd);
+        forgetWatch(wd);
+    }
+}
+
+void InotifyWatcher::forgetWatch(int wd)
+{
+    const QString path = m_paths.take(wd);
+    if (!path.isEmpty() && m_watches.value(path) == wd)
+        m_watches.remove(path);
+}
+
+void InotifyWatcher::readEvents()
+{
+    QVector<InotifyEvent> events;
+    // cookie -> индекс события IN_MOVED_FROM в пачке, для склейки с парным IN_MOVED_TO
+    QHash<quint32, int> pendingMoves;
+
+    auto add = [&](InotifyEvent::Type type, const QString &path) {
+        InotifyEvent event;
+        event.type = type;
+        event.path = path;
+        events.append(event);
+    };
+
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (true) {
+        const ssize_t n = ::read(m_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // EAGAIN — очередь прочитана
+
+        for (const char *p = buffer; p < buffer + n; ) {
+            const struct inotify_event *ev = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                add(InotifyEvent::Overflow, QString());
+                continue;
+            }
+
+            if (ev->mask & IN_IGNORED) {
+                // Наблюдение снято ядром (каталог удалён) или через removeTree
+                forgetWatch(ev->wd);
+                continue;
+            }
+
+            const QString dir = m_paths.value(ev->wd);
+            if (dir.isEmpty())
+                continue;
+
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // Для вложенных каталогов то же событие уже пришло от родителя,
+                // для корневых это единственное уведомление
+                add(InotifyEvent::DirRemoved, dir);
+                continue;
+            }
+
+            if (ev->len == 0)
+                continue;
+
+            const QString path = dir + '/' + QFile::decodeName(ev->name);
+            const bool isDir = ev->mask & IN_ISDIR;
+
+            if (ev->mask & IN_MOVED_FROM) {
+                pendingMoves.insert(ev->cookie, events.size());
+                add(isDir ? InotifyEvent::DirRemoved : InotifyEvent::FileRemoved, path);
+            } else if (ev->mask & IN_MOVED_TO) {
+                auto from = pendingMoves.find(ev->cookie);
+                if (from != pendingMoves.end()) {
+                    // Переименование внутри дерева: одно событие вместо удаления и создания
+                    InotifyEvent &event = events[from.value()];
+                    event.type = isDir ? InotifyEvent::DirMoved : InotifyEvent::FileMoved;
+                    event.oldPath = event.path;
+                    event.path = path;
+                    pendingMoves.erase(from);
+                } else {
+                    add(isDir ? InotifyEvent::DirCreated : InotifyEvent::FileWritten, path);
+                }
+            } else if (ev->mask & IN_CREATE) {
+                // Для файлов дождёмся IN_CLOSE_WRITE
+                if (isDir)
+                    add(InotifyEvent::DirCreated, path);
+            } else if (ev->mask & IN_CLOSE_WRITE) {
+                add(InotifyEvent::FileWritten, path);
+            } else if (ev->mask & IN_DELETE) {
+                add(isDir ? InotifyEvent::DirRemoved : InotifyEvent::FileRemoved, path);
+            }
+        }
+    }
+
+    if (!events.isEmpty())
+        emit eventsReady(events);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class QSocketNotifier;
+
+// Событие файловой системы, уже переведённое в полные пути
+struct InotifyEvent
+{
+    enum Type {
+        FileWritten,      // файл закрыт после записи или перемещён в каталог
+        FileRemoved,      // файл удалён или перемещён из каталога
+        FileMoved,        // переименование внутри отслеживаемого дерева (oldPath -> path)
+        DirCreated,
+        DirRemoved,
+        DirMoved,
+        Overflow          // очередь ядра переполнена, часть событий потеряна
+    };
+
+    Type type;
+    QString path;
+    QString oldPath;
+};
+
+// Наблюдение за каталогами через inotify (только Linux).
+// Все каталоги отслеживаются через один дескриптор, события читаются пачками
+// и отдаются одним сигналом на пачку. Файлы по отдельности не отслеживаются.
+class InotifyWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit InotifyWatcher(QObject *parent = nullptr);
+    ~InotifyWatcher();
+
+    bool isValid() const { return m_fd >= 0; }
+
+    bool addDirectory(const QString &path);
+    // Каталог и все вложенные (скрытые пропускаются)
+    void addTree(const QString &path);
+    // Снять наблюдение с каталога и всех вложенных
+    void removeTree(const QString &path);
+
+    int watchCount() const { return m_paths.size(); }
+
+signals:
+    void eventsReady(const QVector<InotifyEvent> &events);
+
+private slots:
+    void readEvents();
+
+private:
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QHash<int, QString> m_paths;   // дескриптор наблюдения -> каталог
+    QHash<QString, int> m_watches; // каталог -> дескриптор наблюдения
+
+    void forgetWatch(int wd);
+};
@@ -0,0 +1,195 @@
+#include "Log.h"
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QThread>
+#include <stdio.h>
+
+Q_LOGGING_CATEGORY(lcServer, "sync.server")
+Q_LOGGING_CATEGORY(lcClient, "sync.client")
+Q_LOGGING_CATEGORY(lcMonitor, "sync.monitor")
+Q_LOGGING_CATEGORY(lcDelta, "sync.delta")
+Q_LOGGING_CATEGORY(lcApp, "sync.app")
+
+namespace {
+
+// Ограниченная очередь многих писателей и одного читателя (схема Д. Вьюкова):
+// писатель занимает ячейку сдвигом m_enqueuePos и публикует её номером последовательности,
+// без блокировок и без ожидания читателя
+class MessageQueue
+{
+public:
+    static const int Capacity = 8192; // степень двойки
+
+    MessageQueue()
+    {
+        for (int i = 0; i < Capacity; ++i)
+            m_cells[i].sequence.store(quint32(i));
+    }
+
+    bool push(const QByteArray &line)
+    {
+        quint32 pos = m_enqueuePos.load();
+        Cell *cell;
+        for (;;) {
+            cell = &m_cells[pos & (Capacity - 1)];
+            const qint32 diff = qint32(cell->sequence.loadAcquire() - pos);
+            if (diff == 0) {
+                if (m_enqueuePos.testAndSetRelaxed(pos, pos + 1))
+                    break;
+                pos = m_enqueuePos.load();
+            } else if (diff < 0) {
+                return false; // очередь полна
+            } else {
+                pos = m_enqueuePos.load();
+            }
+        }
+
+        cell->line = line;
+        cell->sequence.storeRelease(pos + 1);
+        return true;
+    }
+
+    // Только из потока записи
+    bool pop(QByteArray *line)
+    {
+        Cell *cell = &m_cells[m_dequeuePos & (Capacity - 1)];
+        if (qint32(cell->sequence.loadAcquire() - (m_dequeuePos + 1)) < 0)
+            return false;
+
+        line->swap(cell->line);
+        cell->line.clear();
+        cell->sequence.storeRelease(m_dequeuePos + Capacity);
+        ++m_dequeuePos;
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        QAtomicInteger<quint32> sequence;
+        QByteArray line;
+    };
+
+    Cell m_cells[Capacity];
+    QAtomicInteger<quint32> m_enqueuePos;
+    quint32 m_dequeuePos = 0;
+};
+
+class LogWriter : public QThread
+{
+public:
+    MessageQueue queue;
+    QAtomicInteger<quint32> dropped;
+    QAtomicInt stopping;
+
+    // Читатель один: поток записи, а после его остановки — Log::shutdown()
+    void drain()
+    {
+        QByteArray batch;
+        QByteArray line;
+        while (queue.pop(&line)) {
+            batch += line;
+            if (batch.size() >= 64 * 1024)
+                flush(&batch);
+        }
+        const quint32 lost = dropped.fetchAndStoreRelaxed(0);
+        if (lost)
+            batch += "Log queue overflow: " + QByteArray::number(lost) + " messages dropped\n";
+        flush(&batch);
+    }
+
+protected:
+    void run() override
+    {
+        while (!stopping.load()) {
+            drain();
+            // Очередь пуста: писатели не будят поток, он просыпается сам
+            msleep(5);
+        }
+    }
+
+private:
+    static void flush(QByteArray *batch)
+    {
+        if (batch->isEmpty())
+            return;
+        fwrite(batch->constData(), 1, size_t(batch->size()), stderr);
+        fflush(stderr);
+        batch->clear();
+    }
+};
+
+LogWriter *g_writer = nullptr;
+int g_maxLength = Log::DefaultMaxLength;
+
+void writeSync(const QByteArray &line)
+{
+    fwrite(line.constData(), 1, size_t(line.size()), stderr);
+    fflush(stderr);
+}
+
+void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    QString text = message;
+    if (text.size() > g_maxLength) {
+        const int total = text.size();
+        text.truncate(g_maxLength);
+        text += QString("... (%1 chars)").arg(total);
+    }
+    const QByteArray line = qFormatLogMessage(type, context, text).toLocal8Bit() + '\n';
+
+    // Аварийное сообщение пишется сразу: после обработчика процесс завершится
+    if (!g_writer || type == QtFatalMsg || g_writer->stopping.load()) {
+        writeSync(line);
+        return;
+    }
+
+    if (!g_writer->queue.push(line))
+        g_writer->dropped.fetchAndAddRelaxed(1);
+}
+
+} // namespace
+
+void Log::install(int maxLength)
+{
+    if (g_writer)
+        return;
+
+    g_maxLength = qMax(16, maxLength);
+    g_writer = new LogWriter;
+    g_writer->setObjectName("SyncLog");
+    g_writer->start(QThread::LowPriority);
+    qInstallMessageHandler(messageHandler);
+    // Очередь дописывается при завершении приложения, в том числе при выходе из main() по ошибке
+    qAddPostRoutine(Log::shutdown);
+}
+
+void Log::shutdown()
+{
+    if (!g_writer || g_writer->stopping.load())
+        return;
+
+    // Объект потока не удаляется: другие потоки ещё могут проверять его флаг в обработчике
+    g_writer->stopping.store(1);
+    g_writer->wait();
+    g_writer->drain();
+}
+
+bool Log::setLevel(const QString &level)
+{
+    static const char *const levels[] = { "debug", "info", "warning", "critical" };
+    const int count = int(sizeof(levels) / sizeof(levels[0]));
+
+    int index = 0;
+    while (index < count && level.compare(QLatin1String(levels[index]), Qt::CaseInsensitive) != 0)
+        ++index;
+    if (index == count)
+        return false;
+
+    // Правила применяются по порядку: всё ниже выбранного уровня выключается
+    QString rules;
+    for (int i = 0; i < count; ++i)
+        rules += QString("*.%1=%2\n").arg(QLatin1String(levels[i])).arg(i >= index ? "true" : "false");
+    QLoggingCategory::setFilterRules(rules);
+    return true;
+}
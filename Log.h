@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QByteArray>
+#include <QLoggingCategory>
+#include <QString>
+
+// Категории сообщений по модулям. Уровни включаются во время работы (--log-level,
+// QT_LOGGING_RULES="sync.monitor.debug=true"), а при сборке с CONFIG+=quiet_log
+// qCDebug/qCInfo не компилируются вовсе. Выключенный уровень стоит одной проверки:
+// аргументы qCDebug не вычисляются.
+Q_DECLARE_LOGGING_CATEGORY(lcServer)
+Q_DECLARE_LOGGING_CATEGORY(lcClient)
+Q_DECLARE_LOGGING_CATEGORY(lcMonitor)
+Q_DECLARE_LOGGING_CATEGORY(lcDelta)     // DeltaSync, общий для клиента и сервера
+Q_DECLARE_LOGGING_CATEGORY(lcApp)       // запуск и разбор параметров
+
+// Асинхронный вывод: обработчик сообщений Qt только кладёт готовую строку в
+// неблокирующую очередь, в stderr пишет отдельный поток. Если очередь полна,
+// сообщение отбрасывается (с подсчётом), а не задерживает цикл событий.
+class Log
+{
+public:
+    static const int DefaultMaxLength = 1024; // символов в одном сообщении
+
+    // Вызывается один раз после создания QCoreApplication; maxLength — длина,
+    // после которой сообщение обрезается
+    static void install(int maxLength = DefaultMaxLength);
+    // Дописывает очередь и останавливает поток; дальнейшие сообщения пишутся синхронно.
+    // Вызывается автоматически при уничтожении QCoreApplication
+    static void shutdown();
+    // debug, info, warning или critical — для всех категорий, включая сообщения без категории.
+    // QT_LOGGING_RULES из окружения имеет приоритет
+    static bool setLevel(const QString &level);
+};
+
+// Начало содержимого (тела запроса, ответа) для отладочного вывода
+static inline QByteArray logPayload(const QByteArray &data, int maxSize = 256)
+{
+    if (data.size() <= maxSize)
+        return data;
+    return data.left(maxSize) + "... (" + QByteArray::number(data.size()) + " bytes)";
+}
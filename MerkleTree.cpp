@@ -0,0 +1,184 @@
+#include "MerkleTree.h"
+#include <QCryptographicHash>
+#include <QStringList>
+#include <algorithm>
+
+static QString parentOf(const QString &path)
+{
+    const int slash = path.lastIndexOf('/');
+    return slash < 0 ? QString() : path.left(slash);
+}
+
+static QString nameOf(const QString &path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+QString MerkleTree::childPath(const QString &dirPath, const QString &name)
+{
+    return dirPath.isEmpty() ? name : dirPath + '/' + name;
+}
+
+void MerkleTree::insert(const FileEntry &entry)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const QString dirPath = parentOf(entry.path);
+    Leaf leaf;
+    leaf.version = entry.version;
+    leaf.hash = entry.hash;
+    m_dirs[qMakePair(entry.rootIndex, dirPath)].files.insert(nameOf(entry.path), leaf);
+
+    // Каталог регистрируется у всех предков, которые его ещё не знают
+    QString child = dirPath;
+    while (!child.isEmpty()) {
+        const QString parent = parentOf(child);
+        Dir &dir = m_dirs[qMakePair(entry.rootIndex, parent)];
+        const QString name = nameOf(child);
+        if (dir.subdirs.contains(name))
+            break;
+        dir.subdirs.insert(name);
+        child = parent;
+    }
+
+    markDirty(entry.rootIndex, dirPath);
+}
+
+void MerkleTree::remove(int rootIndex, const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString dirPath = parentOf(path);
+    auto it = m_dirs.find(qMakePair(rootIndex, dirPath));
+    if (it == m_dirs.end() || it->files.remove(nameOf(path)) == 0)
+        return;
+
+    // Опустевшие каталоги удаляются, чтобы хэш не зависел от истории изменений
+    while (!dirPath.isEmpty()) {
+        auto dir = m_dirs.find(qMakePair(rootIndex, dirPath));
+        if (dir == m_dirs.end() || !dir->files.isEmpty() || !dir->subdirs.isEmpty())
+            break;
+        m_dirs.erase(dir);
+
+        const QString parent = parentOf(dirPath);
+        auto parentDir = m_dirs.find(qMakePair(rootIndex, parent));
+        if (parentDir != m_dirs.end())
+            parentDir->subdirs.remove(nameOf(dirPath));
+        dirPath = parent;
+    }
+
+    markDirty(rootIndex, dirPath);
+}
+
+void MerkleTree::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_dirs.clear();
+}
+
+void MerkleTree::markDirty(int rootIndex, QString dirPath)
+{
+    while (true) {
+        auto it = m_dirs.find(qMakePair(rootIndex, dirPath));
+        if (it != m_dirs.end())
+            it->dirty = true;
+        if (dirPath.isEmpty())
+            break;
+        dirPath = parentOf(dirPath);
+    }
+}
+
+QByteArray MerkleTree::hashLocked(const Key &key)
+{
+    auto it = m_dirs.find(key);
+    if (it == m_dirs.end())
+        return QByteArray();
+
+    Dir &dir = it.value();
+    if (!dir.dirty)
+        return dir.hash;
+
+    if (dir.files.isEmpty() && dir.subdirs.isEmpty()) {
+        // Пустой каталог равнозначен отсутствующему
+        dir.hash.clear();
+        dir.dirty = false;
+        return dir.hash;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    QStringList subdirs(dir.subdirs.begin(), dir.subdirs.end());
+#else
+    QStringList subdirs = dir.subdirs.toList();
+#endif
+    std::sort(subdirs.begin(), subdirs.end());
+
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    for (const QString &name : subdirs) {
+        // Вложенные вызовы не добавляют элементов в m_dirs, ссылка dir остаётся действительной
+        const QByteArray subHash = hashLocked(qMakePair(key.first, childPath(key.second, name)));
+        md5.addData("D", 1);
+        md5.addData(name.toUtf8());
+        md5.addData("\0", 1);
+        md5.addData(subHash);
+    }
+    for (auto file = dir.files.constBegin(); file != dir.files.constEnd(); ++file) {
+        const Leaf &leaf = file.value();
+        md5.addData("F", 1);
+        md5.addData(file.key().toUtf8());
+        md5.addData("\0", 1);
+        md5.addData(leaf.hash.isEmpty() ? QByteArray::number(leaf.version) : leaf.hash);
+    }
+
+    dir.hash = md5.result();
+    dir.dirty = false;
+    return dir.hash;
+}
+
+QByteArray MerkleTree::hash(int rootIndex, const QString &dirPath)
+{
+    QMutexLocker locker(&m_mutex);
+    return hashLocked(qMakePair(rootIndex, dirPath));
+}
+
+MerkleTree::Node MerkleTree::node(int rootIndex, const QString &dirPath, bool withChildren)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Node node;
+    node.rootIndex = rootIndex;
+    node.path = dirPath;
+
+    const Key key = qMakePair(rootIndex, dirPath);
+    node.hash = hashLocked(key);
+    if (!withChildren || node.hash.isEmpty())
+        return node;
+
+    const Dir &dir = m_dirs[key];
+    for (const QString &name : dir.subdirs)
+        node.subdirs.insert(name, hashLocked(qMakePair(rootIndex, childPath(dirPath, name))));
+    node.files = dir.files;
+    return node;
+}
+
+QList<FileEntry> MerkleTree::files(int rootIndex, const QString &dirPath)
+{
+    QMutexLocker locker(&m_mutex);
+    QList<FileEntry> result;
+    collectFiles(qMakePair(rootIndex, dirPath), &result);
+    return result;
+}
+
+void MerkleTree::collectFiles(const Key &key, QList<FileEntry> *files) const
+{
+    auto it = m_dirs.constFind(key);
+    if (it == m_dirs.constEnd())
+        return;
+
+    for (auto file = it->files.constBegin(); file != it->files.constEnd(); ++file) {
+        FileEntry entry(childPath(key.second, file.key()), "file", file.value().version, key.first);
+        entry.hash = file.value().hash;
+        files->append(entry);
+    }
+    for (const QString &name : it->subdirs)
+        collectFiles(qMakePair(key.first, childPath(key.second, name)), files);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include "FileEntry.h"
+
+// Дерево хэшей по иерархии каталогов каждого корня (rootIndex).
+// Хэш каталога — MD5 от имён и хэшей его файлов и подкаталогов, поэтому
+// совпадение хэшей корней означает совпадение всего дерева.
+// Хэши пересчитываются лениво: изменение файла помечает цепочку каталогов до корня.
+class MerkleTree
+{
+public:
+    struct Leaf
+    {
+        quint64 version = 0;
+        QByteArray hash;
+
+        bool sameContent(const Leaf &other) const
+        {
+            if (!hash.isEmpty() && !other.hash.isEmpty())
+                return hash == other.hash;
+            return version == other.version;
+        }
+    };
+
+    // Состояние каталога; hash пустой, если каталога (файлов в нём) нет
+    struct Node
+    {
+        int rootIndex = 0;
+        QString path;                      // относительно корня, "" — сам корень
+        QByteArray hash;
+        QMap<QString, QByteArray> subdirs; // имя -> хэш поддерева
+        QMap<QString, Leaf> files;         // имя -> версия и хэш содержимого
+    };
+
+    // Запрос узла: withChildren — нужен ли список детей или только хэш
+    struct Query
+    {
+        int rootIndex = 0;
+        QString path;
+        bool withChildren = false;
+    };
+
+    void insert(const FileEntry &entry);
+    void remove(int rootIndex, const QString &path);
+    void clear();
+
+    QByteArray hash(int rootIndex, const QString &dirPath = QString());
+    Node node(int rootIndex, const QString &dirPath, bool withChildren);
+    // Все файлы поддерева с путями относительно корня
+    QList<FileEntry> files(int rootIndex, const QString &dirPath);
+
+    static QString childPath(const QString &dirPath, const QString &name);
+
+private:
+    typedef QPair<int, QString> Key;
+
+    struct Dir
+    {
+        QMap<QString, Leaf> files;
+        QSet<QString> subdirs;
+        QByteArray hash;
+        bool dirty = true;
+    };
+
+    QMutex m_mutex;
+    QHash<Key, Dir> m_dirs;
+
+    void markDirty(int rootIndex, QString dirPath);
+    QByteArray hashLocked(const Key &key);
+    void collectFiles(const Key &key, QList<FileEntry> *files) const;
+};
@@ -0,0 +1,257 @@
+#include "PushSubscription.h"
+#include "Log.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+static const int MinReconnectDelayMs = 1000;
+static const int MaxReconnectDelayMs = 30 * 1000;
+static const int WatchdogTimeoutMs = 60 * 1000; // три пропущенных heartbeat сервера
+static const int MaxHeaderSize = 64 * 1024;
+static const int MaxLineSize = 1024 * 1024;
+
+PushSubscription::PushSubscription(const QHostAddress &host, quint16 port, QObject *parent)
+    : QObject(parent), m_host(host), m_port(port), m_socket(this),
+      m_reconnectTimer(this), m_watchdogTimer(this), m_reconnectDelay(MinReconnectDelayMs)
+{
+    connect(&m_socket, &QTcpSocket::connected, this, &PushSubscription::onConnected);
+    connect(&m_socket, &QTcpSocket::readyRead, this, &PushSubscription::onReadyRead);
+    connect(&m_socket, &QTcpSocket::disconnected, this, &PushSubscription::onDisconnected);
+    connect(&m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onDisconnected()));
+
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &PushSubscription::reconnect);
+
+    m_watchdogTimer.setSingleShot(true);
+    m_watchdogTimer.setInterval(WatchdogTimeoutMs);
+    connect(&m_watchdogTimer, &QTimer::timeout, this, [this]() {
+        qCWarning(lcClient) << "Push channel is silent, reconnecting";
+        m_socket.abort();
+        scheduleReconnect();
+    });
+}
+
+void PushSubscription::start()
+{
+    m_active = true;
+    reconnect();
+}
+
+void PushSubscription::stop()
+{
+    m_active = false;
+    m_reconnectTimer.stop();
+    m_watchdogTimer.stop();
+    m_socket.abort();
+}
+
+void PushSubscription::reconnect()
+{
+    if (!m_active)
+        return;
+
+    m_buffer.clear();
+    m_lines.clear();
+    m_headersParsed = false;
+    m_chunkState = ChunkSize;
+    m_chunkRemaining = 0;
+
+    m_socket.connectToHost(m_host, m_port);
+    m_watchdogTimer.start();
+}
+
+void PushSubscription::scheduleReconnect()
+{
+    if (!m_active || m_reconnectTimer.isActive())
+        return;
+
+    m_watchdogTimer.stop();
+    m_reconnectTimer.start(m_reconnectDelay);
+    // Повторные неудачи растягивают паузу, чтобы не нагружать недоступный сервер
+    m_reconnectDelay = qMin(m_reconnectDelay * 2, MaxReconnectDelayMs);
+}
+
+void PushSubscription::onConnected()
+{
+    // Продолжение с последнего полученного события той же эпохи сервера
+    QByteArray path = "/subscribe";
+    if (m_epoch != 0)
+        path += "?epoch=" + QByteArray::number(m_epoch) + "&since=" + QByteArray::number(m_lastSeq);
+
+    QByteArray request;
+    request += "GET " + path + " HTTP/1.1\r\n";
+    request += "Host: syncserver\r\n";
+    request += "Accept: application/x-ndjson\r\n";
+    request += "Connection: keep-alive\r\n\r\n";
+    m_socket.write(request);
+}
+
+void PushSubscription::onReadyRead()
+{
+    m_buffer += m_socket.readAll();
+    m_watchdogTimer.start();
+
+    if (!m_headersParsed) {
+        int headerEnd = m_buffer.indexOf("\r\n\r\n");
+        if (headerEnd == -1) {
+            if (m_buffer.size() > MaxHeaderSize) {
+                m_socket.abort();
+                scheduleReconnect();
+            }
+            return;
+        }
+
+        if (!parseHead(m_buffer.left(headerEnd + 4))) {
+            qCWarning(lcClient) << "Push subscription rejected:" << m_buffer.left(m_buffer.indexOf("\r\n"));
+            m_socket.abort();
+            scheduleReconnect();
+            return;
+        }
+
+        m_buffer.remove(0, headerEnd + 4);
+        m_headersParsed = true;
+    }
+
+    if (!parseChunks()) {
+        m_socket.abort();
+        scheduleReconnect();
+        return;
+    }
+
+    int lineEnd;
+    while ((lineEnd = m_lines.indexOf('\n')) != -1) {
+        const QByteArray line = m_lines.left(lineEnd);
+        m_lines.remove(0, lineEnd + 1);
+        if (!line.trimmed().isEmpty())
+            handleLine(line);
+    }
+
+    if (m_lines.size() > MaxLineSize) {
+        m_socket.abort();
+        scheduleReconnect();
+    }
+}
+
+bool PushSubscription::parseHead(const QByteArray &head)
+{
+    const QList<QByteArray> lines = head.split('\n');
+    const QList<QByteArray> statusLine = lines.value(0).trimmed().split(' ');
+    if (statusLine.size() < 2 || statusLine[1] != "200")
+        return false;
+
+    for (int i = 1; i < lines.size(); ++i) {
+        const QByteArray line = lines[i].trimmed().toLower();
+        if (line.startsWith("transfer-encoding:") && line.contains("chunked"))
+            return true;
+    }
+    return false;
+}
+
+bool PushSubscription::parseChunks()
+{
+    int pos = 0;
+    while (pos < m_buffer.size()) {
+        switch (m_chunkState) {
+        case ChunkSize: {
+            int lineEnd = m_buffer.indexOf("\r\n", pos);
+            if (lineEnd == -1) {
+                m_buffer.remove(0, pos);
+                return m_buffer.size() <= 64;
+            }
+            bool ok = false;
+            const QByteArray sizeField = m_buffer.mid(pos, lineEnd - pos).split(';').value(0).trimmed();
+            m_chunkRemaining = sizeField.toLongLong(&ok, 16);
+            if (!ok || m_chunkRemaining < 0)
+                return false;
+            pos = lineEnd + 2;
+            // Последний чанк: сервер завершил поток
+            if (m_chunkRemaining == 0)
+                return false;
+            m_chunkState = ChunkData;
+            break;
+        }
+        case ChunkData: {
+            const int take = int(qMin<qint64>(m_chunkRemaining, m_buffer.size() - pos));
+            m_lines.append(m_buffer.constData() + pos, take);
+            pos += take;
+            m_chunkRemaining -= take;
+            if (m_chunkRemaining == 0)
+                m_chunkState = ChunkDataEnd;
+            break;
+        }
+        case ChunkDataEnd:
+            if (m_buffer.size() - pos < 2) {
+                m_buffer.remove(0, pos);
+                return true;
+            }
+            if (m_buffer.mid(pos, 2) != "\r\n")
+                return false;
+            pos += 2;
+            m_chunkState = ChunkSize;
+            break;
+        }
+    }
+
+    m_buffer.clear();
+    return true;
+}
+
+void PushSubscription::handleLine(const QByteArray &line)
+{
+    const QJsonObject obj = QJsonDocument::fromJson(line).object();
+    if (obj.isEmpty())
+        return;
+
+    const quint64 seq = quint64(obj.value("seq").toDouble());
+
+    if (obj.contains("epoch")) {
+        // Приветствие: с какого номера продолжается поток
+        const qint64 epoch = qint64(obj.value("epoch").toDouble());
+        const bool resync = obj.value("resync").toBool()
+                            || (m_epoch != 0 && epoch != m_epoch);
+        m_epoch = epoch;
+        m_lastSeq = seq;
+        m_reconnectDelay = MinReconnectDelayMs;
+        qCDebug(lcClient) << "Push channel established, seq" << seq << (resync ? "(resync)" : "");
+        if (resync)
+            emit resyncRequired();
+        return;
+    }
+
+    if (obj.value("heartbeat").toBool()) {
+        if (seq != m_lastSeq) {
+            qCWarning(lcClient) << "Push channel lost events" << m_lastSeq << "->" << seq;
+            m_lastSeq = seq;
+            emit resyncRequired();
+        }
+        return;
+    }
+
+    if (seq != m_lastSeq + 1) {
+        qCWarning(lcClient) << "Push channel gap: expected" << m_lastSeq + 1 << "got" << seq;
+        m_lastSeq = seq;
+        emit resyncRequired();
+        return;
+    }
+
+    m_lastSeq = seq;
+
+    // Событие — пакет изменений, уже объединённых сервером по пути
+    const QJsonArray events = obj.value("events").toArray();
+    for (const QJsonValue &value : events) {
+        const QJsonObject event = value.toObject();
+        const QString path = event.value("path").toString();
+        if (!path.isEmpty())
+            emit notification(event.value("rootIndex").toInt(), path, event.value("deleted").toBool());
+    }
+}
+
+void PushSubscription::onDisconnected()
+{
+    if (!m_active)
+        return;
+
+    qCWarning(lcClient) << "Push channel closed:" << m_socket.errorString();
+    scheduleReconnect();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QObject>
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Постоянная подписка клиента на события сервера (GET /subscribe).
+// Сервер держит ответ открытым и передаёт события порциями chunked-кодирования,
+// по одной JSON-строке на событие. У каждого события свой порядковый номер:
+// пропуск номера или смена эпохи (перезапуск сервера) означает, что часть
+// событий потеряна и нужна полная сверка.
+class PushSubscription : public QObject
+{
+    Q_OBJECT
+public:
+    PushSubscription(const QHostAddress &host, quint16 port, QObject *parent = nullptr);
+
+    void start();
+    void stop();
+
+signals:
+    void notification(int rootIndex, const QString &path, bool deleted);
+    // События пропущены — состояние нужно сверить с сервером целиком
+    void resyncRequired();
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void reconnect();
+
+private:
+    enum ChunkState { ChunkSize, ChunkData, ChunkDataEnd };
+
+    QHostAddress m_host;
+    quint16 m_port;
+    QTcpSocket m_socket;
+    QTimer m_reconnectTimer;
+    QTimer m_watchdogTimer;     // сервер шлёт heartbeat; тишина — соединение потеряно
+    int m_reconnectDelay;
+    bool m_active = false;
+
+    QByteArray m_buffer;
+    bool m_headersParsed = false;
+    ChunkState m_chunkState = ChunkSize;
+    qint64 m_chunkRemaining = 0;
+    QByteArray m_lines;         // данные чанков, ещё не разбитые на строки
+
+    qint64 m_epoch = 0;         // эпоха сервера; 0 — подписки ещё не было
+    quint64 m_lastSeq = 0;
+
+    bool parseHead(const QByteArray &head);
+    bool parseChunks();
+    void handleLine(const QByteArray &line);
+    void scheduleReconnect();
+};
@@ -0,0 +1,120 @@
+#include "RequestTrace.h"
+#include <QCoreApplication>
+#include <QThread>
+
+RequestTrace::RequestTrace()
+    : m_capacity(DefaultCapacity)
+{
+    m_clock.start();
+}
+
+RequestTrace::~RequestTrace()
+{
+    qDeleteAll(m_rings);
+}
+
+void RequestTrace::setCapacity(int eventsPerThread)
+{
+    m_capacity.store(qMax(0, eventsPerThread));
+}
+
+RequestTrace::Ring *RequestTrace::createRing()
+{
+    // Первое событие потока: буфер создаётся один раз и живёт до конца работы,
+    // так что его содержимое доступно и после завершения потока
+    Ring *ring = new Ring;
+    ring->events.resize(m_capacity.load());
+    const QString name = QThread::currentThread()->objectName();
+
+    QMutexLocker locker(&m_ringsLock);
+    ring->tid = m_rings.size() + 1;
+    ring->threadName = name.isEmpty() ? "thread-" + QByteArray::number(ring->tid) : name.toUtf8();
+    m_rings.append(ring);
+    return ring;
+}
+
+void RequestTrace::record(const char *category, const char *name, quint64 requestId, qint64 startNs, qint64 endNs,
+                          const char *argName, qint64 arg)
+{
+    if (!isEnabled())
+        return;
+
+    RingRef &ref = m_threadRing.localData();
+    if (!ref.ring)
+        ref.ring = createRing();
+    Ring *ring = ref.ring;
+    if (ring->events.isEmpty())
+        return;
+
+    QMutexLocker locker(&ring->lock);
+    Event &event = ring->events[ring->next];
+    event.category = category;
+    event.name = name;
+    event.argName = argName;
+    event.requestId = requestId;
+    event.startNs = startNs;
+    event.durationNs = qMax<qint64>(0, endNs - startNs);
+    event.arg = arg;
+
+    if (++ring->next == ring->events.size()) {
+        ring->next = 0;
+        ring->wrapped = true;
+    }
+}
+
+static void appendMicroseconds(QByteArray &out, qint64 ns)
+{
+    out += QByteArray::number(ns / 1000);
+    out += '.';
+    out += QByteArray::number(ns % 1000).rightJustified(3, '0');
+}
+
+QByteArray RequestTrace::toChromeJson() const
+{
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+
+    QMutexLocker ringsLocker(&m_ringsLock);
+    for (const Ring *ring : m_rings) {
+        // Снимок под блокировкой, разметка JSON — уже без неё
+        QVector<Event> events;
+        {
+            QMutexLocker locker(&ring->lock);
+            if (ring->wrapped)
+                events = ring->events.mid(ring->next) + ring->events.mid(0, ring->next);
+            else
+                events = ring->events.mid(0, ring->next);
+        }
+
+        const QByteArray tid = QByteArray::number(ring->tid);
+        if (!first)
+            out += ',';
+        first = false;
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+                + ",\"args\":{\"name\":\"" + ring->threadName + "\"}}";
+
+        for (const Event &event : events) {
+            out += ",{\"name\":\"";
+            out += event.name;
+            out += "\",\"cat\":\"";
+            out += event.category;
+            out += "\",\"ph\":\"X\",\"ts\":";
+            appendMicroseconds(out, event.startNs);
+            out += ",\"dur\":";
+            appendMicroseconds(out, event.durationNs);
+            out += ",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"request\":";
+            out += QByteArray::number(event.requestId);
+            if (event.argName) {
+                out += ",\"";
+                out += event.argName;
+                out += "\":";
+                out += QByteArray::number(event.arg);
+            }
+            out += "}}";
+        }
+    }
+
+    out += "]}";
+    return out;
+}
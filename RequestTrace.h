@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QThreadStorage>
+#include <QVector>
+
+// Трассировка запросов сервера: интервалы (разбор, обработка, диск, отправка,
+// рассылка уведомлений) с монотонными отметками времени пишутся в кольцевой
+// буфер фиксированного размера, свой у каждого потока. Старые записи
+// перезаписываются. По запросу буфер выгружается в формате Chrome trace event
+// (JSON), который открывается в Perfetto и chrome://tracing.
+class RequestTrace
+{
+public:
+    static const int DefaultCapacity = 16384; // событий на поток
+
+    RequestTrace();
+    ~RequestTrace();
+
+    // Размер буфера для потоков, которые ещё ничего не записали; 0 — трассировка выключена.
+    // Задаётся до начала работы (до listen()).
+    void setCapacity(int eventsPerThread);
+    bool isEnabled() const { return m_capacity.load() > 0; }
+
+    // Наносекунды от создания объекта, монотонно
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+    quint64 nextRequestId() { return m_nextRequestId.fetchAndAddRelaxed(1) + 1; }
+
+    // name, category и argName — строковые литералы: в буфер пишется только указатель
+    void record(const char *category, const char *name, quint64 requestId, qint64 startNs, qint64 endNs,
+                const char *argName = nullptr, qint64 arg = 0);
+
+    QByteArray toChromeJson() const;
+
+private:
+    struct Event
+    {
+        const char *category;
+        const char *name;
+        const char *argName;
+        quint64 requestId;
+        qint64 startNs;
+        qint64 durationNs;
+        qint64 arg;
+    };
+
+    // Буфер одного потока. Пишет только владелец, так что блокировка почти
+    // всегда свободна; она нужна лишь для согласованного снимка при выгрузке
+    struct Ring
+    {
+        mutable QMutex lock;
+        QVector<Event> events;
+        int next = 0;
+        bool wrapped = false;
+        int tid = 0;
+        QByteArray threadName;
+    };
+
+    QElapsedTimer m_clock;
+    QAtomicInteger<int> m_capacity;
+    QAtomicInteger<quint64> m_nextRequestId;
+    // Обёртка, а не Ring *: QThreadStorage удаляет указатели при завершении потока
+    struct RingRef
+    {
+        Ring *ring = nullptr;
+    };
+
+    QThreadStorage<RingRef> m_threadRing;
+    mutable QMutex m_ringsLock;
+    QList<Ring *> m_rings;
+
+    Ring *createRing();
+
+    RequestTrace(const RequestTrace &) = delete;
+    RequestTrace &operator=(const RequestTrace &) = delete;
+};
+
+// Интервал от создания до уничтожения объекта
+class TraceSpan
+{
+public:
+    TraceSpan(RequestTrace &trace, const char *category, const char *name, quint64 requestId = 0)
+        : m_trace(trace), m_category(category), m_name(name), m_requestId(requestId),
+          m_startNs(trace.isEnabled() ? trace.now() : -1) {}
+    ~TraceSpan()
+    {
+        if (m_startNs >= 0)
+            m_trace.record(m_category, m_name, m_requestId, m_startNs, m_trace.now(), m_argName, m_arg);
+    }
+
+    void setArg(const char *name, qint64 value) { m_argName = name; m_arg = value; }
+
+private:
+    RequestTrace &m_trace;
+    const char *m_category;
+    const char *m_name;
+    quint64 m_requestId;
+    qint64 m_startNs;
+    const char *m_argName = nullptr;
+    qint64 m_arg = 0;
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
@@ -0,0 +1,251 @@
+#include "SegmentedDownload.h"
+#include "HttpClientRequest.h"
+#include "Log.h"
+#include <QFile>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+static const qint64 MinSegmentSize = 4 * 1024 * 1024;  // мельче дробить — накладные расходы на соединения
+static const int SampleIntervalMs = 1000;
+static const double MinGrowthGain = 1.1;                 // прирост скорости, ради которого держим ещё поток
+static const int MaxSegmentRetries = 3;
+
+SegmentedDownload::SegmentedDownload(const RequestFactory &factory, const QByteArray &path, const QString &partPath,
+                                     qint64 size, const QByteArray &etag, int maxStreams, QObject *parent)
+    : QObject(parent), m_factory(factory), m_path(path), m_partPath(partPath),
+      m_size(size), m_etag(etag), m_maxStreams(qMax(1, maxStreams))
+{
+    m_targetStreams = qMin(m_targetStreams, m_maxStreams);
+    m_sampleTimer.setInterval(SampleIntervalMs);
+    connect(&m_sampleTimer, &QTimer::timeout, this, &SegmentedDownload::sample);
+}
+
+SegmentedDownload::~SegmentedDownload()
+{
+    for (Segment *segment : m_segments) {
+        if (segment->request) {
+            segment->request->disconnect(this);
+            segment->request->abort();
+            segment->request->deleteLater();
+        }
+        delete segment->file;
+        delete segment;
+    }
+}
+
+bool SegmentedDownload::start(HttpClientRequest *first)
+{
+    Segment *segment = new Segment;
+    segment->end = m_size;
+    segment->file = new QFile(m_partPath);
+    m_segments.append(segment);
+
+    // Файл сразу нужного размера: потоки пишут каждый в свою область
+    if (!segment->file->open(QIODevice::ReadWrite | QIODevice::Truncate) || !segment->file->resize(m_size)) {
+        fail("Cannot create " + m_partPath);
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    ::fallocate(segment->file->handle(), FALLOC_FL_KEEP_SIZE, 0, m_size);
+#endif
+
+    first->setResponseDevice(segment->file);
+    adopt(segment, first);
+
+    m_sampleTimer.start();
+    rebalance();
+    return !m_finished;
+}
+
+void SegmentedDownload::adopt(Segment *segment, HttpClientRequest *request)
+{
+    segment->request = request;
+    connect(request, &HttpClientRequest::finished, this, [this, segment](bool ok) {
+        onSegmentFinished(segment, ok);
+    });
+}
+
+bool SegmentedDownload::startSegment(Segment *segment)
+{
+    // У каждого потока свой дескриптор: запись идёт с его позиции, без общей блокировки
+    if (!segment->file) {
+        segment->file = new QFile(m_partPath);
+        if (!segment->file->open(QIODevice::ReadWrite))
+            return false;
+    }
+    if (!segment->file->seek(segment->position))
+        return false;
+
+    HttpClientRequest *request = m_factory("GET", m_path);
+    request->setHeader("Range", "bytes=" + QByteArray::number(segment->position) + "-"
+                                + QByteArray::number(segment->end - 1));
+    request->setHeader("If-Range", m_etag);
+
+    connect(request, &HttpClientRequest::headersReceived, this, [this, segment, request]() {
+        const QByteArray expected = "bytes " + QByteArray::number(segment->position) + "-";
+        if (request->statusCode() != 206 || !request->responseHeader("content-range").startsWith(expected)) {
+            // Файл на сервере сменился (If-Range не совпал) — собирать из частей нечего
+            fail("Server copy changed during segmented download");
+            return;
+        }
+        request->setResponseDevice(segment->file);
+    });
+
+    adopt(segment, request);
+    request->start();
+    return true;
+}
+
+void SegmentedDownload::onSegmentFinished(Segment *segment, bool ok)
+{
+    if (m_finished)
+        return;
+
+    HttpClientRequest *request = segment->request;
+    segment->request = nullptr;
+    request->deleteLater();
+
+    const qint64 received = request->bytesReceived();
+    m_bytesDone += received;
+    segment->position += received;
+
+    if (!segment->file->flush()) {
+        fail("Cannot write " + m_partPath);
+        return;
+    }
+
+    if (segment->position < segment->end) {
+        // Обрыв посреди диапазона — дозапрашиваем только остаток
+        if (!ok)
+            qCWarning(lcClient) << "Segment of" << m_path << "interrupted:" << request->errorString();
+        if (++segment->failures > MaxSegmentRetries || !startSegment(segment))
+            fail("Segment failed: " + request->errorString());
+        return;
+    }
+
+    segment->file->close();
+    delete segment->file;
+    m_segments.removeOne(segment);
+    delete segment;
+
+    if (m_segments.isEmpty()) {
+        complete();
+        return;
+    }
+    // Освободившийся поток забирает часть самого большого из оставшихся диапазонов
+    rebalance();
+}
+
+bool SegmentedDownload::splitLargest()
+{
+    Segment *largest = nullptr;
+    qint64 largestRemaining = 0;
+    for (Segment *segment : m_segments) {
+        if (!segment->request)
+            continue;
+        const qint64 remaining = segment->end - segment->position - segment->request->bytesReceived();
+        if (remaining > largestRemaining) {
+            largest = segment;
+            largestRemaining = remaining;
+        }
+    }
+
+    if (!largest || largestRemaining < 2 * MinSegmentSize)
+        return false;
+
+    // Идущий запрос дочитывает первую половину остатка, вторую берёт новый поток
+    Segment *tail = new Segment;
+    tail->end = largest->end;
+    tail->position = largest->end - largestRemaining / 2;
+    largest->end = tail->position;
+    largest->request->limitResponseBody(largest->end - largest->position);
+    m_segments.append(tail);
+
+    if (!startSegment(tail)) {
+        fail("Cannot write " + m_partPath);
+        return false;
+    }
+    return true;
+}
+
+void SegmentedDownload::rebalance()
+{
+    while (!m_finished && activeCount() < m_targetStreams && splitLargest()) {
+    }
+}
+
+void SegmentedDownload::sample()
+{
+    const qint64 total = transferred();
+    const double rate = double(total - m_lastTotal) * 1000 / SampleIntervalMs;
+    m_lastTotal = total;
+
+    if (!m_growing || m_targetStreams >= m_maxStreams)
+        return;
+
+    // Предыдущий добавленный поток не ускорил загрузку — канал уже загружен
+    if (m_rateBeforeGrowth > 0 && rate < m_rateBeforeGrowth * MinGrowthGain) {
+        m_growing = false;
+        qCDebug(lcClient) << "Segmented download of" << m_path << "settled at" << m_targetStreams << "streams";
+        return;
+    }
+
+    m_rateBeforeGrowth = rate;
+    ++m_targetStreams;
+    rebalance();
+}
+
+qint64 SegmentedDownload::transferred() const
+{
+    qint64 total = m_bytesDone;
+    for (const Segment *segment : m_segments) {
+        if (segment->request)
+            total += segment->request->bytesReceived();
+    }
+    return total;
+}
+
+int SegmentedDownload::activeCount() const
+{
+    int count = 0;
+    for (const Segment *segment : m_segments) {
+        if (segment->request)
+            ++count;
+    }
+    return count;
+}
+
+void SegmentedDownload::fail(const QString &reason)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    m_sampleTimer.stop();
+    qCWarning(lcClient) << "Segmented download of" << m_path << "failed:" << reason;
+
+    for (Segment *segment : m_segments) {
+        if (segment->request) {
+            HttpClientRequest *request = segment->request;
+            segment->request = nullptr;
+            request->disconnect(this);
+            request->abort();
+            request->deleteLater();
+        }
+        delete segment->file;
+        delete segment;
+    }
+    m_segments.clear();
+
+    QFile::remove(m_partPath);
+    emit finished(false);
+}
+
+void SegmentedDownload::complete()
+{
+    m_finished = true;
+    m_sampleTimer.stop();
+    emit finished(true);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include <functional>
+
+class HttpClientRequest;
+class QFile;
+
+// Загрузка крупного файла несколькими параллельными потоками.
+// Файл делится на диапазоны (Range), каждый пишется своим дескриптором
+// на своё место заранее выделенного временного файла. Начинаем с двух потоков
+// и добавляем следующий, пока общая скорость растёт; освободившийся поток
+// забирает половину самого большого оставшегося диапазона.
+class SegmentedDownload : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<HttpClientRequest *(const QByteArray &method, const QByteArray &path)> RequestFactory;
+
+    SegmentedDownload(const RequestFactory &factory, const QByteArray &path, const QString &partPath,
+                      qint64 size, const QByteArray &etag, int maxStreams, QObject *parent = nullptr);
+    ~SegmentedDownload();
+
+    // first — уже идущий ответ 200 на весь файл: он становится первым диапазоном.
+    // Вызывается из HttpClientRequest::headersReceived, пока тело ещё не принято
+    bool start(HttpClientRequest *first);
+
+    QString partPath() const { return m_partPath; }
+
+signals:
+    // ok — все диапазоны записаны; иначе временный файл уже удалён
+    void finished(bool ok);
+
+private:
+    struct Segment
+    {
+        qint64 position = 0;    // с какого байта идёт текущий запрос
+        qint64 end = 0;         // конец диапазона (не включая)
+        HttpClientRequest *request = nullptr;
+        QFile *file = nullptr;
+        int failures = 0;
+    };
+
+    RequestFactory m_factory;
+    QByteArray m_path;
+    QString m_partPath;
+    qint64 m_size;
+    QByteArray m_etag;
+    int m_maxStreams;
+
+    QList<Segment *> m_segments;
+    int m_targetStreams = 2;
+    bool m_growing = true;
+    qint64 m_bytesDone = 0;         // принято завершёнными запросами
+    qint64 m_lastTotal = 0;
+    double m_rateBeforeGrowth = 0;
+    QTimer m_sampleTimer;
+    bool m_finished = false;
+
+    void adopt(Segment *segment, HttpClientRequest *request);
+    bool startSegment(Segment *segment);
+    void onSegmentFinished(Segment *segment, bool ok);
+    bool splitLargest();
+    void rebalance();
+    void sample();
+    qint64 transferred() const;
+    int activeCount() const;
+    void fail(const QString &reason);
+    void complete();
+};
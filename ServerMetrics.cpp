@@ -0,0 +1,126 @@
+#include "ServerMetrics.h"
+
+const double ServerMetrics::BucketBounds[BucketCount - 1] = {
+    0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+ServerMetrics::Route ServerMetrics::routeFor(const QByteArray &head)
+{
+    static const struct { const char *prefix; Route route; } routes[] = {
+        { "GET /ping", RoutePing },
+        { "GET /register", RouteRegister },
+        { "GET /subscribe", RouteSubscribe },
+        { "POST /sync-list", RouteSyncList },
+        { "POST /merkle", RouteMerkle },
+        { "POST /upload", RouteUpload },
+        { "GET /upload-offset", RouteUploadOffset },
+        { "POST /delta-upload", RouteDeltaUpload },
+        { "GET /signature", RouteSignature },
+        { "GET /download", RouteDownload },
+        { "POST /delta-download", RouteDeltaDownload },
+        { "POST /delete", RouteDelete },
+        { "GET /metrics", RouteMetrics },
+        { "GET /trace", RouteTrace },
+    };
+
+    for (const auto &item : routes) {
+        if (head.startsWith(item.prefix))
+            return item.route;
+    }
+    return RouteOther;
+}
+
+const char *ServerMetrics::routeName(Route route)
+{
+    static const char *const names[RouteCount] = {
+        "ping", "register", "subscribe", "sync-list", "merkle",
+        "upload", "upload-offset", "delta-upload", "signature",
+        "download", "delta-download", "delete", "metrics", "trace", "other"
+    };
+    return route >= 0 && route < RouteCount ? names[route] : "other";
+}
+
+void ServerMetrics::requestFinished(Route route, qint64 elapsedUs)
+{
+    elapsedUs = qMax<qint64>(0, elapsedUs);
+    const double seconds = elapsedUs / 1e6;
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && seconds > BucketBounds[bucket])
+        ++bucket;
+
+    m_latencyBuckets[route][bucket].fetchAndAddRelaxed(1);
+    m_latencySumUs[route].fetchAndAddRelaxed(quint64(elapsedUs));
+    m_latencyCount[route].fetchAndAddRelaxed(1);
+}
+
+void ServerMetrics::rescanFinished(qint64 elapsedMs)
+{
+    m_rescans.fetchAndAddRelaxed(1);
+    m_rescanTotalMs.fetchAndAddRelaxed(quint64(qMax<qint64>(0, elapsedMs)));
+    m_lastRescanMs.store(quint64(qMax<qint64>(0, elapsedMs)));
+}
+
+static void appendHeader(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out += QByteArray("# HELP ") + name + " " + help + "\n";
+    out += QByteArray("# TYPE ") + name + " " + type + "\n";
+}
+
+static void appendValue(QByteArray &out, const QByteArray &series, double value)
+{
+    out += series + " " + QByteArray::number(value, 'g', 15) + "\n";
+}
+
+QByteArray ServerMetrics::render(const QList<Sample> &samples) const
+{
+    // Значения читаются по одному, без общего снимка: для мониторинга этого достаточно
+    QByteArray out;
+
+    appendHeader(out, "syncserver_requests_total", "counter", "HTTP requests by route");
+    for (int route = 0; route < RouteCount; ++route) {
+        appendValue(out, QByteArray("syncserver_requests_total{route=\"") + routeName(Route(route)) + "\"}",
+                    double(m_requests[route].load()));
+    }
+
+    appendHeader(out, "syncserver_request_duration_seconds", "histogram",
+                 "Time from request headers to the end of the response");
+    for (int route = 0; route < RouteCount; ++route) {
+        const quint64 count = m_latencyCount[route].load();
+        if (count == 0)
+            continue;
+        const QByteArray label = QByteArray("route=\"") + routeName(Route(route)) + "\"";
+        quint64 cumulative = 0;
+        for (int bucket = 0; bucket < BucketCount; ++bucket) {
+            cumulative += m_latencyBuckets[route][bucket].load();
+            const QByteArray le = bucket < BucketCount - 1 ? QByteArray::number(BucketBounds[bucket]) : "+Inf";
+            appendValue(out, "syncserver_request_duration_seconds_bucket{" + label + ",le=\"" + le + "\"}",
+                        double(cumulative));
+        }
+        appendValue(out, "syncserver_request_duration_seconds_sum{" + label + "}",
+                    m_latencySumUs[route].load() / 1e6);
+        appendValue(out, "syncserver_request_duration_seconds_count{" + label + "}", double(count));
+    }
+
+    appendHeader(out, "syncserver_received_bytes_total", "counter", "Bytes read from client sockets");
+    appendValue(out, "syncserver_received_bytes_total", double(m_bytesIn.load()));
+    appendHeader(out, "syncserver_sent_bytes_total", "counter", "Bytes written to client sockets");
+    appendValue(out, "syncserver_sent_bytes_total", double(m_bytesOut.load()));
+    appendHeader(out, "syncserver_connections_total", "counter", "Accepted client connections");
+    appendValue(out, "syncserver_connections_total", double(m_connections.load()));
+
+    appendHeader(out, "syncserver_monitor_events_total", "counter", "File change and removal events from FileMonitor");
+    appendValue(out, "syncserver_monitor_events_total", double(m_monitorEvents.load()));
+    appendHeader(out, "syncserver_monitor_rescans_total", "counter", "Completed FileMonitor rescans");
+    appendValue(out, "syncserver_monitor_rescans_total", double(m_rescans.load()));
+    appendHeader(out, "syncserver_monitor_rescan_seconds_total", "counter", "Time spent in FileMonitor rescans");
+    appendValue(out, "syncserver_monitor_rescan_seconds_total", m_rescanTotalMs.load() / 1e3);
+    appendHeader(out, "syncserver_monitor_last_rescan_seconds", "gauge", "Duration of the latest FileMonitor rescan");
+    appendValue(out, "syncserver_monitor_last_rescan_seconds", m_lastRescanMs.load() / 1e3);
+
+    for (const Sample &sample : samples) {
+        appendHeader(out, sample.name, sample.type, sample.help);
+        appendValue(out, sample.name, sample.value);
+    }
+
+    return out;
+}
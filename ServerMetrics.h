@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+
+// Счётчики сервера для GET /metrics (текстовый формат Prometheus).
+// Обновляются из рабочих потоков атомарными операциями без блокировок;
+// значения, которые и так хранятся под своими блокировками (число соединений,
+// размер индекса), передаются в render() как готовые отсчёты.
+class ServerMetrics
+{
+public:
+    enum Route {
+        RoutePing, RouteRegister, RouteSubscribe, RouteSyncList, RouteMerkle,
+        RouteUpload, RouteUploadOffset, RouteDeltaUpload, RouteSignature,
+        RouteDownload, RouteDeltaDownload, RouteDelete, RouteMetrics, RouteTrace, RouteOther,
+        RouteCount
+    };
+
+    // Готовое значение, снятое в момент запроса; type — "gauge" или "counter"
+    struct Sample
+    {
+        const char *name;
+        const char *type;
+        const char *help;
+        double value;
+    };
+
+    ServerMetrics() = default;
+
+    // Маршрут по строке запроса ("GET /download?..."), как в handleClientRequest
+    static Route routeFor(const QByteArray &head);
+    static const char *routeName(Route route);
+
+    void requestStarted(Route route) { m_requests[route].fetchAndAddRelaxed(1); }
+    void requestFinished(Route route, qint64 elapsedUs);
+    void addBytesIn(qint64 bytes) { m_bytesIn.fetchAndAddRelaxed(quint64(bytes)); }
+    void addBytesOut(qint64 bytes) { m_bytesOut.fetchAndAddRelaxed(quint64(bytes)); }
+    void connectionOpened() { m_connections.fetchAndAddRelaxed(1); }
+    void monitorEvents(int count) { m_monitorEvents.fetchAndAddRelaxed(quint64(count)); }
+    void rescanFinished(qint64 elapsedMs);
+
+    QByteArray render(const QList<Sample> &samples) const;
+
+private:
+    static const int BucketCount = 13;
+    static const double BucketBounds[BucketCount - 1]; // секунды; последний интервал — +Inf
+
+    QAtomicInteger<quint64> m_requests[RouteCount];
+    QAtomicInteger<quint64> m_latencyBuckets[RouteCount][BucketCount];
+    QAtomicInteger<quint64> m_latencySumUs[RouteCount];
+    QAtomicInteger<quint64> m_latencyCount[RouteCount];
+    QAtomicInteger<quint64> m_bytesIn;
+    QAtomicInteger<quint64> m_bytesOut;
+    QAtomicInteger<quint64> m_connections;
+    QAtomicInteger<quint64> m_monitorEvents;
+    QAtomicInteger<quint64> m_rescans;
+    QAtomicInteger<quint64> m_rescanTotalMs;
+    QAtomicInteger<quint64> m_lastRescanMs;
+
+    ServerMetrics(const ServerMetrics &) = delete;
+    ServerMetrics &operator=(const ServerMetrics &) = delete;
+};
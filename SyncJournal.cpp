@@ -0,0 +1,203 @@
+#include "SyncJournal.h"
+#include "Log.h"
+#include <QDataStream>
+#include <QDir>
+#include <QSaveFile>
+#include <QSet>
+#include <QDebug>
+
+static const quint32 SnapshotMagic = 0x534a534e; // "SJSN"
+static const quint32 SnapshotFormatVersion = 1;
+static const int MinCompactRecords = 1000;
+
+enum JournalOp : quint8 {
+    OpRecord = 'R',
+    OpForget = 'F'
+};
+
+static void writeEntry(QDataStream &stream, const FileEntry &entry)
+{
+    stream << qint32(entry.rootIndex) << entry.path << entry.version << entry.hash;
+}
+
+static bool readEntry(QDataStream &stream, FileEntry *entry)
+{
+    qint32 rootIndex = 0;
+    stream >> rootIndex >> entry->path >> entry->version >> entry->hash;
+    entry->rootIndex = rootIndex;
+    entry->type = "file";
+    return stream.status() == QDataStream::Ok;
+}
+
+SyncJournal::SyncJournal(const QString &directory)
+    : m_snapshotPath(directory + "/snapshot.bin"),
+      m_logPath(directory + "/journal.log"),
+      m_log(m_logPath)
+{
+    QDir().mkpath(directory);
+}
+
+SyncJournal::~SyncJournal()
+{
+    m_log.close();
+}
+
+FileEntry SyncJournal::value(const Key &key) const
+{
+    return m_entries.value(key, FileEntry(key.second, QString(), 0, key.first));
+}
+
+bool SyncJournal::load()
+{
+    m_entries.clear();
+    loadSnapshot();
+    replayLog();
+
+    if (!m_log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(lcClient) << "SyncJournal: cannot open" << m_logPath;
+        return false;
+    }
+
+    if (m_logRecords > qMax(MinCompactRecords, m_entries.size()))
+        compact();
+    return true;
+}
+
+bool SyncJournal::loadSnapshot()
+{
+    QFile file(m_snapshotPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 format = 0;
+    quint32 count = 0;
+    stream >> magic >> format >> count;
+    if (stream.status() != QDataStream::Ok || magic != SnapshotMagic || format != SnapshotFormatVersion)
+        return false;
+
+    m_entries.reserve(int(count));
+    FileEntry entry;
+    for (quint32 i = 0; i < count; ++i) {
+        if (!readEntry(stream, &entry))
+            return false;
+        m_entries.insert(qMakePair(entry.rootIndex, entry.path), entry);
+    }
+    return true;
+}
+
+void SyncJournal::replayLog()
+{
+    m_logRecords = 0;
+
+    QFile file(m_logPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    FileEntry entry;
+    qint64 validSize = 0;
+    while (!stream.atEnd()) {
+        quint8 op = 0;
+        stream >> op;
+        // Последняя запись могла не дописаться при аварийном завершении
+        if (!readEntry(stream, &entry))
+            break;
+        validSize = file.pos();
+
+        const Key key = qMakePair(entry.rootIndex, entry.path);
+        if (op == OpRecord)
+            m_entries.insert(key, entry);
+        else if (op == OpForget)
+            m_entries.remove(key);
+        ++m_logRecords;
+    }
+
+    // Недописанный хвост отрезается, иначе новые записи окажутся после мусора
+    if (validSize < file.size()) {
+        file.close();
+        QFile::resize(m_logPath, validSize);
+    }
+}
+
+void SyncJournal::append(quint8 op, const FileEntry &entry)
+{
+    if (!m_log.isOpen())
+        return;
+
+    QDataStream stream(&m_log);
+    stream << op;
+    writeEntry(stream, entry);
+    m_log.flush();
+
+    if (++m_logRecords > qMax(MinCompactRecords, m_entries.size()))
+        compact();
+}
+
+void SyncJournal::record(const FileEntry &entry)
+{
+    const Key key = qMakePair(entry.rootIndex, entry.path);
+    auto it = m_entries.constFind(key);
+    if (it != m_entries.constEnd() && it.value().version == entry.version && it.value().hash == entry.hash)
+        return;
+
+    m_entries.insert(key, entry);
+    append(OpRecord, entry);
+}
+
+void SyncJournal::forget(const Key &key)
+{
+    if (m_entries.remove(key) == 0)
+        return;
+
+    append(OpForget, FileEntry(key.second, QString(), 0, key.first));
+}
+
+SyncJournal::Changes SyncJournal::localChanges(const QList<FileEntry> &localEntries) const
+{
+    Changes changes;
+    QSet<Key> seen;
+    seen.reserve(localEntries.size());
+
+    for (const FileEntry &entry : localEntries) {
+        const Key key = qMakePair(entry.rootIndex, entry.path);
+        seen.insert(key);
+
+        auto it = m_entries.constFind(key);
+        if (it == m_entries.constEnd())
+            changes.added.append(entry);
+        else if (!it.value().sameContent(entry))
+            changes.modified.append(entry);
+    }
+
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (!seen.contains(it.key()))
+            changes.removed.append(it.value());
+    }
+    return changes;
+}
+
+bool SyncJournal::compact()
+{
+    QSaveFile file(m_snapshotPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream << SnapshotMagic << SnapshotFormatVersion << quint32(m_entries.size());
+    for (const FileEntry &entry : m_entries)
+        writeEntry(stream, entry);
+
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        qCWarning(lcClient) << "SyncJournal: cannot write snapshot" << m_snapshotPath;
+        return false;
+    }
+
+    // Снимок уже содержит всё из журнала — журнал начинается заново
+    m_log.close();
+    if (!m_log.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        qCWarning(lcClient) << "SyncJournal: cannot reopen" << m_logPath;
+    m_logRecords = 0;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include "FileEntry.h"
+
+// Журнал синхронизации клиента: последняя согласованная с сервером версия каждого файла.
+// Хранится как снимок плюс журнал дописываемых изменений; при росте журнала
+// состояние переписывается в новый снимок.
+// По журналу при старте отличаются локальные изменения (новый файл, изменение,
+// удаление без связи с сервером) от изменений на сервере.
+class SyncJournal
+{
+public:
+    typedef QPair<int, QString> Key;
+
+    explicit SyncJournal(const QString &directory);
+    ~SyncJournal();
+
+    bool load();
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    bool contains(const Key &key) const { return m_entries.contains(key); }
+    FileEntry value(const Key &key) const;
+
+    // Файл согласован с сервером в этом состоянии
+    void record(const FileEntry &entry);
+    // Файла больше нет ни локально, ни на сервере
+    void forget(const Key &key);
+
+    struct Changes
+    {
+        QList<FileEntry> added;     // нет в журнале
+        QList<FileEntry> modified;  // содержимое отличается от согласованного
+        QList<FileEntry> removed;   // есть в журнале, но нет на диске
+    };
+    Changes localChanges(const QList<FileEntry> &localEntries) const;
+
+    bool compact();
+
+private:
+    QString m_snapshotPath;
+    QString m_logPath;
+    QHash<Key, FileEntry> m_entries;
+    QFile m_log;
+    int m_logRecords = 0;
+
+    bool loadSnapshot();
+    void replayLog();
+    void append(quint8 op, const FileEntry &entry);
+};
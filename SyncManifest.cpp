@@ -0,0 +1,346 @@
+#include "SyncManifest.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+const char SyncManifest::ContentType[] = "application/x-sync-manifest";
+
+static const char EntriesMagic[] = "SMF1";
+static const char DiffsMagic[] = "SDF1";
+static const char MerkleQueryMagic[] = "SMQ1";
+static const char MerkleNodeMagic[] = "SMN1";
+static const int MagicSize = 4;
+
+enum DiffOp : quint8 {
+    OpDownload = 0,
+    OpUpload = 1,
+    OpDelete = 2
+};
+
+static void writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+static void writeBytes(QByteArray &out, const QByteArray &bytes)
+{
+    writeVarint(out, quint64(bytes.size()));
+    out.append(bytes);
+}
+
+// Путь относительно предыдущего: длина общего префикса + остаток
+static void writePath(QByteArray &out, const QByteArray &path, QByteArray &previous)
+{
+    const int limit = qMin(path.size(), previous.size());
+    int shared = 0;
+    while (shared < limit && path.at(shared) == previous.at(shared))
+        ++shared;
+
+    writeVarint(out, quint64(shared));
+    writeBytes(out, path.mid(shared));
+    previous = path;
+}
+
+namespace {
+
+// Последовательное чтение с проверкой границ; любая ошибка делает reader недействительным
+struct Reader
+{
+    const char *pos;
+    const char *end;
+    bool ok = true;
+
+    explicit Reader(const QByteArray &data) : pos(data.constData()), end(data.constData() + data.size()) {}
+
+    quint64 varint()
+    {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= end)
+                break;
+            const quint8 byte = quint8(*pos++);
+            value |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    quint8 byte()
+    {
+        if (pos >= end) {
+            ok = false;
+            return 0;
+        }
+        return quint8(*pos++);
+    }
+
+    QByteArray bytes(quint64 size)
+    {
+        if (!ok || size > quint64(end - pos)) {
+            ok = false;
+            return QByteArray();
+        }
+        QByteArray result(pos, int(size));
+        pos += size;
+        return result;
+    }
+
+    bool magic(const char *expected)
+    {
+        return bytes(MagicSize) == QByteArray::fromRawData(expected, MagicSize) && ok;
+    }
+
+    QString path(QByteArray &previous)
+    {
+        const quint64 shared = varint();
+        const QByteArray suffix = bytes(varint());
+        if (!ok || shared > quint64(previous.size())) {
+            ok = false;
+            return QString();
+        }
+        previous.truncate(int(shared));
+        previous.append(suffix);
+        return QString::fromUtf8(previous);
+    }
+};
+
+}
+
+static bool entryLess(const FileEntry &a, const FileEntry &b)
+{
+    if (a.rootIndex != b.rootIndex)
+        return a.rootIndex < b.rootIndex;
+    return a.path < b.path;
+}
+
+QByteArray SyncManifest::encodeEntries(QList<FileEntry> entries)
+{
+    std::sort(entries.begin(), entries.end(), entryLess);
+
+    QByteArray out;
+    out.reserve(16 + entries.size() * 32);
+    out.append(EntriesMagic, MagicSize);
+    writeVarint(out, quint64(entries.size()));
+
+    QByteArray previous;
+    for (const FileEntry &entry : entries) {
+        writeVarint(out, quint64(entry.rootIndex));
+        writePath(out, entry.path.toUtf8(), previous);
+        writeVarint(out, entry.version);
+        writeBytes(out, entry.type.toUtf8());
+        writeBytes(out, entry.hash);
+    }
+    return out;
+}
+
+bool SyncManifest::decodeEntries(const QByteArray &data, const std::function<void(const FileEntry &)> &func)
+{
+    Reader reader(data);
+    if (!reader.magic(EntriesMagic))
+        return false;
+
+    const quint64 count = reader.varint();
+    QByteArray previous;
+    FileEntry entry;
+    for (quint64 i = 0; i < count && reader.ok; ++i) {
+        entry.rootIndex = int(reader.varint());
+        entry.path = reader.path(previous);
+        entry.version = reader.varint();
+        entry.type = QString::fromUtf8(reader.bytes(reader.varint()));
+        entry.hash = reader.bytes(reader.varint());
+        if (reader.ok)
+            func(entry);
+    }
+    return reader.ok;
+}
+
+static bool diffLess(const FileDiff &a, const FileDiff &b)
+{
+    if (a.rootIndex != b.rootIndex)
+        return a.rootIndex < b.rootIndex;
+    return a.path < b.path;
+}
+
+QByteArray SyncManifest::encodeEntriesJson(const QList<FileEntry> &entries)
+{
+    QJsonArray arr;
+    for (const FileEntry &entry : entries) {
+        QJsonObject obj;
+        obj["path"] = entry.path;
+        obj["version"] = QString::number(entry.version);
+        obj["type"] = entry.type;
+        obj["rootIndex"] = QString::number(entry.rootIndex);
+        if (!entry.hash.isEmpty())
+            obj["hash"] = QString::fromLatin1(entry.hash.toHex());
+        arr.append(obj);
+    }
+    return QJsonDocument(arr).toJson(QJsonDocument::Compact);
+}
+
+bool SyncManifest::decodeEntriesJson(const QByteArray &data, const std::function<void(const FileEntry &)> &func,
+                                     QString *errorString)
+{
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isArray()) {
+        if (errorString)
+            *errorString = parseError.errorString();
+        return false;
+    }
+
+    const QJsonArray array = doc.array();
+    for (const QJsonValue &val : array) {
+        if (!val.isObject())
+            continue;
+
+        const QJsonObject obj = val.toObject();
+        FileEntry entry;
+        entry.path = obj["path"].toString();
+        entry.type = obj["type"].toString();
+        entry.version = obj["version"].toString().toULongLong();
+        entry.rootIndex = obj["rootIndex"].toString().toInt();
+        entry.hash = QByteArray::fromHex(obj["hash"].toString().toLatin1());
+        func(entry);
+    }
+    return true;
+}
+
+QByteArray SyncManifest::encodeDiffs(QVector<FileDiff> diffs)
+{
+    std::sort(diffs.begin(), diffs.end(), diffLess);
+
+    QByteArray out;
+    out.reserve(16 + diffs.size() * 24);
+    out.append(DiffsMagic, MagicSize);
+    writeVarint(out, quint64(diffs.size()));
+
+    QByteArray previous;
+    for (const FileDiff &diff : diffs) {
+        const quint8 op = diff.type == "upload" ? OpUpload
+                        : diff.type == "delete" ? OpDelete : OpDownload;
+        out.append(char(op));
+        writeVarint(out, quint64(diff.rootIndex));
+        writePath(out, diff.path.toUtf8(), previous);
+        writeVarint(out, diff.version);
+    }
+    return out;
+}
+
+bool SyncManifest::decodeDiffs(const QByteArray &data, QVector<FileDiff> *diffs)
+{
+    Reader reader(data);
+    if (!reader.magic(DiffsMagic))
+        return false;
+
+    const quint64 count = reader.varint();
+    QByteArray previous;
+    for (quint64 i = 0; i < count && reader.ok; ++i) {
+        FileDiff diff;
+        const quint8 op = reader.byte();
+        diff.type = op == OpUpload ? "upload" : op == OpDelete ? "delete" : "download";
+        diff.rootIndex = int(reader.varint());
+        diff.path = reader.path(previous);
+        diff.version = reader.varint();
+        if (reader.ok)
+            diffs->append(diff);
+    }
+    return reader.ok;
+}
+
+QByteArray SyncManifest::encodeMerkleQueries(const QVector<MerkleTree::Query> &queries)
+{
+    QByteArray out;
+    out.append(MerkleQueryMagic, MagicSize);
+    writeVarint(out, quint64(queries.size()));
+    for (const MerkleTree::Query &query : queries) {
+        writeVarint(out, quint64(query.rootIndex));
+        writeBytes(out, query.path.toUtf8());
+        out.append(char(query.withChildren ? 1 : 0));
+    }
+    return out;
+}
+
+bool SyncManifest::decodeMerkleQueries(const QByteArray &data, QVector<MerkleTree::Query> *queries)
+{
+    Reader reader(data);
+    if (!reader.magic(MerkleQueryMagic))
+        return false;
+
+    const quint64 count = reader.varint();
+    for (quint64 i = 0; i < count && reader.ok; ++i) {
+        MerkleTree::Query query;
+        query.rootIndex = int(reader.varint());
+        query.path = QString::fromUtf8(reader.bytes(reader.varint()));
+        query.withChildren = reader.byte() != 0;
+        if (reader.ok)
+            queries->append(query);
+    }
+    return reader.ok;
+}
+
+QByteArray SyncManifest::encodeMerkleNodes(const QVector<MerkleTree::Node> &nodes)
+{
+    QByteArray out;
+    out.append(MerkleNodeMagic, MagicSize);
+    writeVarint(out, quint64(nodes.size()));
+    for (const MerkleTree::Node &node : nodes) {
+        writeVarint(out, quint64(node.rootIndex));
+        writeBytes(out, node.path.toUtf8());
+        writeBytes(out, node.hash);
+
+        writeVarint(out, quint64(node.subdirs.size()));
+        for (auto it = node.subdirs.constBegin(); it != node.subdirs.constEnd(); ++it) {
+            writeBytes(out, it.key().toUtf8());
+            writeBytes(out, it.value());
+        }
+
+        writeVarint(out, quint64(node.files.size()));
+        for (auto it = node.files.constBegin(); it != node.files.constEnd(); ++it) {
+            writeBytes(out, it.key().toUtf8());
+            writeVarint(out, it.value().version);
+            writeBytes(out, it.value().hash);
+        }
+    }
+    return out;
+}
+
+bool SyncManifest::decodeMerkleNodes(const QByteArray &data, QVector<MerkleTree::Node> *nodes)
+{
+    Reader reader(data);
+    if (!reader.magic(MerkleNodeMagic))
+        return false;
+
+    const quint64 count = reader.varint();
+    for (quint64 i = 0; i < count && reader.ok; ++i) {
+        MerkleTree::Node node;
+        node.rootIndex = int(reader.varint());
+        node.path = QString::fromUtf8(reader.bytes(reader.varint()));
+        node.hash = reader.bytes(reader.varint());
+
+        const quint64 subdirCount = reader.varint();
+        for (quint64 j = 0; j < subdirCount && reader.ok; ++j) {
+            const QString name = QString::fromUtf8(reader.bytes(reader.varint()));
+            node.subdirs.insert(name, reader.bytes(reader.varint()));
+        }
+
+        const quint64 fileCount = reader.varint();
+        for (quint64 j = 0; j < fileCount && reader.ok; ++j) {
+            const QString name = QString::fromUtf8(reader.bytes(reader.varint()));
+            MerkleTree::Leaf leaf;
+            leaf.version = reader.varint();
+            leaf.hash = reader.bytes(reader.varint());
+            node.files.insert(name, leaf);
+        }
+
+        if (reader.ok)
+            nodes->append(node);
+    }
+    return reader.ok;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <functional>
+#include "FileEntry.h"
+#include "MerkleTree.h"
+
+// Двоичный формат списков /sync-list и ответа с отличиями.
+// Записи отсортированы по (rootIndex, path); числа — varint (LEB128),
+// путь хранится как длина общего префикса с предыдущим путём и остаток.
+// Разбор идёт прямо по буферу, без промежуточного дерева документа.
+class SyncManifest
+{
+public:
+    static const char ContentType[];
+
+    static QByteArray encodeEntries(QList<FileEntry> entries);
+    // func вызывается для каждой записи по мере разбора
+    static bool decodeEntries(const QByteArray &data, const std::function<void(const FileEntry &)> &func);
+    // Тот же список в JSON — для клиентов и серверов без поддержки двоичного формата
+    static QByteArray encodeEntriesJson(const QList<FileEntry> &entries);
+    static bool decodeEntriesJson(const QByteArray &data, const std::function<void(const FileEntry &)> &func,
+                                  QString *errorString = nullptr);
+
+    static QByteArray encodeDiffs(QVector<FileDiff> diffs);
+    static bool decodeDiffs(const QByteArray &data, QVector<FileDiff> *diffs);
+
+    // Сверка по дереву хэшей (/merkle): запросы узлов и ответы с хэшами поддеревьев
+    static QByteArray encodeMerkleQueries(const QVector<MerkleTree::Query> &queries);
+    static bool decodeMerkleQueries(const QByteArray &data, QVector<MerkleTree::Query> *queries);
+    static QByteArray encodeMerkleNodes(const QVector<MerkleTree::Node> &nodes);
+    static bool decodeMerkleNodes(const QByteArray &data, QVector<MerkleTree::Node> *nodes);
+};
@@ -1,5 +1,12 @@
 #include "SyncServer.h"
 #include "FileMonitor.h"
+#include "FileStreamer.h"
+#include "DeltaSync.h"
+#include "FileUtils.h"
+#include "SyncManifest.h"
+#include "IndexStore.h"
+#include "Compression.h"
+#include "Log.h"
 #include <QDebug>
 #include <QFile>
 #include <QFileInfo>
@@ -12,60 +19,228 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QUdpSocket>
+#include <QPointer>
+#include <QThread>
+#include <QTemporaryFile>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSet>
+#include <QSharedPointer>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#endif
+
+static const int PushHeartbeatSec = 20;
+static const int PushHistorySize = 4096;
+static const int IndexRetryAfterSec = 5;    // повтор синхронизации, пока индекс не сверен
+
+// Версии файлов — mtime в миллисекундах. Клиенты, которые передавали секунды, не присылают
+// X-Version-Unit: ms; их версии приводятся к миллисекундам на входе и обратно на выходе
+static bool legacyVersionUnit(const QMap<QString, QString> &headers)
+{
+    return headers.value("x-version-unit") != QLatin1String("ms");
+}
+
+static quint64 versionFromClient(quint64 version, bool legacy)
+{
+    return legacy ? version * 1000 : version;
+}
+
+static quint64 versionToClient(quint64 version, bool legacy)
+{
+    return legacy ? version / 1000 : version;
+}
 
 SyncServer::SyncServer(QObject *parent)
-    : QObject(parent), m_udpSocket(new QUdpSocket(this))
+    : QObject(parent), m_pushEpoch(QDateTime::currentMSecsSinceEpoch()), m_udpSocket(new QUdpSocket(this))
 {
     if (!m_udpSocket->bind(45454, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
-        qWarning() << "Failed to bind UDP socket";
+        qCWarning(lcServer) << "Failed to bind UDP socket";
     }
     connect(m_udpSocket, &QUdpSocket::readyRead, this, &SyncServer::handleDatagram);
 
-    connect(&m_server, &QTcpServer::newConnection, this, &SyncServer::handleNewConnection);
+    connect(&m_server, &ConnectionListener::incomingSocket, this, &SyncServer::handleIncomingSocket);
 
     m_cleanupTimer.setInterval(60 * 1000); // раз в минуту
     connect(&m_cleanupTimer, &QTimer::timeout, this, &SyncServer::cleanupInactiveClients);
+    connect(&m_cleanupTimer, &QTimer::timeout, this, &SyncServer::reportCacheStats);
     m_cleanupTimer.start();
 
+    m_heartbeatTimer.setInterval(PushHeartbeatSec * 1000);
+    connect(&m_heartbeatTimer, &QTimer::timeout, this, &SyncServer::sendHeartbeat);
+    m_heartbeatTimer.start();
+
     // Инициализация мониторинга файлов
     m_syncDirectories.append(QDir::homePath() + "/test/serv/fold1");
     m_syncDirectories.append(QDir::homePath() + "/test/serv/fold2");
-    m_monitor = new FileMonitor(m_syncDirectories, this);
+    // Монитор работает в своём потоке: обход дерева не задерживает приём соединений
+    qRegisterMetaType<FileEntry>("FileEntry");
+    qRegisterMetaType<QList<FileEntry>>("QList<FileEntry>");
+    m_monitor = new FileMonitor(m_syncDirectories);
+    m_monitorThread = new QThread(this);
+    m_monitorThread->setObjectName("SyncMonitor");
+    m_monitor->moveToThread(m_monitorThread);
+    connect(m_monitorThread, &QThread::finished, m_monitor, &QObject::deleteLater);
 
     connect(m_monitor, &FileMonitor::fileChanged, this, [=](const FileEntry &entry){
-        qDebug() << "[SERVER] Изменён/добавлен:" << entry.path << entry.version << "rootIndex:" << entry.rootIndex;
+        qCDebug(lcServer) << "Изменён/добавлен:" << entry.path << entry.version << "rootIndex:" << entry.rootIndex;
+        m_metrics.monitorEvents(1);
+
+        // Файл, только что принятый через /upload, монитор видит повторно — содержимое то же
+        const FileEntry current = m_fileEntries.value(qMakePair(entry.rootIndex, entry.path), FileEntry());
+        if (!entry.hash.isEmpty() && current.hash == entry.hash)
+            return;
+
+        m_hotFiles.invalidate(entry.rootIndex, entry.path);
 
-        m_fileEntries[qMakePair(entry.rootIndex, entry.path)] = entry;
+        m_fileEntries.insert(entry);
 
         notifyUpdate(entry.path, false, entry.rootIndex);
     });
 
     connect(m_monitor, &FileMonitor::fileRemoved, this, [=](const FileEntry &entry){
-        qDebug() << "[SERVER] Удалён:" << entry.path;
+        qCDebug(lcServer) << "Удалён:" << entry.path;
+        m_metrics.monitorEvents(1);
 
         m_fileEntries.remove(qMakePair(entry.rootIndex, entry.path));
+        m_hotFiles.invalidate(entry.rootIndex, entry.path);
 
         // Уведомить клиентов
         notifyUpdate(entry.path, true, entry.rootIndex);
     });
 
-    m_monitor->start();
+    connect(m_monitor, &FileMonitor::initialScanFinished, this, &SyncServer::applyInitialScan);
+    connect(m_monitor, &FileMonitor::rescanFinished, this, [this](qint64 elapsedMs) {
+        m_metrics.rescanFinished(elapsedMs);
+    });
+
+    // Тёплый старт: индекс с прошлого запуска доступен сразу,
+    // а фоновый обход монитора потом сверяет его с диском
+    m_indexPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/server-index.bin";
+    const int loaded = IndexStore::load(m_indexPath, [this](const FileEntry &entry) {
+        if (entry.rootIndex >= 0 && entry.rootIndex < m_syncDirectories.size())
+            m_fileEntries.insert(entry);
+    });
+    m_warmStart = loaded > 0;
+    qCDebug(lcServer) << "Index entries loaded from disk:" << qMax(loaded, 0);
+
+    m_indexSaveTimer.setInterval(60 * 1000);
+    connect(&m_indexSaveTimer, &QTimer::timeout, this, &SyncServer::saveIndex);
+
+    m_monitorThread->start();
+    FileMonitor *monitor = m_monitor;
+    QTimer::singleShot(0, monitor, [monitor]() { monitor->start(); });
+}
+
+SyncServer::~SyncServer()
+{
+    stopWorkers();
+    // Загрузки кэша пишут в m_trace, который разрушается раньше m_hotFiles
+    m_hotFiles.waitForLoads();
+
+    m_monitorThread->quit();
+    m_monitorThread->wait();
+
+    if (m_indexReady.load())
+        saveIndex();
+}
+
+void SyncServer::applyInitialScan(const QList<FileEntry> &files)
+{
+    // Сверка загруженного индекса с тем, что реально лежит на диске
+    QSet<FileIndex::Key> present;
+    int changed = 0;
+    for (const FileEntry &entry : files) {
+        const FileIndex::Key key = qMakePair(entry.rootIndex, entry.path);
+        present.insert(key);
+
+        const FileEntry current = m_fileEntries.value(key, FileEntry());
+        if (!current.path.isEmpty() && current.sameContent(entry))
+            continue;
+
+        m_fileEntries.insert(entry);
+        ++changed;
+        if (m_warmStart)
+            notifyUpdate(entry.path, false, entry.rootIndex);
+    }
+
+    QList<FileIndex::Key> removed;
+    m_fileEntries.forEach([&](const FileIndex::Key &key, const FileEntry &) {
+        if (!present.contains(key))
+            removed.append(key);
+    });
+    for (const FileIndex::Key &key : removed) {
+        m_fileEntries.remove(key);
+        notifyUpdate(key.second, true, key.first);
+    }
+
+    qCDebug(lcServer) << "Index validated:" << files.size() << "files," << changed << "updated,"
+             << removed.size() << "removed";
+
+    m_indexReady.store(1);
+    saveIndex();
+    m_indexSaveTimer.start();
+}
+
+void SyncServer::saveIndex()
+{
+    const int generation = m_fileEntries.generation();
+    if (generation == m_savedGeneration)
+        return;
+
+    if (IndexStore::save(m_indexPath, m_fileEntries.values()))
+        m_savedGeneration = generation;
+    else
+        qCWarning(lcServer) << "Cannot save index to" << m_indexPath;
+}
+
+void SyncServer::setWorkerCount(int count)
+{
+    m_workerCount = qMax(0, count);
+}
+
+void SyncServer::startWorkers()
+{
+    for (int i = m_workers.size(); i < m_workerCount; ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("SyncWorker-%1").arg(i));
 
-    // Заполняем m_fileEntries актуальными файлами из папки
-    const auto initialFiles = m_monitor->currentFiles();
-    for (const FileEntry &entry : initialFiles) {
-        m_fileEntries[qMakePair(entry.rootIndex, entry.path)] = entry;
+        // Через этот объект задачи ставятся в цикл событий рабочего потока
+        QObject *context = new QObject;
+        context->moveToThread(thread);
+
+        thread->start();
+        m_workers.append(thread);
+        m_workerContexts.append(context);
     }
 }
 
+void SyncServer::stopWorkers()
+{
+    for (QThread *thread : m_workers) {
+        thread->quit();
+        thread->wait();
+    }
+    // Потоки остановлены — контексты можно удалить напрямую
+    qDeleteAll(m_workerContexts);
+    qDeleteAll(m_workers);
+    m_workers.clear();
+    m_workerContexts.clear();
+}
+
 bool SyncServer::listen(const QHostAddress &address, quint16 port)
 {
+    startWorkers();
+
     bool ok = m_server.listen(address, port);
     if (ok) {
-        qDebug() << "Sync server listening on" << m_server.serverAddress().toString() << ":" << m_server.serverPort();
+        qCDebug(lcServer) << "Sync server listening on" << m_server.serverAddress().toString() << ":" << m_server.serverPort()
+                 << "workers:" << m_workers.size();
         emit serverStarted();
     } else {
-        qWarning() << "Failed to listen:" << m_server.errorString();
+        qCWarning(lcServer) << "Failed to listen:" << m_server.errorString();
     }
     return ok;
 }
@@ -82,7 +257,7 @@ void SyncServer::handleDatagram()
         m_udpSocket->readDatagram(buffer.data(), buffer.size(), &sender, &senderPort);
 
         if (buffer == "DISCOVER_REQUEST") {
-            qDebug() << "Received DISCOVER_REQUEST from" << sender.toString() << ":" << senderPort;
+            qCDebug(lcServer) << "Received DISCOVER_REQUEST from" << sender.toString() << ":" << senderPort;
             m_udpSocket->writeDatagram("DISCOVER_RESPONSE", sender, senderPort);
         }
     }
@@ -91,24 +266,124 @@ void SyncServer::handleDatagram()
 void SyncServer::stop()
 {
     m_server.close();
+    stopWorkers();
     emit serverStopped();
 }
 
-void SyncServer::handleNewConnection()
+void SyncServer::handleIncomingSocket(qintptr socketDescriptor)
 {
-    while (m_server.hasPendingConnections()) {
-        QTcpSocket *clientSocket = m_server.nextPendingConnection();
-        qDebug() << "New client connected from" << clientSocket->peerAddress().toString();
+    auto accept = [this, socketDescriptor]() {
+        QTcpSocket *clientSocket = new QTcpSocket;
+        if (!clientSocket->setSocketDescriptor(socketDescriptor)) {
+            qCWarning(lcServer) << "Failed to accept connection:" << clientSocket->errorString();
+            delete clientSocket;
+            return;
+        }
+        qCDebug(lcServer) << "New client connected from" << clientSocket->peerAddress().toString();
         handleClient(clientSocket);
+    };
+
+    if (m_workerContexts.isEmpty()) {
+        accept();
+        return;
     }
+
+    // Раздаём соединения по рабочим потокам по кругу; сокет создаётся уже в целевом потоке
+    QObject *context = m_workerContexts[m_nextWorker];
+    m_nextWorker = (m_nextWorker + 1) % m_workerContexts.size();
+    QTimer::singleShot(0, context, accept);
+}
+
+static const int MaxHeaderSize = 64 * 1024;
+// Тела, которые держатся в памяти (/sync-list, /merkle и т.п.), после распаковки;
+// /upload пишется на диск и этим пределом не ограничен
+static const qint64 MaxBufferedBodySize = 128 * 1024 * 1024;
+static const int KeepAliveTimeoutSec = 15;
+static const int MaxRequestsPerConnection = 1000;
+
+ClientConnection::~ClientConnection()
+{
+    if (uploadFile) {
+        // Незавершённая загрузка: принятая часть остаётся для докачки, иначе больше не нужна
+        uploadFile->close();
+        if (!keepPartialUpload)
+            uploadFile->remove();
+        delete uploadFile;
+    }
+    delete uploadHash;
+    delete bodyDecoder;
+}
+
+void ClientConnection::resetRequest()
+{
+    headerScanPos = 0;
+    headersParsed = false;
+    head.clear();
+    method.clear();
+    path.clear();
+    headers.clear();
+    contentLength = 0;
+    bodyReceived = 0;
+    chunked = false;
+    chunkState = ChunkSize;
+    chunkRemaining = 0;
+    body.clear();
+    uploadTarget.clear();
+    keepPartialUpload = false;
+    delete bodyDecoder;
+    bodyDecoder = nullptr;
+    discardBody = false;
+    bodyTooLarge = false;
+    keepAlive = true;
+    route = ServerMetrics::RouteOther;
+    requestTimer.invalidate();
+    traceId = 0;
+    traceStartNs = -1;
+    traceHeadNs = -1;
+    traceSendNs = -1;
+}
+
+bool ClientConnection::bodyComplete() const
+{
+    if (chunked)
+        return chunkState == ChunkDone;
+    return bodyReceived >= contentLength;
+}
+
+ClientConnection *SyncServer::connectionFor(QTcpSocket *socket) const
+{
+    QMutexLocker locker(&m_connectionsMutex);
+    return m_connections.value(socket);
 }
 
 void SyncServer::handleClient(QTcpSocket *clientSocket)
 {
-    connect(clientSocket, &QTcpSocket::readyRead, this, &SyncServer::handleClientReadyRead);
-    connect(clientSocket, &QTcpSocket::disconnected, this, &SyncServer::handleClientDisconnected);
+    // DirectConnection: обработчики выполняются в потоке сокета, а не в потоке SyncServer
+    connect(clientSocket, &QTcpSocket::readyRead, this, &SyncServer::handleClientReadyRead, Qt::DirectConnection);
+    connect(clientSocket, &QTcpSocket::disconnected, this, &SyncServer::handleClientDisconnected, Qt::DirectConnection);
+    connect(clientSocket, &QTcpSocket::bytesWritten, this, [this](qint64 bytes) {
+        m_metrics.addBytesOut(bytes);
+    }, Qt::DirectConnection);
+    m_metrics.connectionOpened();
+
+    ClientConnection *conn = new ClientConnection;
+
+    // Простаивающее постоянное соединение закрываем по таймауту
+    conn->idleTimer = new QTimer(clientSocket);
+    conn->idleTimer->setSingleShot(true);
+    conn->idleTimer->setInterval(KeepAliveTimeoutSec * 1000);
+    connect(conn->idleTimer, &QTimer::timeout, clientSocket, [this, clientSocket]() {
+        ClientConnection *c = connectionFor(clientSocket);
+        if (c && c->responsePending) {
+            c->idleTimer->start();
+            return;
+        }
+        clientSocket->disconnectFromHost();
+    });
+    conn->idleTimer->start();
 
-    m_clientBuffers[clientSocket] = QByteArray();
+    QMutexLocker locker(&m_connectionsMutex);
+    m_connections[clientSocket] = conn;
 }
 
 void SyncServer::handleClientReadyRead()
@@ -117,50 +392,349 @@ void SyncServer::handleClientReadyRead()
     if (!socket)
         return;
 
-    QByteArray &buffer = m_clientBuffers[socket];
-    buffer += socket->readAll();
+    ClientConnection *conn = connectionFor(socket);
+    if (!conn)
+        return;
+
+    const QByteArray data = socket->readAll();
+    m_metrics.addBytesIn(data.size());
+    conn->buffer += data;
+    conn->idleTimer->start();
 
-    int headerEndIndex = buffer.indexOf("\r\n\r\n");
-    if (headerEndIndex == -1) {
-        // Ждем ещё данных
+    // Подписчик только читает поток событий, новых запросов на этом соединении нет
+    if (conn->subscribed) {
+        conn->buffer.clear();
         return;
     }
 
-    QByteArray headerPart = buffer.left(headerEndIndex + 4);
-    QList<QByteArray> lines = headerPart.split('\n');
-    if (lines.isEmpty())
+    processRequests(socket, conn);
+}
+
+void SyncServer::processRequests(QTcpSocket *socket, ClientConnection *conn)
+{
+    // Конвейер: обрабатываем запросы строго по очереди, пока в буфере есть полные запросы
+    while (!conn->responsePending && !conn->closing) {
+        if (!conn->headersParsed) {
+            if (conn->traceStartNs < 0 && !conn->buffer.isEmpty() && m_trace.isEnabled())
+                conn->traceStartNs = m_trace.now();
+
+            // Продолжаем поиск с места предыдущей остановки, а не с начала буфера
+            int from = qMax(0, conn->headerScanPos - 3);
+            int headerEndIndex = conn->buffer.indexOf("\r\n\r\n", from);
+            if (headerEndIndex == -1) {
+                conn->headerScanPos = conn->buffer.size();
+                if (conn->buffer.size() > MaxHeaderSize) {
+                    conn->keepAlive = false;
+                    sendHttpResponse(socket, 431, "Request Header Fields Too Large", QString("Headers too large"));
+                    completeRequest(socket, conn);
+                }
+                // Ждем ещё данных
+                return;
+            }
+
+            conn->traceId = m_trace.nextRequestId();
+            if (!parseRequestHead(conn, conn->buffer.left(headerEndIndex + 4))) {
+                conn->keepAlive = false;
+                sendHttpResponse(socket, 400, "Bad Request", QString("Malformed request"));
+                completeRequest(socket, conn);
+                return;
+            }
+
+            conn->buffer.remove(0, headerEndIndex + 4);
+            conn->headersParsed = true;
+            conn->route = ServerMetrics::routeFor(conn->head);
+            conn->requestTimer.start();
+            m_metrics.requestStarted(conn->route);
+            if (m_trace.isEnabled())
+                conn->traceHeadNs = m_trace.now();
+
+            // Последний разрешённый запрос на соединении
+            if (conn->requestCount + 1 >= MaxRequestsPerConnection)
+                conn->keepAlive = false;
+
+            const QString encoding = conn->headers.value("content-encoding").toLower();
+            if (!encoding.isEmpty() && encoding != "identity") {
+                if (encoding != QLatin1String(Compression::Encoding)) {
+                    conn->keepAlive = false;
+                    sendHttpResponse(socket, 415, "Unsupported Media Type", QString("Unsupported content encoding"));
+                    completeRequest(socket, conn);
+                    return;
+                }
+                // Тело раскодируется по мере приёма, обработчики видят исходные данные
+                conn->bodyDecoder = new GzipStream(GzipStream::Decompress);
+            }
+
+            if (conn->method == "POST"
+                    && (conn->path.startsWith("/upload") || conn->path.startsWith("/delta-upload")))
+                beginUpload(socket, conn);
+
+            // Заявленный размер уже больше предела — тело не принимаем вовсе
+            if (!conn->uploadFile && !conn->discardBody && conn->contentLength > MaxBufferedBodySize) {
+                conn->keepAlive = false;
+                sendHttpResponse(socket, 413, "Payload Too Large", QString("Request body too large"));
+                completeRequest(socket, conn);
+                return;
+            }
+        }
+
+        if (!consumeBody(conn)) {
+            conn->keepAlive = false;
+            if (conn->bodyTooLarge)
+                sendHttpResponse(socket, 413, "Payload Too Large", QString("Request body too large"));
+            else if (!conn->discardBody)
+                sendHttpResponse(socket, 400, "Bad Request", QString("Malformed body"));
+            completeRequest(socket, conn);
+            return;
+        }
+
+        if (!conn->bodyComplete())
+            return;
+
+        if (conn->traceHeadNs >= 0 && conn->bodyReceived > 0) {
+            m_trace.record("http", "receive", conn->traceId, conn->traceHeadNs, m_trace.now(),
+                           "bytes", conn->bodyReceived);
+        }
+
+        QByteArray tail;
+        if (conn->bodyDecoder && !conn->discardBody && !conn->bodyDecoder->finish(&tail)) {
+            conn->keepAlive = false;
+            sendHttpResponse(socket, 400, "Bad Request", QString("Truncated compressed body"));
+            completeRequest(socket, conn);
+            return;
+        }
+
+        conn->dispatching = true;
+        handleClientRequest(socket, conn);
+
+        // Обработчик мог оборвать соединение и освободить состояние
+        if (connectionFor(socket) != conn)
+            return;
+        conn->dispatching = false;
+        if (conn->closing)
+            return;
+
+        // Ответ ещё передаётся (FileStreamer) — продолжим по его завершении
+        if (conn->responsePending) {
+            if (m_trace.isEnabled())
+                conn->traceSendNs = m_trace.now();
+            return;
+        }
+
+        if (!completeRequest(socket, conn))
+            return;
+    }
+}
+
+bool SyncServer::completeRequest(QTcpSocket *socket, ClientConnection *conn)
+{
+    ++conn->requestCount;
+    if (conn->requestTimer.isValid())
+        m_metrics.requestFinished(conn->route, conn->requestTimer.nsecsElapsed() / 1000);
+    if (conn->traceStartNs >= 0 && conn->traceId != 0) {
+        // Весь запрос целиком, от первого байта до конца ответа; внутри — интервалы этапов
+        m_trace.record("request", ServerMetrics::routeName(conn->route), conn->traceId,
+                       conn->traceStartNs, m_trace.now());
+    }
+
+    if (!conn->keepAlive) {
+        conn->closing = true;
+        socket->disconnectFromHost();
+        return false;
+    }
+
+    conn->resetRequest();
+    conn->idleTimer->start();
+    return true;
+}
+
+void SyncServer::finishPendingResponse(QTcpSocket *socket, bool ok)
+{
+    ClientConnection *conn = connectionFor(socket);
+    if (!conn)
         return;
 
+    conn->responsePending = false;
+    if (conn->traceSendNs >= 0)
+        m_trace.record("http", "send", conn->traceId, conn->traceSendNs, m_trace.now());
+
+    if (!ok) {
+        // Тело ответа передано не полностью — соединение больше не согласовано
+        conn->closing = true;
+        socket->abort();
+        return;
+    }
+
+    // Ответ завершился синхронно, ещё внутри обработчика (например, FileStreamer::start()
+    // отправил пустой или небольшой файл целиком): запрос завершит processRequests,
+    // когда обработчик вернёт управление, — иначе он был бы завершён дважды
+    if (conn->dispatching)
+        return;
+
+    if (completeRequest(socket, conn))
+        processRequests(socket, conn);
+}
+
+bool SyncServer::parseRequestHead(ClientConnection *conn, const QByteArray &head)
+{
+    TraceSpan span(m_trace, "http", "parse", conn->traceId);
+    QList<QByteArray> lines = head.split('\n');
+    if (lines.isEmpty())
+        return false;
+
     QByteArray requestLine = lines.first().trimmed();
     QList<QByteArray> parts = requestLine.split(' ');
     if (parts.size() < 2)
-        return;
+        return false;
 
-    QByteArray method = parts[0];
-    QByteArray path = parts[1];
+    conn->head = head;
+    conn->method = parts[0];
+    conn->path = parts[1];
 
     // Собираем заголовки
-    QMap<QString, QString> headers;
-    int contentLength = 0;
-
     for (int i = 1; i < lines.size(); ++i) {
         QByteArray line = lines[i].trimmed();
         int colonIndex = line.indexOf(':');
         if (colonIndex > 0) {
             QString key = QString::fromUtf8(line.left(colonIndex)).toLower();
             QString value = QString::fromUtf8(line.mid(colonIndex + 1)).trimmed();
-            headers[key] = value;
+            conn->headers[key] = value;
+        }
+    }
+
+    bool ok = true;
+    conn->contentLength = conn->headers.value("content-length", "0").toLongLong(&ok);
+    if (!ok || conn->contentLength < 0)
+        return false;
+
+    conn->chunked = conn->headers.value("transfer-encoding").toLower().contains("chunked");
+
+    // HTTP/1.1 — постоянное соединение по умолчанию, HTTP/1.0 — только по явному запросу
+    const QString connection = conn->headers.value("connection").toLower();
+    if (parts.size() > 2 && parts[2].trimmed() == "HTTP/1.0")
+        conn->keepAlive = connection.contains("keep-alive");
+    else
+        conn->keepAlive = !connection.contains("close");
+
+    return true;
+}
+
+bool SyncServer::consumeBody(ClientConnection *conn)
+{
+    QByteArray &buffer = conn->buffer;
+
+    if (!conn->chunked) {
+        qint64 n = qMin(qint64(buffer.size()), conn->contentLength - conn->bodyReceived);
+        if (n <= 0)
+            return true;
 
-            if (key == "content-length")
-                contentLength = value.toInt();
+        if (!writeBody(conn, buffer.constData(), n))
+            return false;
+
+        conn->bodyReceived += n;
+        buffer.remove(0, int(n));
+        return true;
+    }
+
+    // Transfer-Encoding: chunked — однопроходный разбор без повторного сканирования
+    int pos = 0;
+    bool needMoreData = false;
+    while (!needMoreData && pos < buffer.size() && conn->chunkState != ClientConnection::ChunkDone) {
+        switch (conn->chunkState) {
+        case ClientConnection::ChunkSize: {
+            int lineEnd = buffer.indexOf("\r\n", pos);
+            if (lineEnd == -1) {
+                needMoreData = true;
+                break;
+            }
+
+            QByteArray sizeLine = buffer.mid(pos, lineEnd - pos);
+            int ext = sizeLine.indexOf(';');
+            if (ext != -1)
+                sizeLine.truncate(ext);
+
+            bool ok = false;
+            conn->chunkRemaining = sizeLine.trimmed().toLongLong(&ok, 16);
+            if (!ok || conn->chunkRemaining < 0)
+                return false;
+
+            pos = lineEnd + 2;
+            conn->chunkState = conn->chunkRemaining == 0 ? ClientConnection::ChunkTrailer
+                                                         : ClientConnection::ChunkData;
+            break;
+        }
+        case ClientConnection::ChunkData: {
+            qint64 n = qMin(qint64(buffer.size() - pos), conn->chunkRemaining);
+            if (!writeBody(conn, buffer.constData() + pos, n))
+                return false;
+
+            pos += int(n);
+            conn->bodyReceived += n;
+            conn->chunkRemaining -= n;
+            if (conn->chunkRemaining == 0)
+                conn->chunkState = ClientConnection::ChunkDataEnd;
+            break;
+        }
+        case ClientConnection::ChunkDataEnd:
+            if (buffer.size() - pos < 2) {
+                needMoreData = true;
+                break;
+            }
+            if (buffer.at(pos) != '\r' || buffer.at(pos + 1) != '\n')
+                return false;
+
+            pos += 2;
+            conn->chunkState = ClientConnection::ChunkSize;
+            break;
+        case ClientConnection::ChunkTrailer: {
+            // Трейлеры не используются — пропускаем до пустой строки
+            int lineEnd = buffer.indexOf("\r\n", pos);
+            if (lineEnd == -1) {
+                needMoreData = true;
+                break;
+            }
+
+            if (lineEnd == pos)
+                conn->chunkState = ClientConnection::ChunkDone;
+            pos = lineEnd + 2;
+            break;
+        }
+        case ClientConnection::ChunkDone:
+            break;
         }
     }
 
-    // Выделяем body
-    QByteArray body = buffer.mid(headerEndIndex + 4);
-    handleClientRequest(socket, buffer, headers, body, path);
+    buffer.remove(0, pos);
+    return true;
+}
 
-    m_clientBuffers.remove(socket);
+bool SyncServer::writeBody(ClientConnection *conn, const char *data, qint64 size)
+{
+    if (conn->discardBody)
+        return true;
+
+    QByteArray plain;
+    if (conn->bodyDecoder) {
+        if (!conn->bodyDecoder->process(data, size, &plain))
+            return false;
+        data = plain.constData();
+        size = plain.size();
+    }
+
+    if (conn->uploadFile) {
+        TraceSpan span(m_trace, "disk", "write", conn->traceId);
+        span.setArg("bytes", size);
+        if (conn->uploadHash)
+            conn->uploadHash->addData(data, int(size));
+        return conn->uploadFile->write(data, size) == size;
+    }
+
+    // chunked-тело или сжатое: итоговый размер заранее неизвестен, проверяем по мере приёма
+    if (conn->body.size() + size > MaxBufferedBodySize) {
+        conn->bodyTooLarge = true;
+        return false;
+    }
+    conn->body.append(data, int(size));
+    return true;
 }
 
 void SyncServer::handleClientDisconnected()
@@ -169,47 +743,90 @@ void SyncServer::handleClientDisconnected()
     if (!socket)
         return;
 
-    qDebug() << "Client disconnected:" << socket->peerAddress().toString();
+    qCDebug(lcServer) << "Client disconnected:" << socket->peerAddress().toString();
+
+    {
+        QMutexLocker locker(&m_subscribersMutex);
+        m_subscribers.remove(socket);
+    }
 
-    m_clientBuffers.remove(socket);
+    ClientConnection *conn = nullptr;
+    {
+        QMutexLocker locker(&m_connectionsMutex);
+        conn = m_connections.take(socket);
+    }
+    delete conn;
     socket->deleteLater();
 }
 
-void SyncServer::handleClientRequest(QTcpSocket *socket, const QByteArray &data,
-                                     const QMap<QString, QString>& headers,
-                                     const QByteArray &body,
-                                     const QByteArray& path)
+void SyncServer::handleClientRequest(QTcpSocket *socket, ClientConnection *conn)
 {
-    qDebug() << "Request:" << data;
+    const QByteArray &data = conn->head;
+    const QMap<QString, QString> &headers = conn->headers;
+    const QByteArray &body = conn->body;
+    const QByteArray &path = conn->path;
+
+    TraceSpan span(m_trace, "http", "dispatch", conn->traceId);
 
     if (data.startsWith("GET /register")) {
         handleRegisterRequest(socket->peerAddress());
         sendHttpResponse(socket, 200, "OK", QString("Registered"));
-        socket->disconnectFromHost();
+        return;
+    }
+
+    if (data.startsWith("GET /subscribe")) {
+        handleSubscribe(socket, conn);
         return;
     }
 
     if (data.startsWith("GET /ping")) {
         QString clientIp = socket->peerAddress().toString();
-        m_registeredClients[clientIp] = QDateTime::currentDateTime();
-        qDebug() << "Ping from" << clientIp;
+        {
+            QMutexLocker locker(&m_clientsMutex);
+            m_registeredClients[clientIp] = QDateTime::currentDateTime();
+        }
+        qCDebug(lcServer) << "Ping from" << clientIp;
         sendHttpResponse(socket, 200, "OK", QString("Pong"));
-        socket->disconnectFromHost();
         return;
     }
 
     if (data.startsWith("POST /sync-list")) {
-        handleSyncList(socket, body);
+        handleSyncList(socket, headers, body);
+        return;
+    }
+
+    if (data.startsWith("POST /merkle")) {
+        handleMerkle(socket, body);
         return;
     }
 
     if (data.startsWith("POST /upload")) {
-        handleUpload(socket, headers, body);
+        handleUpload(socket, conn);
+        return;
+    }
+
+    if (data.startsWith("GET /upload-offset")) {
+        handleUploadOffset(socket, path);
+        return;
+    }
+
+    if (data.startsWith("GET /signature")) {
+        handleSignature(socket, path, headers);
+        return;
+    }
+
+    if (data.startsWith("POST /delta-download")) {
+        handleDeltaDownload(socket, path, headers, body);
+        return;
+    }
+
+    if (data.startsWith("POST /delta-upload")) {
+        handleDeltaUpload(socket, conn);
         return;
     }
 
     if (data.startsWith("GET /download")) {
-        handleDownload(socket, path);
+        handleDownload(socket, path, headers);
         return;
     }
 
@@ -218,117 +835,142 @@ void SyncServer::handleClientRequest(QTcpSocket *socket, const QByteArray &data,
         return;
     }
 
+    if (data.startsWith("GET /metrics")) {
+        handleMetrics(socket);
+        return;
+    }
+
+    if (data.startsWith("GET /trace")) {
+        handleTrace(socket);
+        return;
+    }
+
     sendHttpResponse(socket, 404, "Not Found", QString("Unknown command"));
-    socket->disconnectFromHost();
 }
 
 void SyncServer::handleRegisterRequest(const QHostAddress &addr)
 {
     QString ip = addr.toString();
-    m_registeredClients[ip] = QDateTime::currentDateTime();
-    qDebug() << "Registered client:" << ip;
+    {
+        QMutexLocker locker(&m_clientsMutex);
+        m_registeredClients[ip] = QDateTime::currentDateTime();
+    }
+    qCDebug(lcServer) << "Registered client:" << ip;
 }
 
-void SyncServer::handleSyncList(QTcpSocket *socket, const QByteArray &body)
+bool SyncServer::rejectUntilIndexReady(QTcpSocket *socket)
 {
-    QJsonParseError parseError;
-    QJsonDocument doc = QJsonDocument::fromJson(body, &parseError);
-    if (parseError.error != QJsonParseError::NoError || !doc.isArray()) {
-        qWarning() << "Invalid sync-list JSON:" << parseError.errorString();
-        sendHttpResponse(socket, 400, "Bad Request", QString("Invalid JSON"));
-        socket->disconnectFromHost();
+    if (m_indexReady.load())
+        return false;
+
+    // Индекс ещё не сверен с диском (первый запуск, потерян файл индекса, фоновый обход идёт):
+    // файлы, которых в нём пока нет, выглядели бы удалёнными на сервере
+    sendHttpResponse(socket, 503, "Service Unavailable", QByteArray("Index is being rebuilt"), "text/plain",
+                     "Retry-After: " + QByteArray::number(IndexRetryAfterSec) + "\r\n");
+    return true;
+}
+
+void SyncServer::handleMerkle(QTcpSocket *socket, const QByteArray &body)
+{
+    if (rejectUntilIndexReady(socket))
+        return;
+
+    // Клиент спускается по дереву только в те поддеревья, хэши которых отличаются
+    QVector<MerkleTree::Query> queries;
+    if (!SyncManifest::decodeMerkleQueries(body, &queries)) {
+        sendHttpResponse(socket, 400, "Bad Request", QString("Invalid query"));
         return;
     }
 
-    QJsonArray clientArray = doc.array();
+    QVector<MerkleTree::Node> nodes;
+    nodes.reserve(queries.size());
+    for (const MerkleTree::Query &query : queries)
+        nodes.append(m_fileEntries.merkle().node(query.rootIndex, query.path, query.withChildren));
+
+    sendHttpResponse(socket, 200, "OK", SyncManifest::encodeMerkleNodes(nodes),
+                     QLatin1String(SyncManifest::ContentType));
+}
+
+void SyncServer::handleSyncList(QTcpSocket *socket, const QMap<QString, QString> &headers, const QByteArray &body)
+{
+    // Формат согласуется заголовками; клиенты без поддержки двоичного формата шлют JSON
+    const QLatin1String manifestType(SyncManifest::ContentType);
+    const bool binaryRequest = headers.value("content-type").startsWith(manifestType);
+    const bool binaryResponse = headers.value("accept").contains(manifestType);
+    // Двоичный формат появился позже миллисекундных версий: такие клиенты всегда шлют миллисекунды
+    const bool legacy = !binaryRequest && !binaryResponse && legacyVersionUnit(headers);
+
     bool allAccepted = true;
     bool isFullSync = true;
 
     QHash<QPair<int, QString>, FileEntry> clientEntries;
 
-    // Разбор входящих данных
-    for (const QJsonValue &val : clientArray) {
-        if (!val.isObject())
-            continue;
-
-        QJsonObject obj = val.toObject();
-        FileEntry entry;
-        entry.path = obj["path"].toString();
-        entry.type = obj["type"].toString();
-        entry.version = obj["version"].toString().toULongLong();
-        entry.rootIndex = obj["rootIndex"].toString().toInt();
-
+    auto addEntry = [&](const FileEntry &entry) {
         if (entry.type != "file")
             isFullSync = false;
 
-        clientEntries[qMakePair(entry.rootIndex, entry.path)] = entry;
+        FileEntry &stored = clientEntries[qMakePair(entry.rootIndex, entry.path)];
+        stored = entry;
+        stored.version = versionFromClient(entry.version, legacy);
+    };
+
+    // Разбор входящих данных
+    if (binaryRequest) {
+        if (!SyncManifest::decodeEntries(body, addEntry)) {
+            qCWarning(lcServer) << "Invalid sync-list manifest";
+            sendHttpResponse(socket, 400, "Bad Request", QString("Invalid manifest"));
+            return;
+        }
+    } else {
+        QString error;
+        if (!SyncManifest::decodeEntriesJson(body, addEntry, &error)) {
+            qCWarning(lcServer) << "Invalid sync-list JSON:" << error;
+            sendHttpResponse(socket, 400, "Bad Request", QString("Invalid JSON"));
+            return;
+        }
     }
 
     if (isFullSync) {
-        // Полная синхронизация — сравниваем и отправляем отличия
-        QJsonArray diffs;
-        for (auto it = m_fileEntries.begin(); it != m_fileEntries.end(); ++it) {
-            const auto &key = it.key();
-            const FileEntry &serverEntry = it.value();
-
-            if (!clientEntries.contains(key)) {
-                // Файл есть на сервере, но нет у клиента
-                QJsonObject diff;
-                diff["path"] = key.second;
-                diff["rootIndex"] = key.first;
-                diff["type"] = "download";
-                diff["version"] = QString::number(serverEntry.version);
-                diffs.append(diff);
-            } else {
-                const FileEntry &clientEntry = clientEntries[key];
-                if (clientEntry.version != serverEntry.version) {
-                    // Версии у сервера и клиента отличаются. Нужно обновить
-                    QJsonObject diff;
-                    diff["path"] = key.second;
-                    diff["rootIndex"] = key.first;
-                    diff["type"] = clientEntry.version < serverEntry.version
-                                   ? "download" : "upload";
-                    diff["version"] = QString::number(serverEntry.version);
-                    diffs.append(diff);
-                }
-            }
-        }
+        if (rejectUntilIndexReady(socket))
+            return;
 
-        // Теперь найдём удалённые файлы (были у клиента, но нет на сервере)
-        for (auto it = clientEntries.begin(); it != clientEntries.end(); ++it) {
-
-            if (!m_fileEntries.contains(it.key())) {
-                // Файл есть у клиента, но нет на сервере
-                QJsonObject diff;
-                diff["path"] = it.key().second;
-                diff["rootIndex"] = it.key().first;
-                diff["type"] = "delete";
-                diff["version"] = QString::number(it.value().version);
-                diffs.append(diff);
+        // Полная синхронизация — сравниваем и отправляем отличия
+        const QVector<FileDiff> diffs = m_fileEntries.diff(clientEntries);
+
+        if (binaryResponse) {
+            // Пустой список отличий — всё актуально
+            sendHttpResponse(socket, 200, "OK", SyncManifest::encodeDiffs(diffs), manifestType);
+        } else if (!diffs.isEmpty()) {
+            QJsonArray array;
+            for (const FileDiff &diff : diffs) {
+                QJsonObject obj;
+                obj["path"] = diff.path;
+                obj["rootIndex"] = diff.rootIndex;
+                obj["type"] = diff.type;
+                obj["version"] = QString::number(versionToClient(diff.version, legacy));
+                array.append(obj);
             }
-        }
-
-        if (!diffs.isEmpty()) {
-            QJsonDocument responseDoc(diffs);
+            QJsonDocument responseDoc(array);
             sendHttpResponse(socket, 200, "OK", responseDoc.toJson(QJsonDocument::Compact));
         } else {
             sendHttpResponse(socket, 200, "OK", QString("Up to date"));
         }
 
-        socket->disconnectFromHost();
         return;
     }
 
     // Частичный список
     for (const FileEntry &entry : clientEntries) {
         const auto key = qMakePair(entry.rootIndex, entry.path);
-        const bool exists = m_fileEntries.contains(key);
-        const quint64 currentVer = exists ? m_fileEntries[key].version : 0;
+        const FileEntry current = m_fileEntries.value(key, FileEntry{entry.path, "unknown", 0, entry.rootIndex});
+        const bool exists = current.version != 0;
+        const quint64 currentVer = current.version;
 
         if (entry.type == "deleted") {
             QString fullPath = resolveFullPath(entry.rootIndex, entry.path);
             QFile::remove(fullPath);
             m_fileEntries.remove(key);
+            m_hotFiles.invalidate(entry.rootIndex, entry.path);
             notifyUpdate(entry.path, true, entry.rootIndex);
         } else if (!exists || entry.version > currentVer) {
             // Примем — ждём upload
@@ -342,53 +984,44 @@ void SyncServer::handleSyncList(QTcpSocket *socket, const QByteArray &body)
     } else {
         sendHttpResponse(socket, 409, "Conflict", QString("Some files are outdated"));
     }
-
-    socket->disconnectFromHost();
 }
 
 void SyncServer::handleDownloadRequest(QTcpSocket *socket, const QString &fileName)
 {
     if (fileName.isEmpty()) {
         sendHttpResponse(socket, 400, "Bad Request", QString("No file specified"));
-        socket->disconnectFromHost();
         return;
     }
 
-    QFile file(fileName);
-    if (file.exists()) {
-        if (!file.open(QIODevice::ReadOnly)) {
-            sendHttpResponse(socket, 500, "Internal Server Error", QString("Cannot open file"));
-            socket->disconnectFromHost();
-            return;
-        }
-
-        QByteArray content = file.readAll();
-        file.close();
-
-        QByteArray response = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n\r\n";
-        response.append(content);
-        socket->write(response);
-        socket->disconnectFromHost();
+    QFileInfo info(fileName);
+    if (info.exists()) {
+        streamFile(socket, fileName, 0, info.size());
     } else {
         // Попробовать получить с внешнего источника
+        if (ClientConnection *conn = connectionFor(socket))
+            conn->responsePending = true;
+
+        QPointer<QTcpSocket> guard(socket);
         fetchFromRemote("/" + fileName, [=](QByteArray data) {
+            if (!guard)
+                return;
+
             if (!data.isEmpty()) {
                 QFile f(fileName);
                 if (f.open(QIODevice::WriteOnly)) {
                     f.write(data);
                     f.close();
                 }
-                QByteArray response = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n\r\n" + data;
-                socket->write(response);
+                sendHttpResponse(socket, 200, "OK", data);
             } else {
                 sendHttpResponse(socket, 404, "Not Found", QString("File not found and not fetched"));
             }
-            socket->disconnectFromHost();
+            finishPendingResponse(socket, true);
         });
     }
 }
 
-void SyncServer::handleDownload(QTcpSocket *socket, const QByteArray &path)
+void SyncServer::handleDownload(QTcpSocket *socket, const QByteArray &path, const QMap<QString, QString> &headers)
 {
     // path содержит URL с параметрами, например: /download?path=relativePath&rootIndex=0
     QUrl url = QUrl::fromEncoded(path);
@@ -398,102 +1031,561 @@ void SyncServer::handleDownload(QTcpSocket *socket, const QByteArray &path)
 
     if (relativePath.isEmpty() || rootIndex < 0 || rootIndex >= m_syncDirectories.size()) {
         sendHttpResponse(socket, 400, "Bad Request", QString("Missing path or invalid rootIndex"));
-        socket->disconnectFromHost();
         return;
     }
 
     QString fullPath = resolveFullPath(rootIndex, relativePath);
-    QFile file(fullPath);
+    QFileInfo info(fullPath);
 
-    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+    if (!info.isFile() || !info.isReadable()) {
         sendHttpResponse(socket, 404, "Not Found", QString("File not found"));
-        socket->disconnectFromHost();
         return;
     }
 
-    QByteArray data = file.readAll();
-    file.close();
+    // Версия и хэш позволяют клиенту докачать файл и проверить собранную копию
+    const qint64 size = info.size();
+    const FileEntry current = m_fileEntries.value(qMakePair(rootIndex, relativePath), FileEntry());
+    const quint64 version = current.version ? current.version : quint64(info.lastModified().toMSecsSinceEpoch());
+    const QByteArray etag = "\"" + QByteArray::number(version) + "\"";
+
+    QByteArray extraHeaders;
+    extraHeaders += "Accept-Ranges: bytes\r\n";
+    extraHeaders += "ETag: " + etag + "\r\n";
+    extraHeaders += "X-File-Version: " + QByteArray::number(versionToClient(version, legacyVersionUnit(headers))) + "\r\n";
+    if (!current.hash.isEmpty())
+        extraHeaders += "X-File-Hash: " + current.hash.toHex() + "\r\n";
+
+    // Range учитывается, только если у клиента та же версия (If-Range)
+    const QString range = headers.value("range");
+    const QString ifRange = headers.value("if-range");
+    if (range.startsWith("bytes=") && (ifRange.isEmpty() || ifRange.toLatin1() == etag)) {
+        const QString spec = range.mid(6).section(',', 0, 0).trimmed();
+        const QString startText = spec.section('-', 0, 0);
+        const QString endText = spec.section('-', 1, 1);
+        bool startOk = spec.contains('-');
+        bool endOk = true;
+        qint64 start = 0;
+        qint64 end = size - 1;
+        if (startText.isEmpty()) {
+            // bytes=-N — последние N байт; N больше размера означает файл целиком (RFC 7233)
+            const qint64 suffix = endText.toLongLong(&endOk);
+            startOk = startOk && endOk && suffix > 0;
+            start = qMax<qint64>(0, size - suffix);
+        } else {
+            start = startText.toLongLong(&startOk);
+            if (!endText.isEmpty())
+                end = qMin(size - 1, endText.toLongLong(&endOk));
+        }
+
+        if (!startOk || !endOk || start >= size || end < start) {
+            sendHttpResponse(socket, 416, "Range Not Satisfiable", QByteArray("Invalid range"), "text/plain",
+                             "Content-Range: bytes */" + QByteArray::number(size) + "\r\n");
+            return;
+        }
+
+        extraHeaders += "Content-Range: bytes " + QByteArray::number(start) + "-" + QByteArray::number(end)
+                        + "/" + QByteArray::number(size) + "\r\n";
+        streamFile(socket, fullPath, start, end - start + 1, extraHeaders, nullptr, false, true);
+        return;
+    }
+
+    const bool gzip = Compression::accepts(headers.value("accept-encoding").toLatin1());
+
+    // Небольшие файлы отдаются из кэша; крупные — потоком (sendfile), без копии в памяти.
+    // Решение о сжатии хранится в записи кэша: при попадании файл не читается и не пробуется
+    if (size <= m_hotFiles.maxEntrySize()) {
+        const HotFileCache::Key key{ rootIndex, relativePath, version,
+                                     info.lastModified().toMSecsSinceEpoch(), gzip };
+        sendCachedFile(socket, key, fullPath, extraHeaders);
+        return;
+    }
+
+    // Уже сжатые форматы повторно не сжимаются
+    streamFile(socket, fullPath, 0, size, extraHeaders, nullptr, gzip && Compression::worthCompressing(fullPath));
+}
+
+void SyncServer::sendCachedFile(QTcpSocket *socket, const HotFileCache::Key &key, const QString &fullPath,
+                                const QByteArray &extraHeaders)
+{
+    const bool gzip = key.gzip;
+    ClientConnection *conn = connectionFor(socket);
+    const quint64 traceId = conn ? conn->traceId : 0;
+    auto load = [this, fullPath, gzip, traceId](QByteArray *content, bool *compressed) {
+        TraceSpan span(m_trace, "disk", "read", traceId);
+        QFile file(fullPath);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        *content = file.readAll();
+        if (file.error() != QFile::NoError)
+            return false;
+        // Проба сжатия — по уже прочитанному содержимому, один раз на запись кэша
+        *compressed = gzip && Compression::worthCompressing(fullPath, *content);
+        if (*compressed) {
+            *content = Compression::compress(*content);
+            return !content->isEmpty();
+        }
+        return true;
+    };
+
+    // Ответ приходит сразу (попадание) либо позже, когда пул кэша дочитает файл
+    QSharedPointer<bool> answered(new bool(false));
+    QSharedPointer<bool> deferred(new bool(false));
+    m_hotFiles.fetch(key, socket, load, [=](const QByteArray &content, bool compressed, bool ok) {
+        *answered = true;
+        if (!ok) {
+            sendHttpResponse(socket, 500, "Internal Server Error", QString("Cannot read file"));
+        } else {
+            sendHttpHeaders(socket, 200, "OK", content.size(), "application/octet-stream",
+                            compressed ? extraHeaders + "Content-Encoding: " + Compression::Encoding + "\r\n"
+                                       : extraHeaders);
+            socket->write(content);
+        }
+        if (*deferred)
+            finishPendingResponse(socket, true);
+    });
+
+    if (!*answered) {
+        *deferred = true;
+        if (conn)
+            conn->responsePending = true;
+    }
+}
+
+void SyncServer::streamFile(QTcpSocket *socket, const QString &fullPath, qint64 offset, qint64 length,
+                            const QByteArray &extraHeaders, QObject *attachment, bool compress, bool partial)
+{
+    // Тело файла не загружается в память: отдаём его порциями по мере освобождения буфера сокета
+    FileStreamer *streamer = new FileStreamer(socket, fullPath, offset, length, socket);
+    if (!streamer->open()) {
+        delete streamer;
+        delete attachment;
+        sendHttpResponse(socket, 500, "Internal Server Error", QString("Cannot open file"));
+        return;
+    }
+
+    // attachment (например, временный файл с дельтой) живёт до конца передачи
+    if (attachment)
+        attachment->setParent(streamer);
+
+    connect(streamer, &FileStreamer::finished, socket, [this, socket, streamer, fullPath](bool ok) {
+        if (!ok)
+            qCWarning(lcServer) << "Download interrupted:" << fullPath << "sent" << streamer->bytesSent();
+        m_metrics.addBytesOut(streamer->bytesSentDirectly());
+        streamer->deleteLater();
+        finishPendingResponse(socket, ok);
+    });
+
+    if (ClientConnection *conn = connectionFor(socket))
+        conn->responsePending = true;
 
-    sendHttpResponse(socket, 200, "OK", data, "application/octet-stream");
+    if (compress) {
+        streamer->setCompressed(true);
+        sendHttpHeaders(socket, 200, "OK", -1, "application/octet-stream",
+                        extraHeaders + "Content-Encoding: " + Compression::Encoding + "\r\n");
+    } else if (partial) {
+        sendHttpHeaders(socket, 206, "Partial Content", length, "application/octet-stream", extraHeaders);
+    } else {
+        sendHttpHeaders(socket, 200, "OK", length, "application/octet-stream", extraHeaders);
+    }
+    streamer->start();
 }
 
+bool SyncServer::parseFileQuery(const QByteArray &path, int *rootIndex, QString *relativePath) const
+{
+    QUrlQuery query(QUrl::fromEncoded(path));
+    *relativePath = query.queryItemValue("path");
+    *rootIndex = query.queryItemValue("rootIndex").toInt();
 
-void SyncServer::handleUpload(QTcpSocket *socket,
-                              const QMap<QString, QString> &headers,
-                              const QByteArray &body)
+    return !relativePath->isEmpty() && *rootIndex >= 0 && *rootIndex < m_syncDirectories.size();
+}
+
+void SyncServer::handleSignature(QTcpSocket *socket, const QByteArray &path, const QMap<QString, QString> &headers)
 {
+    // Сигнатура серверной копии — клиент строит по ней дельту для загрузки
+    int rootIndex = -1;
+    QString relativePath;
+    if (!parseFileQuery(path, &rootIndex, &relativePath)) {
+        sendHttpResponse(socket, 400, "Bad Request", QString("Missing path or invalid rootIndex"));
+        return;
+    }
+
+    const FileEntry current = m_fileEntries.value(qMakePair(rootIndex, relativePath),
+                                                  FileEntry{relativePath, "unknown", 0, rootIndex});
+    DeltaSync::Signature signature;
+    if (current.version == 0 || !DeltaSync::computeSignature(resolveFullPath(rootIndex, relativePath), &signature)) {
+        sendHttpResponse(socket, 404, "Not Found", QString("File not found"));
+        return;
+    }
+
+    sendHttpResponse(socket, 200, "OK", signature.serialize(), "application/x-sync-signature",
+                     "X-File-Version: " + QByteArray::number(versionToClient(current.version, legacyVersionUnit(headers))) + "\r\n");
+}
+
+void SyncServer::handleDeltaDownload(QTcpSocket *socket, const QByteArray &path,
+                                     const QMap<QString, QString> &headers, const QByteArray &body)
+{
+    // Клиент прислал сигнатуру своей копии — отвечаем дельтой вместо файла целиком
+    int rootIndex = -1;
+    QString relativePath;
+    if (!parseFileQuery(path, &rootIndex, &relativePath)) {
+        sendHttpResponse(socket, 400, "Bad Request", QString("Missing path or invalid rootIndex"));
+        return;
+    }
+
+    DeltaSync::Signature signature;
+    if (!DeltaSync::Signature::parse(body, &signature)) {
+        sendHttpResponse(socket, 400, "Bad Request", QString("Invalid signature"));
+        return;
+    }
+
+    const QString fullPath = resolveFullPath(rootIndex, relativePath);
+    if (!QFileInfo(fullPath).isFile()) {
+        sendHttpResponse(socket, 404, "Not Found", QString("File not found"));
+        return;
+    }
+
+    const FileEntry current = m_fileEntries.value(qMakePair(rootIndex, relativePath),
+                                                  FileEntry{relativePath, "unknown", 0, rootIndex});
+
+    QTemporaryFile *deltaFile = new QTemporaryFile;
+    if (!deltaFile->open() || !DeltaSync::writeDelta(fullPath, signature, deltaFile) || !deltaFile->flush()) {
+        delete deltaFile;
+        sendHttpResponse(socket, 500, "Internal Server Error", QString("Cannot build delta"));
+        return;
+    }
+
+    const qint64 deltaSize = deltaFile->size();
+    deltaFile->close();
+
+    qCDebug(lcServer) << "Delta for" << relativePath << ":" << deltaSize << "bytes instead of" << QFileInfo(fullPath).size();
+
+    streamFile(socket, deltaFile->fileName(), 0, deltaSize,
+               "X-File-Version: " + QByteArray::number(versionToClient(current.version, legacyVersionUnit(headers))) + "\r\n",
+               deltaFile);
+}
+
+static QString uploadTempPath(const QString &fullPath, quint64 version)
+{
+    return partFilePath(fullPath, "sync-" + QString::number(version));
+}
+
+// Недокачанные части других версий того же файла больше не понадобятся.
+// Сборки из дельты (".delta-<version>.part") не затрагиваются: они живут только внутри запроса
+static void removeStaleUploads(const QString &fullPath, quint64 version)
+{
+    const QFileInfo info(fullPath);
+    const QString keep = QFileInfo(uploadTempPath(fullPath, version)).fileName();
+    QDir dir(info.absolutePath());
+    const QStringList parts = dir.entryList(QStringList() << "." + info.fileName() + ".sync-*.part",
+                                            QDir::Files | QDir::Hidden);
+    for (const QString &name : parts) {
+        if (name != keep)
+            dir.remove(name);
+    }
+}
+
+void SyncServer::handleUploadOffset(QTcpSocket *socket, const QByteArray &path)
+{
+    // /upload-offset?path=...&rootIndex=...&version=... — сколько байт этой версии уже принято
+    int rootIndex = -1;
+    QString relativePath;
+    const quint64 version = QUrlQuery(QUrl::fromEncoded(path)).queryItemValue("version").toULongLong();
+    if (!parseFileQuery(path, &rootIndex, &relativePath) || version == 0) {
+        sendHttpResponse(socket, 400, "Bad Request", QString("Missing path, rootIndex or version"));
+        return;
+    }
+
+    const QFileInfo part(uploadTempPath(resolveFullPath(rootIndex, relativePath), version));
+    const qint64 offset = part.isFile() ? part.size() : 0;
+    sendHttpResponse(socket, 200, "OK", QByteArray::number(offset), "text/plain",
+                     "X-Upload-Offset: " + QByteArray::number(offset) + "\r\n");
+}
+
+void SyncServer::beginUpload(QTcpSocket *socket, ClientConnection *conn)
+{
+    const QMap<QString, QString> &headers = conn->headers;
     QString relativePath = headers.value("x-file-path");
-    quint64 version = headers.value("x-file-version").toULongLong();
+    quint64 version = versionFromClient(headers.value("x-file-version").toULongLong(), legacyVersionUnit(headers));
     int rootIndex = headers.value("x-file-root-index").toInt();
-    QString type = headers.value("x-file-type").toLower();
-    if (type.isEmpty()) {
-        type = "modified"; // По умолчанию
-    }
 
-    if (relativePath.isEmpty() || version <= 0 || body.isEmpty()) {
+    if (relativePath.isEmpty() || version <= 0 || (!conn->chunked && conn->contentLength == 0)
+            || rootIndex < 0 || rootIndex >= m_syncDirectories.size()) {
         sendHttpResponse(socket, 400, "Bad Request", QString("Missing headers or body"));
+        conn->discardBody = true;
         return;
     }
 
-    // Сравнение версий
+    // Сравнение версий ещё до приёма тела, чтобы не гонять устаревшие данные на диск
     auto key = qMakePair(rootIndex, relativePath);
     FileEntry current = m_fileEntries.value(key, FileEntry{relativePath, "unknown", 0, rootIndex});
     if (version <= current.version) {
-        qDebug() << "Upload rejected: incoming version" << version << "≤ current version" << current.version;
+        qCDebug(lcServer) << "Upload rejected: incoming version" << version << "≤ current version" << current.version;
         sendHttpResponse(socket, 409, "Conflict", QString("Older or same version received"));
+        conn->discardBody = true;
         return;
     }
 
-    // Версия новее — сохраняем
     QString fullPath = resolveFullPath(rootIndex, relativePath);
     QDir().mkpath(QFileInfo(fullPath).absolutePath());
 
-    QFile file(fullPath);
-    if (!file.open(QIODevice::WriteOnly)) {
+    // Для /delta-upload во временный файл пишется дельта, итоговый файл собирается в handleDeltaUpload
+    const bool delta = conn->path.startsWith("/delta-upload");
+    // X-Upload-Offset — продолжение ранее прерванной загрузки той же версии
+    const qint64 offset = delta ? 0 : headers.value("x-upload-offset").toLongLong();
+    if (!delta)
+        removeStaleUploads(fullPath, version);
+
+    QFile *file = new QFile(uploadTempPath(fullPath, version) + (delta ? ".delta" : ""));
+    if (offset > 0 && file->size() != offset) {
+        // Принятая часть не совпадает с ожиданием клиента — сообщаем, с какого места продолжать
+        const QByteArray actual = QByteArray::number(file->exists() ? file->size() : 0);
+        delete file;
+        sendHttpResponse(socket, 416, "Range Not Satisfiable", actual, "text/plain",
+                         "X-Upload-Offset: " + actual + "\r\n");
+        conn->discardBody = true;
+        return;
+    }
+
+    const QIODevice::OpenMode mode = offset > 0 ? QIODevice::ReadWrite | QIODevice::Append
+                                                : QIODevice::WriteOnly | QIODevice::Truncate;
+    if (offset < 0 || !file->open(mode)) {
+        delete file;
         sendHttpResponse(socket, 500, "Internal Server Error", QString("Cannot write file"));
+        conn->discardBody = true;
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    // Резервируем место заранее: меньше фрагментации и отказ ещё до приёма тела.
+    // Отсутствие поддержки в файловой системе (EOPNOTSUPP) и прочие ошибки не мешают записи
+    if (conn->contentLength > 0
+            && ::fallocate(file->handle(), FALLOC_FL_KEEP_SIZE, offset, conn->contentLength) == -1
+            && errno == ENOSPC) {
+        qCWarning(lcServer) << "No space left for upload of" << relativePath << ":" << conn->contentLength << "bytes";
+        file->close();
+        // Уже принятая часть сохраняется для докачки, пустой файл не нужен
+        if (offset == 0)
+            file->remove();
+        delete file;
+        sendHttpResponse(socket, 507, "Insufficient Storage", QString("Not enough disk space"));
+        conn->discardBody = true;
+        return;
+    }
+#endif
+
+    if (!delta) {
+        // Хэш считается по всему файлу, поэтому уже принятая часть прогоняется через него заново
+        conn->uploadHash = new QCryptographicHash(QCryptographicHash::Md5);
+        if (offset > 0) {
+            file->seek(0);
+            char buffer[64 * 1024];
+            qint64 remaining = offset;
+            while (remaining > 0) {
+                const qint64 n = file->read(buffer, qMin<qint64>(sizeof(buffer), remaining));
+                if (n <= 0)
+                    break;
+                conn->uploadHash->addData(buffer, int(n));
+                remaining -= n;
+            }
+            file->seek(offset);
+        }
+        conn->keepPartialUpload = true;
+    }
+
+    conn->uploadFile = file;
+    conn->uploadTarget = fullPath;
+}
+
+void SyncServer::handleUpload(QTcpSocket *socket, ClientConnection *conn)
+{
+    if (conn->discardBody || !conn->uploadFile) {
+        // Ответ уже отправлен в beginUpload
+        return;
+    }
+
+    const QMap<QString, QString> &headers = conn->headers;
+    QString relativePath = headers.value("x-file-path");
+    quint64 version = versionFromClient(headers.value("x-file-version").toULongLong(), legacyVersionUnit(headers));
+    int rootIndex = headers.value("x-file-root-index").toInt();
+    QString type = headers.value("x-file-type").toLower();
+    if (type.isEmpty()) {
+        type = "modified"; // По умолчанию
+    }
+
+    QFile *file = conn->uploadFile;
+    conn->uploadFile = nullptr;
+    QByteArray hash;
+    if (conn->uploadHash) {
+        hash = conn->uploadHash->result();
+        delete conn->uploadHash;
+        conn->uploadHash = nullptr;
+    }
+
+    bool flushed = file->flush();
+    file->close();
+
+    if (!flushed || conn->bodyReceived == 0) {
+        file->remove();
+        delete file;
+        sendHttpResponse(socket, 400, "Bad Request", QString("Missing headers or body"));
+        return;
+    }
+
+    // Хэш, заявленный клиентом, должен совпасть с принятым содержимым
+    const QByteArray expectedHash = QByteArray::fromHex(headers.value("x-file-hash").toLatin1());
+    if (!expectedHash.isEmpty() && expectedHash != hash) {
+        file->remove();
+        delete file;
+        qCDebug(lcServer) << "Upload rejected for" << relativePath << ": content hash mismatch";
+        sendHttpResponse(socket, 400, "Bad Request", QString("Content hash mismatch"));
+        return;
+    }
+
+    const QString tempPath = file->fileName();
+    delete file;
+
+    FileEntry entry{ relativePath, type, version, rootIndex };
+    entry.hash = hash;
+    TraceSpan span(m_trace, "disk", "commit", conn->traceId);
+    commitUpload(socket, entry, tempPath, conn->uploadTarget);
+}
+
+void SyncServer::handleDeltaUpload(QTcpSocket *socket, ClientConnection *conn)
+{
+    if (conn->discardBody || !conn->uploadFile) {
+        // Ответ уже отправлен в beginUpload
+        return;
+    }
+
+    const QMap<QString, QString> &headers = conn->headers;
+    QString relativePath = headers.value("x-file-path");
+    quint64 version = versionFromClient(headers.value("x-file-version").toULongLong(), legacyVersionUnit(headers));
+    int rootIndex = headers.value("x-file-root-index").toInt();
+    QString type = headers.value("x-file-type").toLower();
+    if (type.isEmpty()) {
+        type = "modified"; // По умолчанию
+    }
+
+    QFile *deltaFile = conn->uploadFile;
+    conn->uploadFile = nullptr;
+    deltaFile->flush();
+    deltaFile->close();
+
+    // Собираем новую версию из текущей серверной копии и присланной дельты.
+    // Если базовая копия успела измениться, не сойдётся контрольная сумма — клиент отправит файл целиком.
+    // Свой тег: файл "sync-" хранит принятую часть обычной загрузки той же версии для докачки
+    const QString tempPath = partFilePath(conn->uploadTarget, "delta-" + QString::number(version));
+    QFile output(tempPath);
+    bool applied = false;
+    QByteArray hash;
+    if (deltaFile->open(QIODevice::ReadOnly) && output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        applied = DeltaSync::applyDelta(conn->uploadTarget, deltaFile, &output, &hash) && output.flush();
+        output.close();
+    }
+
+    deltaFile->close();
+    deltaFile->remove();
+    delete deltaFile;
+
+    if (!applied) {
+        output.remove();
+        qCDebug(lcServer) << "Delta upload rejected for" << relativePath << ": basis mismatch";
+        sendHttpResponse(socket, 422, "Unprocessable Entity", QString("Delta does not apply"));
         return;
     }
 
-    file.write(body);
-    file.close();
+    FileEntry entry{ relativePath, type, version, rootIndex };
+    entry.hash = hash;
+    TraceSpan span(m_trace, "disk", "commit", conn->traceId);
+    commitUpload(socket, entry, tempPath, conn->uploadTarget);
+}
 
-    // Обновить локальный список
-    m_fileEntries[key] = FileEntry{ relativePath, type, version, rootIndex };
+void SyncServer::commitUpload(QTcpSocket *socket, const FileEntry &entry,
+                              const QString &tempPath, const QString &targetPath)
+{
+    // Пока шла передача, могла прийти более новая версия: проверка версии, подмена файла
+    // и обновление индекса выполняются атомарно относительно других потоков
+    quint64 currentVersion = 0;
+    bool committed = m_fileEntries.commitIfNewer(entry,
+                                                 [&]() { return replaceFile(tempPath, targetPath); },
+                                                 &currentVersion);
+    if (!committed) {
+        QFile::remove(tempPath);
+        if (entry.version <= currentVersion) {
+            qCDebug(lcServer) << "Upload rejected: incoming version" << entry.version << "≤ current version" << currentVersion;
+            sendHttpResponse(socket, 409, "Conflict", QString("Older or same version received"));
+        } else {
+            sendHttpResponse(socket, 500, "Internal Server Error", QString("Cannot write file"));
+        }
+        return;
+    }
 
-    qDebug() << "Accepted new version for" << relativePath << "version:" << version<<"rootIndex:"<<rootIndex;
+    qCDebug(lcServer) << "Accepted new version for" << entry.path << "version:" << entry.version << "rootIndex:" << entry.rootIndex;
 
     sendHttpResponse(socket, 200, "OK", QString("File uploaded"));
+    m_hotFiles.invalidate(entry.rootIndex, entry.path);
 
     // Уведомить других клиентов
-    notifyUpdate(relativePath, false, rootIndex);
+    notifyUpdate(entry.path, false, entry.rootIndex);
 }
 
 void SyncServer::sendHttpResponse(QTcpSocket *socket, int code, const QString &status,
                                   const QString &body, const QString &contentType)
 {
-    QByteArray response;
-    response += "HTTP/1.1 " + QByteArray::number(code) + " " + status.toUtf8() + "\r\n";
-    response += "Content-Type: " + contentType.toUtf8() + "\r\n";
-    response += "Content-Length: " + QByteArray::number(body.toUtf8().size()) + "\r\n";
-    response += "Connection: close\r\n\r\n";
-    response += body.toUtf8();
-
-    socket->write(response);
+    sendHttpResponse(socket, code, status, body.toUtf8(), contentType);
 }
 
 void SyncServer::sendHttpResponse(QTcpSocket *socket, int code,
                                   const QString &status,
                                   const QByteArray &body,
-                                  const QString &contentType)
+                                  const QString &contentType,
+                                  const QByteArray &extraHeaders)
 {
-    QByteArray response;
-    response += "HTTP/1.1 " + QByteArray::number(code) + " " + status.toUtf8() + "\r\n";
-    response += "Content-Type: " + contentType.toUtf8() + "\r\n";
-    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
-    response += "Connection: close\r\n\r\n";
-    response += body;
+    // Списки и манифесты сжимаются, если клиент это принимает
+    ClientConnection *conn = connectionFor(socket);
+    const bool compressible = contentType.startsWith("text/") || contentType.startsWith("application/json")
+                              || contentType == QLatin1String(SyncManifest::ContentType);
+    if (conn && compressible && body.size() >= Compression::MinSize
+            && Compression::accepts(conn->headers.value("accept-encoding").toLatin1())) {
+        const QByteArray packed = Compression::compress(body);
+        if (!packed.isEmpty() && packed.size() < body.size()) {
+            sendHttpHeaders(socket, code, status, packed.size(), contentType,
+                            extraHeaders + "Content-Encoding: " + Compression::Encoding + "\r\n");
+            socket->write(packed);
+            return;
+        }
+    }
+
+    sendHttpHeaders(socket, code, status, body.size(), contentType, extraHeaders);
+    // Тело пишется отдельно, без склейки с заголовками в промежуточный буфер
+    socket->write(body);
+}
+
+void SyncServer::sendHttpHeaders(QTcpSocket *socket, int code, const QString &status,
+                                 qint64 contentLength, const QString &contentType,
+                                 const QByteArray &extraHeaders)
+{
+    QByteArray headers;
+    headers += "HTTP/1.1 " + QByteArray::number(code) + " " + status.toUtf8() + "\r\n";
+    headers += "Content-Type: " + contentType.toUtf8() + "\r\n";
+    if (contentLength >= 0)
+        headers += "Content-Length: " + QByteArray::number(contentLength) + "\r\n";
+    else
+        headers += "Transfer-Encoding: chunked\r\n";
+    // Клиент узнаёт, что тела запросов можно сжимать
+    headers += "Accept-Encoding: " + QByteArray(Compression::Encoding) + "\r\n";
+    headers += extraHeaders;
+
+    ClientConnection *conn = connectionFor(socket);
+    if (conn && conn->keepAlive) {
+        headers += "Connection: keep-alive\r\n";
+        headers += "Keep-Alive: timeout=" + QByteArray::number(KeepAliveTimeoutSec)
+                   + ", max=" + QByteArray::number(MaxRequestsPerConnection - conn->requestCount) + "\r\n\r\n";
+    } else {
+        headers += "Connection: close\r\n\r\n";
+    }
 
-    socket->write(response);
+    socket->write(headers);
 }
 
 void SyncServer::fetchFromRemote(const QString &path, std::function<void(QByteArray)> callback)
@@ -507,7 +1599,7 @@ void SyncServer::fetchFromRemote(const QString &path, std::function<void(QByteAr
 
     connect(remoteSocket, &QTcpSocket::connected, [=]() {
         QByteArray request = "GET " + path.toUtf8() + " HTTP/1.1\r\nHost: example.com\r\nConnection: close\r\n\r\n";
-        qDebug() << "Sending request to example.com:" << request;
+        qCDebug(lcServer) << "Sending request to example.com:" << request;
         remoteSocket->write(request);
         timeout->start();
     });
@@ -537,6 +1629,7 @@ void SyncServer::cleanupInactiveClients()
 {
     const QDateTime now = QDateTime::currentDateTime();
     QStringList toRemove;
+    QMutexLocker locker(&m_clientsMutex);
 
     for (auto it = m_registeredClients.begin(); it != m_registeredClients.end(); ++it) {
         if (it.value().secsTo(now) > 180) { // 3 минуты
@@ -545,43 +1638,227 @@ void SyncServer::cleanupInactiveClients()
     }
 
     for (const QString &ip : toRemove) {
-        qDebug() << "Removing inactive client:" << ip;
+        qCDebug(lcServer) << "Removing inactive client:" << ip;
         m_registeredClients.remove(ip);
     }
 }
 
-void SyncServer::notifyUpdate(const QString &relativePath, bool deleted, int rootIndex)
+static QByteArray encodeChunk(const QByteArray &data)
+{
+    return QByteArray::number(data.size(), 16) + "\r\n" + data + "\r\n";
+}
+
+static QByteArray pushLine(const QJsonObject &obj)
+{
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact) + '\n';
+}
+
+void SyncServer::handleMetrics(QTcpSocket *socket)
 {
+    // Значения, которые хранятся под своими блокировками, снимаются только здесь — при запросе
+    int connections = 0;
+    {
+        QMutexLocker locker(&m_connectionsMutex);
+        connections = m_connections.size();
+    }
+    int subscribers = 0;
+    int pendingNotifications = 0;
+    {
+        QMutexLocker locker(&m_subscribersMutex);
+        subscribers = m_subscribers.size();
+        pendingNotifications = m_pendingNotifications.size();
+    }
+    const HotFileCache::Stats cache = m_hotFiles.stats();
+
+    const QList<ServerMetrics::Sample> samples = {
+        { "syncserver_connections", "gauge", "Open client connections", double(connections) },
+        { "syncserver_subscribers", "gauge", "Clients subscribed to push events", double(subscribers) },
+        { "syncserver_notify_queue_depth", "gauge", "Change notifications waiting for the next batch",
+          double(pendingNotifications) },
+        { "syncserver_index_files", "gauge", "Files in the server index", double(m_fileEntries.size()) },
+        { "syncserver_file_cache_bytes", "gauge", "Memory used by the hot file cache", double(cache.bytes) },
+        { "syncserver_file_cache_entries", "gauge", "Files in the hot file cache", double(cache.entries) },
+        { "syncserver_file_cache_hits_total", "counter", "Downloads served from the hot file cache",
+          double(cache.hits) },
+        { "syncserver_file_cache_shared_total", "counter", "Downloads that waited for a load started by another request",
+          double(cache.shared) },
+        { "syncserver_file_cache_misses_total", "counter", "Downloads that loaded the file into the hot file cache",
+          double(cache.misses) },
+    };
+
+    sendHttpResponse(socket, 200, "OK", m_metrics.render(samples), "text/plain; version=0.0.4");
+}
+
+void SyncServer::handleTrace(QTcpSocket *socket)
+{
+    if (!m_trace.isEnabled()) {
+        sendHttpResponse(socket, 404, "Not Found", QString("Tracing is disabled"));
+        return;
+    }
+
+    // Chrome trace event JSON: открывается в Perfetto (ui.perfetto.dev) или chrome://tracing
+    sendHttpResponse(socket, 200, "OK", m_trace.toChromeJson(), "application/json");
+}
+
+void SyncServer::handleSubscribe(QTcpSocket *socket, ClientConnection *conn)
+{
+    QUrlQuery query(QUrl::fromEncoded(conn->path));
+    const qint64 epoch = query.queryItemValue("epoch").toLongLong();
+    bool sinceOk = false;
+    const quint64 since = query.queryItemValue("since").toULongLong(&sinceOk);
+
+    QByteArray headers;
+    headers += "HTTP/1.1 200 OK\r\n";
+    headers += "Content-Type: application/x-ndjson\r\n";
+    headers += "Transfer-Encoding: chunked\r\n";
+    headers += "Cache-Control: no-cache\r\n";
+    headers += "Connection: keep-alive\r\n\r\n";
+    socket->write(headers);
+
+    // Ответ не завершается, пока клиент не отключится
+    conn->subscribed = true;
+    conn->responsePending = true;
+
+    // История и регистрация под одной блокировкой: событие не потеряется и не придёт дважды
+    QMutexLocker locker(&m_subscribersMutex);
+    const quint64 oldest = m_eventSeq - quint64(m_recentEvents.size());
+    const bool resume = epoch == m_pushEpoch && sinceOk && since >= oldest && since <= m_eventSeq;
+
+    QJsonObject hello;
+    hello["epoch"] = double(m_pushEpoch);
+    hello["seq"] = double(resume ? since : m_eventSeq);
+    // Клиент уже был подписан, но пропущенных событий не восстановить
+    if (epoch != 0 && !resume)
+        hello["resync"] = true;
+    socket->write(encodeChunk(pushLine(hello)));
+
+    if (resume) {
+        for (int i = int(since - oldest); i < m_recentEvents.size(); ++i)
+            socket->write(encodeChunk(m_recentEvents.at(i)));
+    }
+
+    m_subscribers.insert(socket);
+    qCDebug(lcServer) << "Subscriber" << socket->peerAddress().toString() << "from seq" << (resume ? since : m_eventSeq)
+             << "subscribers:" << m_subscribers.size();
+}
+
+void SyncServer::pushToSubscribers(const QByteArray &line)
+{
+    // Вызывается под m_subscribersMutex. Сокеты живут в рабочих потоках —
+    // запись ставится в цикл событий потока сокета
+    const QByteArray chunk = encodeChunk(line);
+    for (QTcpSocket *socket : m_subscribers)
+        QTimer::singleShot(0, socket, [socket, chunk]() { socket->write(chunk); });
+}
+
+void SyncServer::sendHeartbeat()
+{
+    QMutexLocker locker(&m_subscribersMutex);
+    if (m_subscribers.isEmpty())
+        return;
+
     QJsonObject obj;
-    obj["path"] = relativePath;
-    obj["rootIndex"] = rootIndex;
-    obj["deleted"] = deleted;
+    obj["heartbeat"] = true;
+    obj["seq"] = double(m_eventSeq);
+    pushToSubscribers(pushLine(obj));
+}
 
-    QJsonDocument doc(obj);
-    QByteArray json = doc.toJson();
+void SyncServer::setFileCacheSize(qint64 bytes)
+{
+    m_hotFiles.setCapacity(bytes);
+}
 
-    for (auto it = m_registeredClients.begin(); it != m_registeredClients.end(); ++it) {
-        const QString &clientIp = it.key();
-        QHostAddress clientAddr(clientIp);
+void SyncServer::setTraceCapacity(int eventsPerThread)
+{
+    m_trace.setCapacity(eventsPerThread);
+}
 
-        QTcpSocket *socket = new QTcpSocket(this);
+void SyncServer::reportCacheStats()
+{
+    const HotFileCache::Stats stats = m_hotFiles.stats();
+    const quint64 requests = stats.hits + stats.misses + stats.shared;
+    if (requests == m_reportedCacheRequests)
+        return;
+    m_reportedCacheRequests = requests;
 
-        connect(socket, &QTcpSocket::connected, [=]() {
-            QByteArray request;
-            request += "POST /notify HTTP/1.1\r\n";
-            request += "Host: " + clientIp.toUtf8() + "\r\n";
-            request += "Content-Type: application/json\r\n";
-            request += "Content-Length: " + QByteArray::number(json.size()) + "\r\n";
-            request += "Connection: close\r\n\r\n";
-            request += json;
+    // Ожидание чужой загрузки тоже экономит чтение с диска
+    const double hitRate = 100.0 * double(stats.hits + stats.shared) / double(requests);
+    qCDebug(lcServer) << "File cache:" << stats.entries << "files," << stats.bytes / 1024 << "KiB, hit rate"
+             << QString::number(hitRate, 'f', 1) + "%" << "(hits" << stats.hits << "shared" << stats.shared
+             << "misses" << stats.misses << ")";
+}
 
-            socket->write(request);
-        });
+void SyncServer::setNotifyCoalescing(int windowMs, int maxBatch)
+{
+    QMutexLocker locker(&m_subscribersMutex);
+    m_notifyWindowMs = qMax(0, windowMs);
+    m_notifyMaxBatch = qMax(1, maxBatch);
+}
+
+void SyncServer::notifyUpdate(const QString &relativePath, bool deleted, int rootIndex)
+{
+    QMutexLocker locker(&m_subscribersMutex);
+
+    const QPair<int, QString> key(rootIndex, relativePath);
+    auto it = m_pendingIndex.constFind(key);
+    if (it != m_pendingIndex.constEnd()) {
+        // Промежуточные версии клиенту не нужны — важно только последнее состояние
+        m_pendingNotifications[it.value()].deleted = deleted;
+        return;
+    }
+
+    m_pendingIndex.insert(key, m_pendingNotifications.size());
+    m_pendingNotifications.append(PendingNotification{rootIndex, relativePath, deleted});
+
+    if (m_pendingNotifications.size() >= m_notifyMaxBatch) {
+        flushNotificationsLocked();
+        return;
+    }
+
+    // Окно отсчитывается от первого изменения в пакете; вызов возможен из любого потока
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QTimer::singleShot(m_notifyWindowMs, this, &SyncServer::flushNotifications);
+    }
+}
+
+void SyncServer::flushNotifications()
+{
+    QMutexLocker locker(&m_subscribersMutex);
+    m_flushScheduled = false;
+    flushNotificationsLocked();
+}
+
+void SyncServer::flushNotificationsLocked()
+{
+    if (m_pendingNotifications.isEmpty())
+        return;
 
-        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    TraceSpan span(m_trace, "notify", "fanout");
+    span.setArg("subscribers", m_subscribers.size());
 
-        socket->connectToHost(clientAddr, 9090);  // порт клиента
+    QJsonArray events;
+    for (const PendingNotification &pending : m_pendingNotifications) {
+        QJsonObject obj;
+        obj["path"] = pending.path;
+        obj["rootIndex"] = pending.rootIndex;
+        obj["deleted"] = pending.deleted;
+        events.append(obj);
     }
+    m_pendingNotifications.clear();
+    m_pendingIndex.clear();
+
+    // Пакет целиком получает один порядковый номер
+    QJsonObject batch;
+    batch["seq"] = double(++m_eventSeq);
+    batch["events"] = events;
+    const QByteArray line = pushLine(batch);
+
+    m_recentEvents.append(line);
+    if (m_recentEvents.size() > PushHistorySize)
+        m_recentEvents.removeFirst();
+
+    pushToSubscribers(line);
 }
 
 void SyncServer::handleDelete(QTcpSocket *socket, const QMap<QString, QString> &headers)
@@ -603,7 +1880,8 @@ void SyncServer::handleDelete(QTcpSocket *socket, const QMap<QString, QString> &
     }
 
     m_fileEntries.remove(qMakePair(rootIndex, relativePath));
-    qDebug() << "Deleted file:" << relativePath;
+    m_hotFiles.invalidate(rootIndex, relativePath);
+    qCDebug(lcServer) << "Deleted file:" << relativePath;
 
     sendHttpResponse(socket, 200, "OK", QString("File deleted"));
 
@@ -6,17 +6,113 @@
 #include <QDateTime>
 #include <QHostAddress>
 #include <QTimer>
+#include <QMutex>
+#include <QVector>
+#include <QSet>
+#include <QAtomicInt>
 #include <functional>
 #include "FileEntry.h"
+#include "FileIndex.h"
+#include "HotFileCache.h"
+#include "RequestTrace.h"
+#include "ServerMetrics.h"
+#include <QElapsedTimer>
 
 class QTcpSocket;
 class QUdpSocket;
+class QFile;
+class QThread;
+class QCryptographicHash;
+class GzipStream;
 class FileMonitor;
+
+// Состояние разбора HTTP-запроса на одном соединении.
+// Данные разбираются по мере поступления, тело /upload сразу пишется на диск.
+struct ClientConnection
+{
+    enum ChunkState { ChunkSize, ChunkData, ChunkDataEnd, ChunkTrailer, ChunkDone };
+
+    QByteArray buffer;          // ещё не разобранные данные
+    int headerScanPos = 0;      // откуда продолжать поиск конца заголовков
+    bool headersParsed = false;
+
+    QByteArray head;            // строка запроса и заголовки
+    QByteArray method;
+    QByteArray path;
+    QMap<QString, QString> headers;
+
+    qint64 contentLength = 0;
+    qint64 bodyReceived = 0;
+    bool chunked = false;
+    ChunkState chunkState = ChunkSize;
+    qint64 chunkRemaining = 0;
+
+    QByteArray body;            // тело небольших запросов (sync-list и т.п.)
+    QFile *uploadFile = nullptr; // временный файл рядом с целевым
+    QString uploadTarget;
+    QCryptographicHash *uploadHash = nullptr; // MD5 принимаемого файла, считается по мере записи
+    GzipStream *bodyDecoder = nullptr; // тело со сжатием (Content-Encoding: gzip)
+    bool keepPartialUpload = false; // при обрыве принятая часть остаётся для докачки
+    bool discardBody = false;   // ответ уже отправлен, тело только вычитываем
+    bool bodyTooLarge = false;  // тело в памяти превысило MaxBufferedBodySize
+
+    // Постоянное соединение (keep-alive) и конвейер запросов
+    bool keepAlive = true;
+    bool responsePending = false; // ответ ещё передаётся асинхронно
+    bool dispatching = false;   // выполняется handleClientRequest
+    bool closing = false;
+    int requestCount = 0;
+    QTimer *idleTimer = nullptr;
+    bool subscribed = false;    // соединение отдано под поток событий /subscribe
+
+    ServerMetrics::Route route = ServerMetrics::RouteOther;
+    QElapsedTimer requestTimer; // от разбора заголовков до конца ответа
+
+    // Отметки RequestTrace; -1 — ещё не наступило
+    quint64 traceId = 0;
+    qint64 traceStartNs = -1;   // первый байт запроса
+    qint64 traceHeadNs = -1;    // заголовки разобраны, дальше приём тела
+    qint64 traceSendNs = -1;    // ответ передаётся асинхронно
+
+    ~ClientConnection();
+    void resetRequest();
+    bool bodyComplete() const;
+};
+
+// Принимает соединения, не создавая QTcpSocket: сокет создаётся уже
+// в том потоке, который будет его обслуживать
+class ConnectionListener : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit ConnectionListener(QObject *parent = nullptr) : QTcpServer(parent) {}
+
+signals:
+    void incomingSocket(qintptr socketDescriptor);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override
+    {
+        emit incomingSocket(socketDescriptor);
+    }
+};
+
 class SyncServer : public QObject
 {
     Q_OBJECT
 public:
     explicit SyncServer(QObject *parent = nullptr);
+    ~SyncServer();
+
+    // Число рабочих потоков для соединений; 0 — всё в основном цикле событий.
+    // Задаётся до listen().
+    void setWorkerCount(int count);
+    // Изменения за windowMs объединяются в один пакет уведомлений, не больше maxBatch путей
+    void setNotifyCoalescing(int windowMs, int maxBatch);
+    // Объём памяти под кэш часто запрашиваемых файлов
+    void setFileCacheSize(qint64 bytes);
+    // Событий трассировки на поток (GET /trace); 0 — трассировка выключена. Задаётся до listen().
+    void setTraceCapacity(int eventsPerThread);
     bool listen(const QHostAddress &address, quint16 port);
     void stop();
 
@@ -25,36 +121,105 @@ signals:
     void serverStopped();
 
 private slots:
-    void handleNewConnection();
+    void handleIncomingSocket(qintptr socketDescriptor);
     void handleClientReadyRead();
     void handleClientDisconnected();
     void cleanupInactiveClients();
     void handleDatagram();
+    void sendHeartbeat();
+    void flushNotifications();
+    void applyInitialScan(const QList<FileEntry> &files);
+    void saveIndex();
+    void reportCacheStats();
 
 private:
-    QTcpServer m_server;
+    ConnectionListener m_server;
     QHash<QString, QDateTime> m_fileVersions;
     QHash<QString, QDateTime> m_registeredClients;
+    QMutex m_clientsMutex;
     QTimer m_cleanupTimer;
 
-    QHash<QTcpSocket*, QByteArray> m_clientBuffers;
-    FileMonitor *m_monitor = nullptr;
-    // актуальное состояние файлов сервера
-    QHash<QPair<int, QString>, FileEntry> m_fileEntries;
+    QHash<QTcpSocket*, ClientConnection*> m_connections;
+    mutable QMutex m_connectionsMutex;
+
+    // Подписчики на события (GET /subscribe) и недавняя история для дозапроса
+    QMutex m_subscribersMutex;
+    QSet<QTcpSocket*> m_subscribers;
+    QList<QByteArray> m_recentEvents;   // последние события, по строке JSON на событие
+    quint64 m_eventSeq = 0;             // номер последнего события
+    qint64 m_pushEpoch;                 // меняется при перезапуске сервера
+    QTimer m_heartbeatTimer;
+
+    // Накопление уведомлений: повторные изменения одного файла сливаются в последнее состояние
+    struct PendingNotification
+    {
+        int rootIndex;
+        QString path;
+        bool deleted;
+    };
+    QVector<PendingNotification> m_pendingNotifications;
+    QHash<QPair<int, QString>, int> m_pendingIndex; // ключ -> позиция в m_pendingNotifications
+    bool m_flushScheduled = false;
+    int m_notifyWindowMs = 100;
+    int m_notifyMaxBatch = 500;
+
+    FileMonitor *m_monitor = nullptr;   // живёт в m_monitorThread
+    QThread *m_monitorThread = nullptr;
+    QString m_indexPath;                // сохранённый индекс для быстрого старта
+    QTimer m_indexSaveTimer;
+    bool m_warmStart = false;
+    // Индекс сверен с диском после старта. Читается рабочими потоками: до сверки
+    // полная синхронизация отклоняется — по неполному индексу клиент удалил бы свои файлы
+    QAtomicInt m_indexReady;
+    int m_savedGeneration = -1;
+    // актуальное состояние файлов сервера (общее для всех рабочих потоков)
+    FileIndex m_fileEntries;
+    // Тела /download свежих файлов: после уведомления их запрашивают все клиенты разом
+    HotFileCache m_hotFiles;
+    quint64 m_reportedCacheRequests = 0;
+    ServerMetrics m_metrics;
+    RequestTrace m_trace;
+
+    int m_workerCount = 0;
+    int m_nextWorker = 0;
+    QVector<QThread*> m_workers;
+    QVector<QObject*> m_workerContexts; // объекты-контексты, живущие в рабочих потоках
     QStringList m_syncDirectories;
     QUdpSocket *m_udpSocket;
 
+    void startWorkers();
+    void stopWorkers();
     void handleClient(QTcpSocket *clientSocket);
-    void handleClientRequest(QTcpSocket *socket, const QByteArray &data,
-                             const QMap<QString, QString>& headers,
-                             const QByteArray &body,
-                             const QByteArray& path);
+    ClientConnection *connectionFor(QTcpSocket *socket) const;
+    void processRequests(QTcpSocket *socket, ClientConnection *conn);
+    bool completeRequest(QTcpSocket *socket, ClientConnection *conn);
+    void finishPendingResponse(QTcpSocket *socket, bool ok);
+    bool parseRequestHead(ClientConnection *conn, const QByteArray &head);
+    bool consumeBody(ClientConnection *conn);
+    bool writeBody(ClientConnection *conn, const char *data, qint64 size);
+    void beginUpload(QTcpSocket *socket, ClientConnection *conn);
+    void handleClientRequest(QTcpSocket *socket, ClientConnection *conn);
     void handleRegisterRequest(const QHostAddress &addr);
-    void handleSyncList(QTcpSocket *socket, const QByteArray &body);
+    void handleSubscribe(QTcpSocket *socket, ClientConnection *conn);
+    void handleMetrics(QTcpSocket *socket);
+    void handleTrace(QTcpSocket *socket);
+    bool rejectUntilIndexReady(QTcpSocket *socket);
+    void pushToSubscribers(const QByteArray &line);
+    void flushNotificationsLocked();
+    void handleMerkle(QTcpSocket *socket, const QByteArray &body);
+    void handleSyncList(QTcpSocket *socket, const QMap<QString, QString> &headers, const QByteArray &body);
     void handleDownloadRequest(QTcpSocket *socket, const QString &fileName);
-    void handleDownload(QTcpSocket *socket, const QByteArray &path);
+    void handleDownload(QTcpSocket *socket, const QByteArray &path, const QMap<QString, QString> &headers);
     void handleDelete(QTcpSocket *socket, const QMap<QString, QString> &headers);
-    void handleUpload(QTcpSocket *socket, const QMap<QString, QString> &headers, const QByteArray &body);
+    void handleUpload(QTcpSocket *socket, ClientConnection *conn);
+    void handleUploadOffset(QTcpSocket *socket, const QByteArray &path);
+    void handleDeltaUpload(QTcpSocket *socket, ClientConnection *conn);
+    void commitUpload(QTcpSocket *socket, const FileEntry &entry,
+                      const QString &tempPath, const QString &targetPath);
+    void handleSignature(QTcpSocket *socket, const QByteArray &path, const QMap<QString, QString> &headers);
+    void handleDeltaDownload(QTcpSocket *socket, const QByteArray &path,
+                             const QMap<QString, QString> &headers, const QByteArray &body);
+    bool parseFileQuery(const QByteArray &path, int *rootIndex, QString *relativePath) const;
     void fetchFromRemote(const QString &path, std::function<void(QByteArray)> callback);
     // Отправка HTTP-ответа с текстовым телом (QString)
     void sendHttpResponse(QTcpSocket *socket,
@@ -68,7 +233,24 @@ private:
                           int code,
                           const QString &status,
                           const QByteArray &body,
-                          const QString &contentType = "application/octet-stream");
+                          const QString &contentType = "application/octet-stream",
+                          const QByteArray &extraHeaders = QByteArray());
+    // Отправка только заголовков ответа (тело передаётся отдельно, например FileStreamer).
+    // contentLength < 0 — тело передаётся chunked-кодированием
+    void sendHttpHeaders(QTcpSocket *socket,
+                         int code,
+                         const QString &status,
+                         qint64 contentLength,
+                         const QString &contentType = "application/octet-stream",
+                         const QByteArray &extraHeaders = QByteArray());
+    // compress — тело сжимается gzip на лету и передаётся chunked-кодированием;
+    // partial — ответ 206 на запрос с Range (Content-Range передаётся в extraHeaders)
+    void streamFile(QTcpSocket *socket, const QString &fullPath, qint64 offset, qint64 length,
+                    const QByteArray &extraHeaders = QByteArray(), QObject *attachment = nullptr,
+                    bool compress = false, bool partial = false);
+    // Тело из m_hotFiles; одновременные запросы того же файла читают его один раз
+    void sendCachedFile(QTcpSocket *socket, const HotFileCache::Key &key, const QString &fullPath,
+                        const QByteArray &extraHeaders);
     void notifyUpdate(const QString &relativePath, bool deleted, int rootIndex);
     QString resolveFullPath(int rootIndex, const QString &relativePath) const;
 };
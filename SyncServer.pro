@@ -1,4 +1,6 @@
-QT += core network
+QT += core network concurrent
+
+LIBS += -lz
 
 CONFIG += c++11 console
 CONFIG -= app_bundle
@@ -8,17 +10,62 @@ TARGET = SyncServer
 
 INCLUDEPATH += $$PWD
 
+# qmake CONFIG+=quiet_log — qCDebug/qCInfo не попадают в сборку
+quiet_log: DEFINES += QT_NO_DEBUG_OUTPUT QT_NO_INFO_OUTPUT
+
 SOURCES += \
     main.cpp \
+    Compression.cpp \
+    DeltaSync.cpp \
+    FileIndex.cpp \
     FileMonitor.cpp \
+    FileStreamer.cpp \
+    HashCache.cpp \
+    HotFileCache.cpp \
+    HttpClientRequest.cpp \
+    HttpConnection.cpp \
+    IndexStore.cpp \
+    Log.cpp \
+    MerkleTree.cpp \
+    PushSubscription.cpp \
+    RequestTrace.cpp \
+    SegmentedDownload.cpp \
+    ServerMetrics.cpp \
+    SyncJournal.cpp \
+    SyncManifest.cpp \
     SyncServer.cpp \
-    SyncService.cpp
+    SyncService.cpp \
+    TransferScheduler.cpp
 
 HEADERS += \
+    Compression.h \
+    DeltaSync.h \
     FileEntry.h \
+    FileIndex.h \
     FileMonitor.h \
+    FileStreamer.h \
+    FileUtils.h \
+    HashCache.h \
+    HotFileCache.h \
+    HttpClientRequest.h \
+    HttpConnection.h \
+    IndexStore.h \
+    Log.h \
+    MerkleTree.h \
+    PushSubscription.h \
+    RequestTrace.h \
+    SegmentedDownload.h \
+    ServerMetrics.h \
+    SyncJournal.h \
+    SyncManifest.h \
     SyncServer.h \
-    SyncService.h
+    SyncService.h \
+    TransferScheduler.h
+
+linux {
+    SOURCES += InotifyWatcher.cpp
+    HEADERS += InotifyWatcher.h
+}
 
 #target.path = /usr/bin
 #INSTALLS += target
@@ -1,14 +1,28 @@
 #include "SyncService.h"
 #include "FileMonitor.h"
+#include "HttpClientRequest.h"
+#include "HttpConnection.h"
+#include "SyncManifest.h"
+#include "SyncJournal.h"
+#include "PushSubscription.h"
+#include "Compression.h"
+#include "DeltaSync.h"
+#include "FileUtils.h"
+#include "HashCache.h"
+#include "Log.h"
+#include "SegmentedDownload.h"
 #include <QTcpSocket>
 #include <QUdpSocket>
 #include <QDebug>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonDocument>
-#include <QDirIterator>
 #include <QDateTime>
 #include <QUrl>
+#include <QTemporaryFile>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSharedPointer>
 
 static QString makeKey(int rootIndex, const QString &relativePath) {
     return QString::number(rootIndex) + ":" + relativePath;
@@ -19,6 +33,8 @@ SyncService::SyncService(const QHostAddress &serverAddress,
                          QObject *parent)
     : QObject(parent), m_serverAddress(serverAddress), m_serverPort(serverPort)
 {
+    // Пул создаётся раньше запросов: при удалении сервиса соединения закрываются первыми
+    m_pool = new HttpConnectionPool(m_serverAddress, m_serverPort, this);
     m_pingTimer.setInterval(30 * 1000); // 30 секунд
     connect(&m_pingTimer, &QTimer::timeout, this, &SyncService::sendPing);
 
@@ -26,26 +42,35 @@ SyncService::SyncService(const QHostAddress &serverAddress,
     m_syncDirectories.append(QDir::homePath() + "/test/client/fold2");
     m_monitor = new FileMonitor(m_syncDirectories, this);
 
+    const QByteArray journalId = QCryptographicHash::hash(m_syncDirectories.join('\n').toUtf8(),
+                                                          QCryptographicHash::Md5).toHex();
+    m_journal.reset(new SyncJournal(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                                    + "/journal-" + QString::fromLatin1(journalId)));
+    m_journal->load();
+
     connect(m_monitor, &FileMonitor::fileChanged, this, [=](const FileEntry &entry){
         QString key = makeKey(entry.rootIndex, entry.path);
-        qDebug() << "Изменён/добавлен:" << key << entry.version;
+        qCDebug(lcClient) << "Изменён/добавлен:" << key << entry.version;
         if (m_ignoreNextChange.contains(key)) {
-            qDebug() << "Ignoring fileChanged for:" << key;
+            qCDebug(lcClient) << "Ignoring fileChanged for:" << key;
             m_ignoreNextChange.remove(key);
             return;
         }
-        sendSyncListToServer({ entry });
+        // Изменение пользователя передаётся раньше массовой сверки
+        sendSyncListToServer({ entry }, TransferScheduler::Interactive);
     });
 
     connect(m_monitor, &FileMonitor::fileRemoved, this, [=](const FileEntry &entry){
         QString key = makeKey(entry.rootIndex, entry.path);
         if (m_ignoreNextChange.contains(key)) {
-            qDebug() << "Ignoring fileRemoved for:" << key;
+            qCDebug(lcClient) << "Ignoring fileRemoved for:" << key;
             m_ignoreNextChange.remove(key);
             return;
         }
 
-        qDebug() << "Удалён:" << key;
+        qCDebug(lcClient) << "Удалён:" << key;
+
+        m_journal->forget(qMakePair(entry.rootIndex, entry.path));
 
         FileEntry deletedEntry = entry;
         deletedEntry.version = 0;
@@ -61,58 +86,230 @@ SyncService::SyncService(const QHostAddress &serverAddress,
     m_monitor->start();
 }
 
+void SyncService::setTransferLimits(const TransferScheduler::Limits &limits)
+{
+    m_transfers.setLimits(limits);
+}
+
 void SyncService::start()
 {
-    qDebug() << "SyncService started";
+    qCDebug(lcClient) << "SyncService started";
+
+    // Подписка открывается до сверки, чтобы не пропустить события между ними.
+    // Соединение исходящее: принимать входящие подключения клиенту не нужно
+    m_push = new PushSubscription(m_serverAddress, m_serverPort, this);
+    connect(m_push, &PushSubscription::notification, this, &SyncService::applyNotification);
+    connect(m_push, &PushSubscription::resyncRequired, this, &SyncService::synchronizeWithServer);
+    m_push->start();
+
     synchronizeWithServer();
     m_pingTimer.start();
     sendPing(); // первый ping сразу
-
-    // Запуск TCP-сервера для приёма /notify
-    if (!m_server.listen(QHostAddress::AnyIPv4, 9090)) {
-        qCritical() << "Failed to start local server on port 9090";
-    } else {
-        qDebug() << "Listening for incoming connections on port 9090";
-        connect(&m_server, &QTcpServer::newConnection,
-                this, &SyncService::handleNewConnection);
-    }
 }
 
 void SyncService::synchronizeWithServer()
 {
-    qDebug() << "Starting initial sync with server...";
+    qCDebug(lcClient) << "Starting initial sync with server...";
 
     QList<FileEntry> localEntries = scanLocalDirectories();
-    sendSyncListToServer(localEntries);
+
+    if (!m_journal->isEmpty()) {
+        // Что изменилось локально, пока клиент не работал, видно по журналу
+        const SyncJournal::Changes changes = m_journal->localChanges(localEntries);
+        qCDebug(lcClient) << "Local changes since last sync: added" << changes.added.size()
+                 << "modified" << changes.modified.size() << "removed" << changes.removed.size();
+
+        // Удалённые без связи файлы удаляются и на сервере, а не скачиваются заново
+        for (const FileEntry &entry : changes.removed) {
+            const SyncJournal::Key key = qMakePair(entry.rootIndex, entry.path);
+            m_pendingDeletes.insert(key);
+            m_journal->forget(key);
+            sendDeleteRequest(entry);
+        }
+    }
+
+    if (!m_merkleSupported) {
+        sendLocalState(localEntries);
+        return;
+    }
+
+    // Сверка по дереву хэшей: сначала только хэши корней, дальше — лишь отличающиеся поддеревья
+    m_localTree.clear();
+    for (const FileEntry &entry : localEntries)
+        m_localTree.insert(entry);
+    m_reconcileDiffs.clear();
+
+    QVector<MerkleTree::Query> queries;
+    for (int rootIndex = 0; rootIndex < m_syncDirectories.size(); ++rootIndex) {
+        MerkleTree::Query query;
+        query.rootIndex = rootIndex;
+        queries.append(query);
+    }
+    reconcileWithServer(queries, localEntries);
 }
 
-QList<FileEntry> SyncService::scanLocalDirectories()
+static int retryAfterMs(const HttpClientRequest *request)
 {
-    QList<FileEntry> entries;
+    // Retry-After в секундах; без заголовка — 5 с
+    bool ok = false;
+    const int seconds = request->responseHeader("retry-after").toInt(&ok);
+    return (ok ? qBound(1, seconds, 300) : 5) * 1000;
+}
 
-    for (int rootIndex = 0; rootIndex < m_syncDirectories.size(); ++rootIndex) {
-        const QString &dirPath = m_syncDirectories[rootIndex];
-        QDir root(dirPath);
-        QDirIterator it(dirPath, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-        const int basePathLength = root.absolutePath().length() + 1;
+void SyncService::reconcileWithServer(const QVector<MerkleTree::Query> &queries, const QList<FileEntry> &localEntries)
+{
+    HttpClientRequest *request = createRequest("POST", "/merkle");
+    request->setPipelined(true);
+    request->setHeader("Content-Type", SyncManifest::ContentType);
+    request->setBody(SyncManifest::encodeMerkleQueries(queries));
 
-        while (it.hasNext()) {
-            it.next();
-            const QFileInfo file = it.fileInfo();
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
 
-            FileEntry entry;
-            entry.path = file.filePath().mid(basePathLength);
-            entry.rootIndex = rootIndex;
-            entry.version = (file.lastModified().toMSecsSinceEpoch() / 1000);
-            entry.type = "file";
-            entries.append(entry);
+        if (!ok) {
+            qCWarning(lcClient) << "merkle request failed:" << request->errorString();
+            return;
+        }
+
+        if (request->statusCode() == 503) {
+            // Сервер ещё сверяет индекс с диском — повторим сверку позже
+            QTimer::singleShot(retryAfterMs(request), this, [=]() { reconcileWithServer(queries, localEntries); });
+            return;
+        }
+
+        if (request->statusCode() == 404) {
+            // Сервер без поддержки /merkle — полный список
+            qCDebug(lcClient) << "Server does not support merkle reconciliation";
+            m_merkleSupported = false;
+            sendLocalState(localEntries);
+            return;
+        }
+
+        QVector<MerkleTree::Node> nodes;
+        if (request->statusCode() != 200
+                || !SyncManifest::decodeMerkleNodes(request->responseBody(), &nodes)
+                || nodes.size() != queries.size()) {
+            qCWarning(lcClient) << "Invalid merkle response:" << request->statusCode();
+            return;
+        }
+
+        QVector<MerkleTree::Query> next;
+        QVector<FileDiff> diffs;
+        for (int i = 0; i < nodes.size(); ++i) {
+            const MerkleTree::Node &remote = nodes[i];
+            const MerkleTree::Node local = m_localTree.node(remote.rootIndex, remote.path, true);
+            if (local.hash == remote.hash)
+                continue;
+
+            if (!queries[i].withChildren) {
+                MerkleTree::Query query = queries[i];
+                query.withChildren = true;
+                next.append(query);
+                continue;
+            }
+
+            compareMerkleNodes(local, remote, &next, &diffs);
+        }
+
+        qCDebug(lcClient) << "merkle round:" << queries.size() << "nodes," << diffs.size() << "differences";
+
+        for (const FileDiff &diff : diffs)
+            m_reconcileDiffs.insert(qMakePair(diff.rootIndex, diff.path));
+
+        if (!diffs.isEmpty())
+            onResponse(diffs);
+        if (!next.isEmpty()) {
+            reconcileWithServer(next, localEntries);
+            return;
+        }
+
+        // Сверка завершена: всё, что не попало в отличия, совпадает с сервером
+        recordSynced(localEntries, m_reconcileDiffs);
+        m_reconcileDiffs.clear();
+    });
+
+    request->start();
+}
+
+void SyncService::compareMerkleNodes(const MerkleTree::Node &local, const MerkleTree::Node &remote,
+                                     QVector<MerkleTree::Query> *next, QVector<FileDiff> *diffs)
+{
+    auto addDiff = [&](const QString &path, const char *type, quint64 version) {
+        FileDiff diff;
+        diff.path = path;
+        diff.rootIndex = remote.rootIndex;
+        diff.type = type;
+        diff.version = version;
+        diffs->append(diff);
+    };
+
+    // Отличающиеся подкаталоги сервера — спускаемся глубже
+    for (auto it = remote.subdirs.constBegin(); it != remote.subdirs.constEnd(); ++it) {
+        if (local.subdirs.value(it.key()) != it.value()) {
+            MerkleTree::Query query;
+            query.rootIndex = remote.rootIndex;
+            query.path = MerkleTree::childPath(remote.path, it.key());
+            query.withChildren = true;
+            next->append(query);
         }
     }
 
+    // Подкаталоги, которых нет на сервере: как и при полном списке, их файлы удаляются
+    for (auto it = local.subdirs.constBegin(); it != local.subdirs.constEnd(); ++it) {
+        if (remote.subdirs.contains(it.key()))
+            continue;
+        const QList<FileEntry> files = m_localTree.files(local.rootIndex, MerkleTree::childPath(local.path, it.key()));
+        for (const FileEntry &entry : files)
+            addDiff(entry.path, "delete", entry.version);
+    }
+
+    // Файлы сравниваются по тем же правилам, что и в handleSyncList на сервере
+    for (auto it = remote.files.constBegin(); it != remote.files.constEnd(); ++it) {
+        const QString path = MerkleTree::childPath(remote.path, it.key());
+        auto localFile = local.files.constFind(it.key());
+        if (localFile == local.files.constEnd())
+            addDiff(path, "download", it.value().version);
+        else if (!localFile.value().sameContent(it.value()))
+            addDiff(path, localFile.value().version <= it.value().version ? "download" : "upload",
+                    it.value().version);
+    }
+
+    for (auto it = local.files.constBegin(); it != local.files.constEnd(); ++it) {
+        if (!remote.files.contains(it.key()))
+            addDiff(MerkleTree::childPath(local.path, it.key()), "delete", it.value().version);
+    }
+}
+
+QList<FileEntry> SyncService::scanLocalDirectories()
+{
+    QStringList fullPaths;
+    QList<FileEntry> entries = listFiles(m_syncDirectories, &fullPaths);
+
+    // Хэши содержимого: из кэша монитора, недостающие считаются параллельно
+    const QVector<QByteArray> hashes = m_monitor->hashCache()->hashFiles(fullPaths);
+    for (int i = 0; i < entries.size(); ++i)
+        entries[i].hash = hashes[i];
+
     return entries;
 }
 
-void SyncService::discoverAndStart(QObject *parent)
+void SyncService::sendLocalState(const QList<FileEntry> &localEntries)
+{
+    // Без /merkle только полный список показывает и то, что изменилось на сервере, пока
+    // клиент был отключён; локальные изменения из журнала сервер увидит в нём же как "upload".
+    // Удалённые без связи файлы уже отправлены через /delete и в m_pendingDeletes
+    sendSyncListToServer(localEntries);
+}
+
+void SyncService::recordSynced(const QList<FileEntry> &localEntries, const QSet<SyncJournal::Key> &differing)
+{
+    for (const FileEntry &entry : localEntries) {
+        if (!differing.contains(qMakePair(entry.rootIndex, entry.path)))
+            m_journal->record(entry);
+    }
+}
+
+void SyncService::discoverAndStart(QObject *parent, const TransferScheduler::Limits &limits)
 {
     auto socket = new QUdpSocket(parent);
     socket->bind(QHostAddress::AnyIPv4, 0, QUdpSocket::ShareAddress);
@@ -123,10 +320,10 @@ void SyncService::discoverAndStart(QObject *parent)
     QObject::connect(timer, &QTimer::timeout, [socket]() {
         QByteArray message = "DISCOVER_REQUEST";
         socket->writeDatagram(message, QHostAddress::Broadcast, 45454);
-        qDebug() << "Broadcasted DISCOVER_REQUEST";
+        qCDebug(lcClient) << "Broadcasted DISCOVER_REQUEST";
     });
 
-    QObject::connect(socket, &QUdpSocket::readyRead, [socket, parent, timer]() {
+    QObject::connect(socket, &QUdpSocket::readyRead, [socket, parent, timer, limits]() {
         while (socket->hasPendingDatagrams()) {
             QByteArray buffer;
             buffer.resize(socket->pendingDatagramSize());
@@ -136,34 +333,33 @@ void SyncService::discoverAndStart(QObject *parent)
             socket->readDatagram(buffer.data(), buffer.size(), &sender, &senderPort);
 
             if (buffer == "DISCOVER_RESPONSE") {
-                qDebug() << "Discovered SyncServer at" << sender.toString();
+                qCDebug(lcClient) << "Discovered SyncServer at" << sender.toString();
 
                 timer->stop();
                 timer->deleteLater();
 
-                auto tcpSocket = new QTcpSocket(parent);
-                QObject::connect(tcpSocket, &QTcpSocket::connected, [tcpSocket]() {
-                    QByteArray req = "GET /register HTTP/1.1\r\nHost: server\r\nConnection: close\r\n\r\n";
-                    tcpSocket->write(req);
-                });
-
-                QObject::connect(tcpSocket, &QTcpSocket::readyRead, [tcpSocket, sender, parent]() {
-                    QByteArray response = tcpSocket->readAll();
-                    qDebug() << "Response:\n" << response;
+                // Сервиса с пулом соединений ещё нет — отдельный запрос на своём соединении
+                auto request = new HttpClientRequest(sender, 8080, parent);
+                request->setPath("/register");
+                QObject::connect(request, &HttpClientRequest::finished, [request, sender, parent, limits](bool ok) {
+                    request->deleteLater();
+                    if (!ok) {
+                        qCWarning(lcClient) << "register request failed:" << request->errorString();
+                        return;
+                    }
+                    qCDebug(lcClient) << "Response:\n" << logPayload(request->responseBody());
 
                     auto syncService = new SyncService(sender, 8080, parent);
+                    syncService->setTransferLimits(limits);
                     syncService->start();
-                    QObject::connect(syncService, &SyncService::connectionLost, parent, [syncService, parent]() {
+                    QObject::connect(syncService, &SyncService::connectionLost, parent, [syncService, parent, limits]() {
                         syncService->deleteLater();
-                        qWarning() << "Connection lost. Rediscovering...";
-                        SyncService::discoverAndStart(parent);
+                        qCWarning(lcClient) << "Connection lost. Rediscovering...";
+                        SyncService::discoverAndStart(parent, limits);
                     });
-
-                    QObject::connect(tcpSocket, &QTcpSocket::disconnected, tcpSocket, &QObject::deleteLater);
-                    tcpSocket->disconnectFromHost();
                 });
 
-                tcpSocket->connectToHost(sender, 8080);
+                request->start();
 
                 QObject::disconnect(socket, nullptr, nullptr, nullptr);
                 socket->deleteLater();
@@ -175,107 +371,118 @@ void SyncService::discoverAndStart(QObject *parent)
     timer->start();
     QByteArray message = "DISCOVER_REQUEST";
     socket->writeDatagram(message, QHostAddress::Broadcast, 45454);
-    qDebug() << "Broadcasted initial DISCOVER_REQUEST";
+    qCDebug(lcClient) << "Broadcasted initial DISCOVER_REQUEST";
 }
 
 void SyncService::sendPing()
 {
-    QTcpSocket *socket = new QTcpSocket(this);
-    connect(socket, &QTcpSocket::connected, this, [=]() {
-        socket->write("GET /ping HTTP/1.1\r\nHost: sync\r\nConnection: close\r\n\r\n");
-    });
-    connect(socket, &QTcpSocket::readyRead, this, [=]() {
-        QByteArray response = socket->readAll(); // можно игнорировать
-        qDebug() << "Response:\n" << response;
+    HttpClientRequest *request = createRequest("GET", "/ping");
+    request->setPipelined(true);
+    connect(request, &HttpClientRequest::finished, this, [this, request](bool ok) {
+        request->deleteLater();
+        if (ok) {
+            qCDebug(lcClient) << "Response:\n" << logPayload(request->responseBody()); // можно игнорировать
+            return;
+        }
+
+        const QAbstractSocket::SocketError socketError = request->socketError();
+        if (socketError == QAbstractSocket::ConnectionRefusedError ||
+            socketError == QAbstractSocket::HostNotFoundError) {
+            qCWarning(lcClient) << "Ping failed with error:" << request->errorString();
+            emit connectionLost();
+        }
     });
-    connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
-    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(onPingSocketError(QAbstractSocket::SocketError)));
-    socket->connectToHost(m_serverAddress, m_serverPort);
+    request->start();
 }
 
-void SyncService::onPingSocketError(QAbstractSocket::SocketError socketError)
+void SyncService::sendSyncListToServer(const QList<FileEntry> &files, TransferScheduler::Priority priority)
 {
-    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
-    if (!socket)
-        return;
+    HttpClientRequest *request = createRequest("POST", "/sync-list");
+    request->setPipelined(true);
+    const QByteArray manifestType(SyncManifest::ContentType);
 
-    socket->deleteLater();
-
-    if (socketError == QAbstractSocket::ConnectionRefusedError ||
-        socketError == QAbstractSocket::HostNotFoundError) {
-        qWarning() << "Ping failed with error:" << socket->errorString();
-        emit connectionLost();
+    if (m_binaryManifest) {
+        request->setHeader("Content-Type", manifestType);
+        request->setBody(SyncManifest::encodeEntries(files));
+    } else {
+        request->setHeader("Content-Type", "application/json");
+        request->setBody(SyncManifest::encodeEntriesJson(files));
     }
-}
+    request->setHeader("Accept", manifestType + ", application/json");
+    request->setCompressBody(m_serverCompression);
 
-void SyncService::sendSyncListToServer(const QList<FileEntry> &files)
-{
-    QJsonArray arr;
-    for (const FileEntry &entry : files) {
-        QJsonObject obj;
-        obj["path"] = entry.path;
-        obj["version"] = QString::number(entry.version);
-        obj["type"] = entry.type;
-        obj["rootIndex"] = QString::number(entry.rootIndex);
-        arr.append(obj);
-    }
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
 
-    QJsonDocument doc(arr);
-    QByteArray body = doc.toJson();
+        if (!ok) {
+            qCWarning(lcClient) << "sync-list failed:" << request->errorString();
+            return;
+        }
 
-    QByteArray request;
-    request += "POST /sync-list HTTP/1.1\r\n";
-    request += "Host: dummy\r\n";
-    request += "Content-Type: application/json\r\n";
-    request += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
-    request += "Connection: close\r\n\r\n";
-    request += body;
+        if (request->statusCode() == 400 && m_binaryManifest) {
+            // Старый сервер понимает только JSON
+            qCDebug(lcClient) << "Server does not accept binary manifest, falling back to JSON";
+            m_binaryManifest = false;
+            sendSyncListToServer(files, priority);
+            return;
+        }
 
-    QTcpSocket *socket = new QTcpSocket(this);
-    connect(socket, &QTcpSocket::connected, [=]() {
-        socket->write(request);
-    });
+        if (request->statusCode() == 503) {
+            // Сервер ещё сверяет индекс с диском: отличия по нему были бы неверны
+            QTimer::singleShot(retryAfterMs(request), this, [=]() { sendSyncListToServer(files, priority); });
+            return;
+        }
 
-    connect(socket, &QTcpSocket::readyRead, [=]() {
-        QByteArray response = socket->readAll();
-        qDebug() << "[SyncService] Response to sync-list:\n" << response;
-
-        if (response.contains("200 OK")) {
-            QVector<FileDiff> diffs = parseDiffs(response);
-            if (!diffs.isEmpty()) {
-                onResponse(diffs);
-            } else {
-                if (response.contains("Up to date")) {
-                    return;
-                }
+        const QByteArray &body = request->responseBody();
+        if (request->statusCode() != 200) {
+            qCDebug(lcClient) << "Response to sync-list:" << request->statusCode() << logPayload(body);
+            return;
+        }
 
-                // fallback: сервер ничего не вернул, загружаем сами
-                for (const FileEntry &entry : files) {
-                    if (entry.type != "deleted")
-                        uploadFile(entry);
-                }
+        QVector<FileDiff> diffs;
+        bool upToDate = false;
+        if (request->responseHeader("content-type").startsWith(manifestType)) {
+            if (!SyncManifest::decodeDiffs(body, &diffs)) {
+                qCWarning(lcClient) << "Invalid diff manifest from server";
+                return;
             }
+            upToDate = diffs.isEmpty();
+        } else {
+            diffs = parseDiffs(body);
+            upToDate = body.contains("Up to date");
+        }
+
+        qCDebug(lcClient) << "sync-list:" << diffs.size() << "differences";
+
+        // Ответ на полный список: остальные файлы совпадают с сервером
+        bool fullList = !files.isEmpty();
+        for (const FileEntry &entry : files)
+            fullList = fullList && entry.type == "file";
+        if (fullList) {
+            QSet<SyncJournal::Key> differing;
+            for (const FileDiff &diff : diffs)
+                differing.insert(qMakePair(diff.rootIndex, diff.path));
+            recordSynced(files, differing);
         }
-    });
 
-    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
-    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(handleSocketError(QAbstractSocket::SocketError)));
+        if (!diffs.isEmpty()) {
+            onResponse(diffs, priority);
+        } else if (!upToDate) {
+            // fallback: сервер ничего не вернул, загружаем сами
+            for (const FileEntry &entry : files) {
+                if (entry.type != "deleted")
+                    uploadFile(entry, priority);
+            }
+        }
+    });
 
-    socket->connectToHost(m_serverAddress, m_serverPort);
+    request->start();
 }
 
-QVector<FileDiff> SyncService::parseDiffs(const QByteArray& response)
+QVector<FileDiff> SyncService::parseDiffs(const QByteArray &body)
 {
     QVector<FileDiff> diffs;
 
-    // Отделяем тело от заголовков
-    int headerEndIndex = response.indexOf("\r\n\r\n");
-    if (headerEndIndex == -1)
-        return diffs;
-
-    QByteArray body = response.mid(headerEndIndex + 4);  // после \r\n\r\n
     QJsonParseError parseError;
     QJsonDocument doc = QJsonDocument::fromJson(body, &parseError);
 
@@ -307,20 +514,39 @@ QString SyncService::resolveFullPath(int rootIndex, const QString &relativePath)
     return fullPath;
 }
 
-void SyncService::onResponse(const QVector<FileDiff> &diffs)
+void SyncService::onResponse(const QVector<FileDiff> &diffs, TransferScheduler::Priority priority)
 {
     for (const FileDiff &diff : diffs) {
+        const SyncJournal::Key key = qMakePair(diff.rootIndex, diff.path);
+
+        if (diff.type == "download" && m_pendingDeletes.contains(key)) {
+            // Удалён локально без связи с сервером, удаление уже отправлено
+            continue;
+        }
+
+        if (diff.type == "delete" && !m_journal->isEmpty() && !m_journal->contains(key)) {
+            // Файла нет на сервере, но и синхронизирован он не был — создан локально
+            FileEntry entry;
+            entry.path = diff.path;
+            entry.version = diff.version;
+            entry.type = "file";
+            entry.rootIndex = diff.rootIndex;
+            uploadFile(entry, priority);
+            continue;
+        }
+
         if (diff.type == "download") {
-            getFile(diff.rootIndex, diff.path);
+            getFile(diff.rootIndex, diff.path, priority);
         } else if (diff.type == "upload") {
             FileEntry entry;
             entry.path = diff.path;
             entry.version = diff.version;
             entry.type = "file";
             entry.rootIndex = diff.rootIndex;
-            uploadFile(entry);
+            uploadFile(entry, priority);
         } else if (diff.type == "delete") {
-            qDebug() << "Deleting file per server instruction:" << diff.path;
+            qCDebug(lcClient) << "Deleting file per server instruction:" << diff.path;
+            m_journal->forget(key);
             QString fullPath = resolveFullPath(diff.rootIndex, diff.path);
             if (!fullPath.isEmpty()) {
                 QFile::remove(fullPath);
@@ -340,7 +566,7 @@ void SyncService::onResponse(const QVector<FileDiff> &diffs)
                     m_ignoreNextChange.insert(key);
             }
         } else {
-            qWarning() << "Unknown diff type:" << diff.type;
+            qCWarning(lcClient) << "Unknown diff type:" << diff.type;
         }
     }
 }
@@ -349,137 +575,488 @@ void SyncService::handleSocketError(QAbstractSocket::SocketError err)
 {
     QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
     if (socket) {
-        qWarning() << "SyncService: socket error:" << err << socket->errorString();
+        qCWarning(lcClient) << "Socket error:" << err << socket->errorString();
     }
 }
 
-void SyncService::uploadFile(const FileEntry &entry)
+QString SyncService::ignoreKeyFor(const QString &relativePath) const
+{
+    for (int i = 0; i < m_syncDirectories.size(); ++i) {
+        QDir dir(m_syncDirectories[i]);
+        QString rootDirName = dir.dirName();
+        if (relativePath.startsWith(rootDirName + "/"))
+            return makeKey(i, relativePath);
+    }
+    return QString();
+}
+
+HttpClientRequest *SyncService::createRequest(const QByteArray &method, const QByteArray &path)
+{
+    HttpClientRequest *request = new HttpClientRequest(m_pool, this);
+    request->setMethod(method);
+    request->setPath(path);
+    // Ответы со сжатием HttpClientRequest раскодирует сам
+    request->setHeader("Accept-Encoding", Compression::Encoding);
+    // Версии передаются в миллисекундах; без этого заголовка сервер считает их секундами
+    request->setHeader("X-Version-Unit", "ms");
+
+    // Поддержку сжатых запросов сервер объявляет в заголовках любого ответа
+    connect(request, &HttpClientRequest::finished, this, [this, request](bool ok) {
+        if (ok)
+            m_serverCompression = Compression::accepts(request->responseHeader("accept-encoding"));
+    });
+    return request;
+}
+
+static QByteArray fileQuery(int rootIndex, const QString &relativePath)
+{
+    return "?path=" + QUrl::toPercentEncoding(relativePath) + "&rootIndex=" + QByteArray::number(rootIndex);
+}
+
+// Недокачанные копии файла (".name.<tag>-<version>.part"), самая свежая первой
+static QStringList downloadParts(const QString &fullPath, const QString &tag = "download")
+{
+    const QFileInfo info(fullPath);
+    QDir dir(info.absolutePath());
+    QStringList parts;
+    const QStringList names = dir.entryList(QStringList() << "." + info.fileName() + "." + tag + "-*.part",
+                                            QDir::Files | QDir::Hidden, QDir::Time);
+    for (const QString &name : names)
+        parts.append(dir.filePath(name));
+    return parts;
+}
+
+static void setFileHeaders(HttpClientRequest *request, const FileEntry &entry)
+{
+    request->setHeader("X-File-Path", entry.path.toUtf8());
+    request->setHeader("X-File-Version", QByteArray::number(entry.version));
+    request->setHeader("X-File-Type", entry.type.toUtf8());
+    request->setHeader("X-File-Root-Index", QByteArray::number(entry.rootIndex));
+    if (!entry.hash.isEmpty())
+        request->setHeader("X-File-Hash", entry.hash.toHex());
+    request->setHeader("Content-Type", "application/octet-stream");
+}
+
+// Файлы меньше этого размера при обрыве загружаются заново, без запроса смещения
+static const qint64 ResumableUploadMinSize = 1024 * 1024;
+
+// Сбой сети и ошибки сервера повторяются, отказ по существу запроса — нет
+static TransferScheduler::Result transferResult(bool ok, int statusCode)
+{
+    if (!ok || statusCode >= 500)
+        return TransferScheduler::Retry;
+    return statusCode == 200 ? TransferScheduler::Succeeded : TransferScheduler::Failed;
+}
+
+void SyncService::uploadFile(const FileEntry &entry, TransferScheduler::Priority priority)
+{
+    const QString fullPath = resolveFullPath(entry.rootIndex, entry.path);
+    const qint64 size = QFileInfo(fullPath).size();
+    m_transfers.enqueue(TransferScheduler::Upload, makeKey(entry.rootIndex, entry.path), size, priority,
+                        [this, entry](const TransferScheduler::Done &done) { startUpload(entry, done); });
+}
+
+void SyncService::getFile(int rootIndex, const QString &relativePath, TransferScheduler::Priority priority)
+{
+    // Размер серверной копии заранее не известен — оценка по локальной копии (0 для нового файла),
+    // уточняется по Content-Length ответа в getFileFull
+    const QString fullPath = resolveFullPath(rootIndex, relativePath);
+    const qint64 size = QFileInfo(fullPath).size();
+    m_transfers.enqueue(TransferScheduler::Download, makeKey(rootIndex, relativePath), size, priority,
+                        [this, rootIndex, relativePath](const TransferScheduler::Done &done) {
+                            startDownload(rootIndex, relativePath, done);
+                        });
+}
+
+void SyncService::startUpload(const FileEntry &entry, const TransferScheduler::Done &done)
 {
     QString fullPath = resolveFullPath(entry.rootIndex, entry.path);
     if (fullPath.isEmpty()) {
-        qWarning() << "uploadFile: cannot resolve full path for" << entry.path;
+        qCWarning(lcClient) << "uploadFile: cannot resolve full path for" << entry.path;
+        done(TransferScheduler::Failed);
         return;
     }
 
-    QFile file(fullPath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Failed to open file for upload:" << entry.path;
+    QFileInfo info(fullPath);
+    if (!info.isFile()) {
+        qCWarning(lcClient) << "Failed to open file for upload:" << entry.path;
+        done(TransferScheduler::Failed);
         return;
     }
 
-    QByteArray fileData = file.readAll();
+    // Сервер сверяет принятое содержимое с этим хэшем
+    FileEntry hashed = entry;
+    hashed.hash = m_monitor->hashCache()->hashFile(fullPath);
 
-    QTcpSocket *socket = new QTcpSocket(this);
+    // Небольшие файлы дешевле отправить целиком, чем гонять сигнатуры
+    if (info.size() >= DeltaSync::MinDeltaFileSize)
+        uploadFileDelta(hashed, fullPath, done);
+    else
+        uploadFileFull(hashed, fullPath, done);
+}
 
-    connect(socket, &QTcpSocket::connected, [=]() {
-        QByteArray request;
-        request += "POST /upload HTTP/1.1\r\n";
-        request += "Host: syncserver\r\n";
-        request += "Content-Length: " + QByteArray::number(fileData.size()) + "\r\n";
-        request += "X-File-Path: " + entry.path.toUtf8() + "\r\n";
-        request += "X-File-Version: " + QByteArray::number(entry.version) + "\r\n";
-        request += "X-File-Type: " + entry.type.toUtf8() + "\r\n";
-        request += "X-File-Root-Index: " + QByteArray::number(entry.rootIndex) + "\r\n";
-        request += "Content-Type: application/octet-stream\r\n";
-        request += "Connection: close\r\n\r\n";
-        request += fileData;
+void SyncService::uploadFileFull(const FileEntry &entry, const QString &fullPath, const TransferScheduler::Done &done)
+{
+    const qint64 size = QFileInfo(fullPath).size();
+    if (size < ResumableUploadMinSize) {
+        uploadFileFrom(entry, fullPath, 0, done);
+        return;
+    }
 
-        socket->write(request);
-    });
+    // Сервер мог сохранить часть этой версии от прерванной попытки
+    HttpClientRequest *request = createRequest("GET", "/upload-offset" + fileQuery(entry.rootIndex, entry.path)
+                                                      + "&version=" + QByteArray::number(entry.version));
+    request->setPipelined(true);
 
-    connect(socket, &QTcpSocket::readyRead, [=]() {
-        QByteArray response = socket->readAll();
-        qDebug() << "Upload response:" << response;
-    });
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
 
-    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        qint64 offset = 0;
+        if (ok && request->statusCode() == 200)
+            offset = request->responseHeader("x-upload-offset").toLongLong();
+        if (offset < 0 || offset >= size)
+            offset = 0;
+        uploadFileFrom(entry, fullPath, offset, done);
+    });
 
-    socket->connectToHost(m_serverAddress, m_serverPort);
+    request->start();
 }
 
-void SyncService::getFile(int rootIndex, const QString &relativePath)
+void SyncService::uploadFileFrom(const FileEntry &entry, const QString &fullPath, qint64 offset,
+                                 const TransferScheduler::Done &done)
 {
-    QTcpSocket *socket = new QTcpSocket(this);
-    QByteArray *buffer = new QByteArray;
-
-    connect(socket, &QTcpSocket::connected, [=]() {
-        QByteArray request;
-        request += "GET /download?path=" + QUrl::toPercentEncoding(relativePath)
-                   + "&rootIndex=" + QByteArray::number(rootIndex)
-                   + " HTTP/1.1\r\n";
-        request += "Host: syncserver\r\n";
-        request += "Connection: close\r\n\r\n";
-        socket->write(request);
+    HttpClientRequest *request = createRequest("POST", "/upload");
+    setFileHeaders(request, entry);
+    if (offset > 0) {
+        qCDebug(lcClient) << "Resuming upload of" << entry.path << "from" << offset;
+        request->setHeader("X-Upload-Offset", QByteArray::number(offset));
+    }
+    // Файл читается с диска порциями по мере отправки; сжимается, если это имеет смысл
+    request->setBodyFile(fullPath, offset, QFileInfo(fullPath).size() - offset);
+    request->setCompressBody(m_serverCompression && Compression::worthCompressing(fullPath));
+
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        if (ok && request->statusCode() == 200)
+            m_journal->record(entry);
+
+        if (ok)
+            qCDebug(lcClient) << "Upload response:" << request->statusCode() << logPayload(request->responseBody());
+        else
+            qCWarning(lcClient) << "Upload failed:" << entry.path << request->errorString();
+        request->deleteLater();
+        // 416 — на сервере другая часть файла; следующая попытка заново спросит смещение
+        const int status = request->statusCode();
+        done(ok && status == 416 ? TransferScheduler::Retry : transferResult(ok, status));
     });
 
-    connect(socket, &QTcpSocket::readyRead, [=]() {
-        buffer->append(socket->readAll());
+    request->start();
+}
+
+void SyncService::uploadFileDelta(const FileEntry &entry, const QString &fullPath, const TransferScheduler::Done &done)
+{
+    // 1. Сигнатура серверной копии
+    HttpClientRequest *request = createRequest("GET", "/signature" + fileQuery(entry.rootIndex, entry.path));
+    request->setPipelined(true);
+
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
+
+        DeltaSync::Signature signature;
+        if (!ok || request->statusCode() != 200
+                || !DeltaSync::Signature::parse(request->responseBody(), &signature)) {
+            // На сервере файла нет (или сигнатура недоступна) — обычная загрузка
+            uploadFileFull(entry, fullPath, done);
+            return;
+        }
 
-        int headerEndIndex = buffer->indexOf("\r\n\r\n");
-        if (headerEndIndex == -1)
+        // 2. Дельта локального файла относительно серверной копии
+        QTemporaryFile *deltaFile = new QTemporaryFile(this);
+        if (!deltaFile->open() || !DeltaSync::writeDelta(fullPath, signature, deltaFile) || !deltaFile->flush()) {
+            delete deltaFile;
+            uploadFileFull(entry, fullPath, done);
             return;
+        }
 
-        QByteArray body = buffer->mid(headerEndIndex + 4);
+        const qint64 deltaSize = deltaFile->size();
+        deltaFile->close();
 
-        // Сохраняем файл
-        QString fullPath = resolveFullPath(rootIndex, relativePath);
-        if (fullPath.isEmpty()) {
-            qWarning() << "getFile: cannot resolve full path for" << relativePath;
-            delete buffer;
-            socket->disconnectFromHost();
+        if (deltaSize >= QFileInfo(fullPath).size()) {
+            // Изменилось почти всё — дельта не даёт выигрыша
+            delete deltaFile;
+            uploadFileFull(entry, fullPath, done);
             return;
         }
 
-        QDir().mkpath(QFileInfo(fullPath).absolutePath());
-        QFile file(fullPath);
-        if (file.open(QIODevice::WriteOnly)) {
-            file.write(body);
-            file.close();
-            qDebug() << "Downloaded file:" << relativePath;
-        } else {
-            qWarning() << "Failed to save downloaded file:" << fullPath;
+        qCDebug(lcClient) << "Uploading delta for" << entry.path << ":" << deltaSize << "bytes";
+
+        // 3. Отправка дельты
+        HttpClientRequest *upload = createRequest("POST", "/delta-upload");
+        setFileHeaders(upload, entry);
+        upload->setHeader("X-Delta-Basis-Version", request->responseHeader("x-file-version"));
+        upload->setBodyFile(deltaFile->fileName(), 0, deltaSize);
+
+        connect(upload, &HttpClientRequest::finished, this, [=](bool uploaded) {
+            upload->deleteLater();
+            deltaFile->deleteLater();
+
+            if (uploaded && upload->statusCode() == 422) {
+                // Серверная копия изменилась, дельта не применилась
+                uploadFileFull(entry, fullPath, done);
+                return;
+            }
+
+            if (uploaded && upload->statusCode() == 200)
+                m_journal->record(entry);
+
+            if (uploaded)
+                qCDebug(lcClient) << "Delta upload response:" << upload->statusCode() << logPayload(upload->responseBody());
+            else
+                qCWarning(lcClient) << "Delta upload failed:" << entry.path << upload->errorString();
+            done(transferResult(uploaded, upload->statusCode()));
+        });
+
+        upload->start();
+    });
+
+    request->start();
+}
+
+void SyncService::startDownload(int rootIndex, const QString &relativePath, const TransferScheduler::Done &done)
+{
+    QString fullPath = resolveFullPath(rootIndex, relativePath);
+    if (fullPath.isEmpty()) {
+        qCWarning(lcClient) << "getFile: cannot resolve full path for" << relativePath;
+        done(TransferScheduler::Failed);
+        return;
+    }
+
+    QFileInfo info(fullPath);
+    if (info.isFile() && info.size() >= DeltaSync::MinDeltaFileSize)
+        getFileDelta(rootIndex, relativePath, fullPath, done);
+    else
+        getFileFull(rootIndex, relativePath, fullPath, done);
+}
+
+void SyncService::getFileFull(int rootIndex, const QString &relativePath, const QString &fullPath,
+                              const TransferScheduler::Done &done)
+{
+    QDir().mkpath(QFileInfo(fullPath).absolutePath());
+
+    // Тело пишется во временный файл рядом с целевым и подменяет его только целиком.
+    // Имя временного файла содержит версию серверной копии: после обрыва докачивается
+    // только та же версия (If-Range), иначе сервер отдаёт файл целиком
+    QString resumePath;
+    QByteArray resumeVersion;
+    const QStringList parts = downloadParts(fullPath);
+    if (!parts.isEmpty()) {
+        resumePath = parts.first();
+        const QString name = QFileInfo(resumePath).fileName();
+        resumeVersion = name.section(".download-", -1).section('.', 0, 0).toLatin1();
+    }
+    const qint64 resumeOffset = resumePath.isEmpty() ? 0 : QFileInfo(resumePath).size();
+
+    HttpClientRequest *request = createRequest("GET", "/download" + fileQuery(rootIndex, relativePath));
+    if (resumeOffset > 0) {
+        request->setHeader("Range", "bytes=" + QByteArray::number(resumeOffset) + "-");
+        request->setHeader("If-Range", "\"" + resumeVersion + "\"");
+    }
+
+    // Проверка собранного файла по хэшу серверной копии и подмена целевого
+    auto complete = [=](const QString &partPath, const QByteArray &expectedHash) {
+        if (!expectedHash.isEmpty() && HashCache::computeHash(partPath) != expectedHash) {
+            qCWarning(lcClient) << "Downloaded file does not match server hash:" << relativePath;
+            QFile::remove(partPath);
+            done(TransferScheduler::Retry);
+            return;
         }
 
-        // Помечаем для игнорирования, чтобы не зациклить синхронизацию
-        QString key;
-        for (int i = 0; i < m_syncDirectories.size(); ++i) {
-            QDir dir(m_syncDirectories[i]);
-            QString rootDirName = dir.dirName();
-            if (relativePath.startsWith(rootDirName + "/")) {
-                key = makeKey(i, relativePath);
-                break;
+        const bool saved = finishDownload(rootIndex, relativePath, partPath, fullPath);
+        done(saved ? TransferScheduler::Succeeded : TransferScheduler::Failed);
+    };
+
+    QFile *partFile = new QFile(request);
+    // Крупный файл передан SegmentedDownload — ответ обрабатывает он
+    QSharedPointer<bool> segmented(new bool(false));
+    connect(request, &HttpClientRequest::headersReceived, this, [=]() {
+        // Лимит передаваемых байт учитывает настоящий размер, а не оценку по локальной копии.
+        // Сжатый поток идёт без Content-Length — тогда остаётся оценка
+        const QByteArray contentLength = request->responseHeader("content-length");
+        if ((request->statusCode() == 200 || request->statusCode() == 206) && !contentLength.isEmpty())
+            m_transfers.updateSize(TransferScheduler::Download, makeKey(rootIndex, relativePath),
+                                   contentLength.toLongLong());
+
+        bool opened = false;
+        if (request->statusCode() == 206) {
+            // Сервер продолжает ровно с того места, где оборвалась прошлая попытка
+            const QByteArray expected = "bytes " + QByteArray::number(resumeOffset) + "-";
+            if (resumeOffset > 0 && request->responseHeader("content-range").startsWith(expected)) {
+                partFile->setFileName(resumePath);
+                opened = partFile->open(QIODevice::WriteOnly | QIODevice::Append);
+            }
+        } else if (request->statusCode() == 200) {
+            for (const QString &stale : downloadParts(fullPath) + downloadParts(fullPath, "segments"))
+                QFile::remove(stale);
+            QByteArray version = request->responseHeader("x-file-version");
+            if (version.isEmpty())
+                version = "0";
+
+            const TransferScheduler::Limits &limits = m_transfers.limits();
+            const qint64 size = request->responseHeader("content-length").toLongLong();
+            if (limits.maxStreamsPerDownload > 1 && size >= limits.segmentThreshold
+                    && request->responseHeader("accept-ranges") == "bytes"
+                    && request->responseHeader("content-encoding").isEmpty()) {
+                // Этот ответ становится первым диапазоном, остальные запрашиваются параллельно
+                *segmented = true;
+                const QByteArray expectedHash = QByteArray::fromHex(request->responseHeader("x-file-hash"));
+                SegmentedDownload *download = new SegmentedDownload(
+                        [this](const QByteArray &method, const QByteArray &path) { return createRequest(method, path); },
+                        "/download" + fileQuery(rootIndex, relativePath),
+                        partFilePath(fullPath, "segments-" + QString::fromLatin1(version)),
+                        size, request->responseHeader("etag"), limits.maxStreamsPerDownload, this);
+                connect(download, &SegmentedDownload::finished, this, [=](bool ok) {
+                    download->deleteLater();
+                    if (ok)
+                        complete(download->partPath(), expectedHash);
+                    else
+                        done(TransferScheduler::Retry);
+                });
+                if (!download->start(request)) {
+                    request->abort();
+                    request->deleteLater();
+                }
+                return;
             }
+
+            partFile->setFileName(partFilePath(fullPath, "download-" + QString::fromLatin1(version)));
+            opened = partFile->open(QIODevice::WriteOnly | QIODevice::Truncate);
+        } else {
+            // Короткое тело ошибки остаётся в памяти
+            return;
         }
-        if (!key.isEmpty())
-            m_ignoreNextChange.insert(key);
 
-        delete buffer;
+        if (!opened) {
+            qCWarning(lcClient) << "Failed to save downloaded file:" << fullPath;
+            if (request->statusCode() == 206)
+                QFile::remove(resumePath);
+            request->abort();
+            return;
+        }
+        request->setResponseDevice(partFile);
     });
 
-    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        if (*segmented)
+            return;
+        request->deleteLater();
+        const bool flushed = !partFile->isOpen() || partFile->flush();
+        partFile->close();
+        const int status = request->statusCode();
+
+        if (!ok || !flushed) {
+            // Принятая часть остаётся на диске: следующая попытка её докачает
+            qCWarning(lcClient) << "Download interrupted:" << relativePath << request->errorString();
+            done(TransferScheduler::Retry);
+            return;
+        }
+
+        if (status == 416) {
+            // Сохранённая часть длиннее серверного файла — она ни к чему
+            QFile::remove(resumePath);
+            done(TransferScheduler::Retry);
+            return;
+        }
+
+        if (status != 200 && status != 206) {
+            qCWarning(lcClient) << "Download failed:" << relativePath << status;
+            done(transferResult(ok, status));
+            return;
+        }
+
+        complete(partFile->fileName(), QByteArray::fromHex(request->responseHeader("x-file-hash")));
+    });
 
-    socket->connectToHost(m_serverAddress, m_serverPort);
+    request->start();
 }
 
-void SyncService::handleNotify(QTcpSocket *socket, const QByteArray &body)
+void SyncService::getFileDelta(int rootIndex, const QString &relativePath, const QString &fullPath,
+                               const TransferScheduler::Done &done)
 {
-    Q_UNUSED(socket)
-    QJsonDocument doc = QJsonDocument::fromJson(body);
-    if (!doc.isObject()) {
-        qWarning() << "Invalid JSON in /notify";
+    // Отправляем сигнатуру локальной копии, сервер отвечает дельтой
+    DeltaSync::Signature signature;
+    if (!DeltaSync::computeSignature(fullPath, &signature)) {
+        getFileFull(rootIndex, relativePath, fullPath, done);
         return;
     }
 
-    QJsonObject obj = doc.object();
-    QString path = obj.value("path").toString();
-    bool deleted = obj.value("deleted").toBool();
-    int rootIndex = obj.value("rootIndex").toInt();
-
-    if (path.isEmpty())
+    QTemporaryFile *deltaFile = new QTemporaryFile;
+    if (!deltaFile->open()) {
+        delete deltaFile;
+        getFileFull(rootIndex, relativePath, fullPath, done);
         return;
+    }
+
+    HttpClientRequest *request = createRequest("POST", "/delta-download" + fileQuery(rootIndex, relativePath));
+    request->setHeader("Content-Type", "application/x-sync-signature");
+    request->setBody(signature.serialize());
+    request->setResponseDevice(deltaFile);
+    deltaFile->setParent(request);
+
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
 
+        if (!ok || request->statusCode() != 200 || !deltaFile->flush() || !deltaFile->seek(0)) {
+            getFileFull(rootIndex, relativePath, fullPath, done);
+            return;
+        }
+
+        const QString partPath = partFilePath(fullPath, "download");
+        QFile output(partPath);
+        bool applied = output.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                && DeltaSync::applyDelta(fullPath, deltaFile, &output)
+                && output.flush();
+        output.close();
+
+        if (!applied) {
+            qCWarning(lcClient) << "Delta download did not apply, fetching whole file:" << relativePath;
+            output.remove();
+            getFileFull(rootIndex, relativePath, fullPath, done);
+            return;
+        }
+
+        qCDebug(lcClient) << "Delta download for" << relativePath << ":" << request->bytesReceived() << "bytes";
+        const bool saved = finishDownload(rootIndex, relativePath, partPath, fullPath);
+        done(saved ? TransferScheduler::Succeeded : TransferScheduler::Failed);
+    });
+
+    request->start();
+}
+
+bool SyncService::finishDownload(int rootIndex, const QString &relativePath, const QString &partPath, const QString &fullPath)
+{
+    if (!replaceFile(partPath, fullPath)) {
+        qCWarning(lcClient) << "Failed to save downloaded file:" << fullPath;
+        QFile::remove(partPath);
+        return false;
+    }
+
+    qCDebug(lcClient) << "Downloaded file:" << relativePath;
+
+    FileEntry entry(relativePath, "file", QFileInfo(fullPath).lastModified().toMSecsSinceEpoch(), rootIndex);
+    entry.hash = m_monitor->hashCache()->hashFile(fullPath);
+    m_journal->record(entry);
+
+    // Помечаем для игнорирования, чтобы не зациклить синхронизацию
+    QString key = ignoreKeyFor(relativePath);
+    if (!key.isEmpty())
+        m_ignoreNextChange.insert(key);
+    return true;
+}
+
+void SyncService::applyNotification(int rootIndex, const QString &path, bool deleted)
+{
     if (deleted) {
-        qDebug() << "Received deletion notification for" << path;
+        qCDebug(lcClient) << "Received deletion notification for" << path;
+        m_journal->forget(qMakePair(rootIndex, path));
         QString fullPath = resolveFullPath(rootIndex, path);
         if (!fullPath.isEmpty()) {
             QFile::remove(fullPath);
@@ -498,7 +1075,7 @@ void SyncService::handleNotify(QTcpSocket *socket, const QByteArray &body)
                 m_ignoreNextChange.insert(key);
         }
     } else {
-        qDebug() << "Received update notification for" << path;
+        qCDebug(lcClient) << "Received update notification for" << path;
         QString key;
         for (int i = 0; i < m_syncDirectories.size(); ++i) {
             QDir dir(m_syncDirectories[i]);
@@ -511,69 +1088,34 @@ void SyncService::handleNotify(QTcpSocket *socket, const QByteArray &body)
         if (!key.isEmpty())
             m_ignoreNextChange.insert(key);
 
-        getFile(rootIndex, path);
-    }
-}
-
-void SyncService::handleNewConnection()
-{
-    while (m_server.hasPendingConnections())
-    {
-        QTcpSocket *clientSocket = m_server.nextPendingConnection();
-        connect(clientSocket, &QTcpSocket::readyRead, this, [=]() {
-            QByteArray data = clientSocket->readAll();
-
-            // Минимальный разбор HTTP-запроса
-            int headerEnd = data.indexOf("\r\n\r\n");
-            if (headerEnd == -1)
-                return;
-
-            QByteArray headers = data.left(headerEnd);
-            QByteArray body = data.mid(headerEnd + 4);
-
-            QString requestLine = QString::fromUtf8(headers).split("\r\n").value(0);
-            QString method = requestLine.section(' ', 0, 0);
-            QString path   = requestLine.section(' ', 1, 1);
-
-            if (method == "POST" && path == "/notify") {
-                handleNotify(clientSocket, body);
-            } else {
-                // Ответ по умолчанию
-                clientSocket->write("HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n");
-                clientSocket->disconnectFromHost();
-            }
-        });
-
-        connect(clientSocket, &QTcpSocket::disconnected, clientSocket, &QObject::deleteLater);
+        getFile(rootIndex, path, TransferScheduler::Interactive);
     }
 }
 
 void SyncService::sendDeleteRequest(const FileEntry &entry)
 {
+    const SyncJournal::Key key = qMakePair(entry.rootIndex, entry.path);
     QString fullPath = resolveFullPath(entry.rootIndex, entry.path);
     if (fullPath.isEmpty()) {
-        qWarning() << "sendDeleteRequest: cannot resolve full path for" << entry.path;
+        qCWarning(lcClient) << "sendDeleteRequest: cannot resolve full path for" << entry.path;
+        m_pendingDeletes.remove(key);
         return;
     }
 
-    QTcpSocket *socket = new QTcpSocket(this);
-
-    connect(socket, &QTcpSocket::connected, [=]() {
-        QByteArray request;
-        request += "POST /delete HTTP/1.1\r\n";
-        request += "Host: syncserver\r\n";
-        request += "X-File-Path: " + entry.path.toUtf8() + "\r\n";
-        request += "X-File-Root-Index: " + QByteArray::number(entry.rootIndex) + "\r\n";
-        request += "Connection: close\r\n\r\n";
-        socket->write(request);
+    HttpClientRequest *request = createRequest("POST", "/delete");
+    request->setHeader("X-File-Path", entry.path.toUtf8());
+    request->setHeader("X-File-Root-Index", QByteArray::number(entry.rootIndex));
+    request->setPipelined(true);
+
+    // Запрос завершён, успешно или нет: дальше файл снова сверяется по отличиям сервера,
+    // иначе его больше никогда не скачать, даже если другой клиент создаст его заново
+    connect(request, &HttpClientRequest::finished, this, [this, request, key](bool ok) {
+        request->deleteLater();
+        m_pendingDeletes.remove(key);
+        if (ok)
+            qCDebug(lcClient) << "Delete response:" << request->statusCode() << logPayload(request->responseBody());
+        else
+            qCWarning(lcClient) << "delete request failed:" << request->errorString();
     });
-
-    connect(socket, &QTcpSocket::readyRead, [=]() {
-        QByteArray response = socket->readAll();
-        qDebug() << "Delete response:" << response;
-    });
-
-    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
-
-    socket->connectToHost(m_serverAddress, m_serverPort);
+    request->start();
 }
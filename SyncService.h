@@ -3,23 +3,30 @@
 #include <QObject>
 #include <QTimer>
 #include <QHostAddress>
-#include <QTcpServer>
+#include <QAbstractSocket>
 #include "FileEntry.h"
+#include "MerkleTree.h"
+#include "SyncJournal.h"
+#include "TransferScheduler.h"
+#include <QScopedPointer>
+#include <QSet>
 
 class QTcpSocket;
 class FileMonitor;
+class HttpClientRequest;
+class HttpConnectionPool;
+class PushSubscription;
 class SyncService : public QObject
 {
     Q_OBJECT
 public:
     explicit SyncService(const QHostAddress &serverAddress, quint16 serverPort, QObject *parent = nullptr);
+    void setTransferLimits(const TransferScheduler::Limits &limits);
     void start();
-    static void discoverAndStart(QObject *parent);
+    static void discoverAndStart(QObject *parent, const TransferScheduler::Limits &limits = TransferScheduler::Limits());
 
 private slots:
-    void handleNewConnection();
     void handleSocketError(QAbstractSocket::SocketError err);
-    void onPingSocketError(QAbstractSocket::SocketError socketError);
 
 signals:
     void connectionLost();
@@ -27,21 +34,53 @@ signals:
 private:
     QHostAddress m_serverAddress;
     quint16 m_serverPort;
+    HttpConnectionPool *m_pool = nullptr; // постоянные соединения для всех запросов к серверу
     QTimer m_pingTimer;
     QStringList m_syncDirectories;
     FileMonitor *m_monitor = nullptr;
-    QTcpServer m_server;
+    PushSubscription *m_push = nullptr; // события сервера по постоянному соединению
+    TransferScheduler m_transfers;
     QSet<QString> m_ignoreNextChange;
+    bool m_binaryManifest = true; // сбрасывается, если сервер понимает только JSON
+    bool m_merkleSupported = true;
+    bool m_serverCompression = false; // сервер принимает тела запросов со сжатием gzip
+    MerkleTree m_localTree;       // дерево хэшей локальных файлов на момент последней сверки
+    QScopedPointer<SyncJournal> m_journal; // последнее согласованное с сервером состояние
+    QSet<SyncJournal::Key> m_pendingDeletes; // удалены локально без связи с сервером
+    QSet<SyncJournal::Key> m_reconcileDiffs; // отличия, найденные текущей сверкой
 
     void sendPing();
-    void sendSyncListToServer(const QList<FileEntry> &files);
-    void uploadFile(const FileEntry &entry);
-    void getFile(int rootIndex, const QString &relativePath);
-    void handleNotify(QTcpSocket *socket, const QByteArray &body);
+    void sendSyncListToServer(const QList<FileEntry> &files,
+                              TransferScheduler::Priority priority = TransferScheduler::Bulk);
+    // Передачи ставятся в очередь m_transfers и запускаются по мере освобождения слотов
+    void uploadFile(const FileEntry &entry, TransferScheduler::Priority priority = TransferScheduler::Bulk);
+    void getFile(int rootIndex, const QString &relativePath,
+                 TransferScheduler::Priority priority = TransferScheduler::Bulk);
+    void startUpload(const FileEntry &entry, const TransferScheduler::Done &done);
+    void uploadFileFull(const FileEntry &entry, const QString &fullPath, const TransferScheduler::Done &done);
+    // offset — сколько байт этой версии сервер уже принял в прошлых попытках
+    void uploadFileFrom(const FileEntry &entry, const QString &fullPath, qint64 offset,
+                        const TransferScheduler::Done &done);
+    void uploadFileDelta(const FileEntry &entry, const QString &fullPath, const TransferScheduler::Done &done);
+    void startDownload(int rootIndex, const QString &relativePath, const TransferScheduler::Done &done);
+    void getFileFull(int rootIndex, const QString &relativePath, const QString &fullPath,
+                     const TransferScheduler::Done &done);
+    void getFileDelta(int rootIndex, const QString &relativePath, const QString &fullPath,
+                      const TransferScheduler::Done &done);
+    bool finishDownload(int rootIndex, const QString &relativePath, const QString &partPath, const QString &fullPath);
+    HttpClientRequest *createRequest(const QByteArray &method, const QByteArray &path);
+    QString ignoreKeyFor(const QString &relativePath) const;
+    void applyNotification(int rootIndex, const QString &path, bool deleted);
     void sendDeleteRequest(const FileEntry &entry);
     void synchronizeWithServer();
+    void sendLocalState(const QList<FileEntry> &localEntries);
+    void recordSynced(const QList<FileEntry> &localEntries, const QSet<SyncJournal::Key> &differing);
+    void reconcileWithServer(const QVector<MerkleTree::Query> &queries, const QList<FileEntry> &localEntries);
+    void compareMerkleNodes(const MerkleTree::Node &local, const MerkleTree::Node &remote,
+                            QVector<MerkleTree::Query> *next, QVector<FileDiff> *diffs);
     QList<FileEntry> scanLocalDirectories();
-    QVector<FileDiff> parseDiffs(const QByteArray& response);
-    void onResponse(const QVector<FileDiff> &diffs);
+    QVector<FileDiff> parseDiffs(const QByteArray &body);
+    void onResponse(const QVector<FileDiff> &diffs,
+                    TransferScheduler::Priority priority = TransferScheduler::Bulk);
     QString resolveFullPath(int rootIndex, const QString &relativePath) const;
 };
@@ -0,0 +1,169 @@
+#include "TransferScheduler.h"
+#include "Log.h"
+#include <QTimer>
+#include <QSharedPointer>
+#include <QDebug>
+
+static const int MinRetryDelayMs = 1000;
+static const int MaxRetryDelayMs = 60 * 1000;
+
+TransferScheduler::TransferScheduler(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void TransferScheduler::setLimits(const Limits &limits)
+{
+    m_limits = limits;
+    m_limits.maxActive = qMax(1, m_limits.maxActive);
+    m_limits.maxDownloads = qMax(1, m_limits.maxDownloads);
+    m_limits.maxUploads = qMax(1, m_limits.maxUploads);
+    m_limits.maxAttempts = qMax(1, m_limits.maxAttempts);
+    m_limits.maxStreamsPerDownload = qMax(1, m_limits.maxStreamsPerDownload);
+    schedule();
+}
+
+QString TransferScheduler::taskKey(Direction direction, const QString &key)
+{
+    return (direction == Upload ? QLatin1String("u:") : QLatin1String("d:")) + key;
+}
+
+void TransferScheduler::enqueue(Direction direction, const QString &key, qint64 size, Priority priority, const Job &job)
+{
+    Task task;
+    task.direction = direction;
+    task.key = taskKey(direction, key);
+    task.size = qMax<qint64>(0, size);
+    task.priority = priority;
+    task.job = job;
+
+    if (m_active.contains(task.key)) {
+        // Идущая передача может не застать последнее изменение
+        if (m_rerun.contains(task.key))
+            task.priority = qMin(task.priority, m_rerun.value(task.key).priority);
+        m_rerun.insert(task.key, task);
+        return;
+    }
+
+    auto it = m_pending.find(task.key);
+    if (it != m_pending.end()) {
+        // Одна задача на файл; приоритет не понижается
+        task.priority = qMin(task.priority, it->priority);
+        m_queue.remove(m_pendingOrder.take(task.key));
+        m_pending.erase(it);
+    }
+
+    addPending(task);
+    schedule();
+}
+
+void TransferScheduler::updateSize(Direction direction, const QString &key, qint64 size)
+{
+    auto it = m_active.find(taskKey(direction, key));
+    if (it == m_active.end())
+        return;
+
+    size = qMax<qint64>(0, size);
+    m_inFlightBytes += size - it->size;
+    it->size = size;
+    // Оценка могла оказаться завышенной — освободившееся место достаётся ожидающим
+    schedule();
+}
+
+void TransferScheduler::addPending(const Task &task)
+{
+    const Order order = { int(task.priority), task.size, m_nextSeq++ };
+    m_queue.insert(order, task.key);
+    m_pendingOrder.insert(task.key, order);
+    m_pending.insert(task.key, task);
+}
+
+bool TransferScheduler::canStart(const Task &task) const
+{
+    const int directionLimit = task.direction == Upload ? m_limits.maxUploads : m_limits.maxDownloads;
+    if (m_activeByDirection[task.direction] >= directionLimit)
+        return false;
+
+    // Крупный файл без других передач проходит всегда, иначе он не передастся никогда
+    return m_activeCount == 0 || m_inFlightBytes + task.size <= m_limits.maxInFlightBytes;
+}
+
+void TransferScheduler::schedule()
+{
+    // Задача может завершиться синхронно прямо из start() — повторный вход откладываем
+    if (m_scheduling) {
+        m_rescheduleNeeded = true;
+        return;
+    }
+
+    m_scheduling = true;
+    do {
+        m_rescheduleNeeded = false;
+
+        bool blocked[2] = { false, false };
+        auto it = m_queue.begin();
+        while (it != m_queue.end() && m_activeCount < m_limits.maxActive && !(blocked[Download] && blocked[Upload])) {
+            const Task &task = m_pending[it.value()];
+            // Дальше в очереди того же направления задачи не приоритетнее и не меньше
+            if (blocked[task.direction] || !canStart(task)) {
+                blocked[task.direction] = true;
+                ++it;
+                continue;
+            }
+
+            const Task started = m_pending.take(it.value());
+            m_pendingOrder.remove(started.key);
+            it = m_queue.erase(it);
+            start(started);
+            // start() мог изменить очередь
+            if (m_rescheduleNeeded)
+                break;
+        }
+    } while (m_rescheduleNeeded);
+    m_scheduling = false;
+}
+
+void TransferScheduler::start(const Task &task)
+{
+    m_active.insert(task.key, task);
+    ++m_activeCount;
+    ++m_activeByDirection[task.direction];
+    m_inFlightBytes += task.size;
+
+    const QString key = task.key;
+    // Сбой задачи после её удаления из m_active не должен учитываться повторно
+    QSharedPointer<bool> called(new bool(false));
+    task.job([this, key, called](Result result) {
+        if (*called)
+            return;
+        *called = true;
+        finish(key, result);
+    });
+}
+
+void TransferScheduler::finish(const QString &key, Result result)
+{
+    Task task = m_active.take(key);
+    --m_activeCount;
+    --m_activeByDirection[task.direction];
+    m_inFlightBytes -= task.size;
+
+    if (m_rerun.contains(key)) {
+        // Файл изменился во время передачи — передаём последнее состояние
+        addPending(m_rerun.take(key));
+    } else if (result == Retry && ++task.attempts < m_limits.maxAttempts) {
+        const int delay = qMin(MaxRetryDelayMs, MinRetryDelayMs << qMin(task.attempts - 1, 16));
+        qCWarning(lcClient) << "Transfer" << key << "failed, retry" << task.attempts << "in" << delay << "ms";
+        QTimer::singleShot(delay, this, [this, task]() {
+            // За время паузы файл могли поставить заново — новая задача важнее
+            if (m_pending.contains(task.key) || m_active.contains(task.key))
+                return;
+            addPending(task);
+            schedule();
+        });
+    } else if (result != Succeeded) {
+        qCWarning(lcClient) << "Transfer" << key << "failed";
+    }
+
+    schedule();
+}
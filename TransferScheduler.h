@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <functional>
+
+// Очередь передач файлов клиента.
+// Одновременно выполняется ограниченное число передач (всего и по направлениям),
+// суммарный размер передаваемых файлов ограничен. Изменённые пользователем файлы
+// идут раньше массовой сверки, внутри класса — сначала мелкие. Сбой сети
+// приводит к повтору с растущей паузой.
+class TransferScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Direction { Download, Upload };
+    enum Priority { Interactive, Bulk };
+    enum Result { Succeeded, Failed, Retry };
+
+    typedef std::function<void(Result)> Done;
+    // Задача запускает передачу и по её окончании ровно один раз вызывает done
+    typedef std::function<void(const Done &done)> Job;
+
+    struct Limits
+    {
+        int maxActive = 8;
+        int maxDownloads = 6;
+        int maxUploads = 4;
+        qint64 maxInFlightBytes = 64 * 1024 * 1024;
+        int maxAttempts = 5;
+        // Файлы от segmentThreshold байт загружаются в несколько потоков (не больше maxStreamsPerDownload)
+        int maxStreamsPerDownload = 4;
+        qint64 segmentThreshold = 32 * 1024 * 1024;
+    };
+
+    explicit TransferScheduler(QObject *parent = nullptr);
+
+    void setLimits(const Limits &limits);
+    const Limits &limits() const { return m_limits; }
+
+    // Повторная постановка того же файла заменяет ожидающую задачу;
+    // если передача уже идёт, она будет выполнена ещё раз после завершения
+    void enqueue(Direction direction, const QString &key, qint64 size, Priority priority, const Job &job);
+    // Уточнение размера идущей передачи, когда он стал известен (Content-Length ответа).
+    // Учитывается и в лимите maxInFlightBytes, и при повторах задачи
+    void updateSize(Direction direction, const QString &key, qint64 size);
+
+    int pendingCount() const { return m_pending.size(); }
+    int activeCount() const { return m_activeCount; }
+
+private:
+    struct Task
+    {
+        Direction direction = Download;
+        QString key;
+        qint64 size = 0;
+        Priority priority = Bulk;
+        Job job;
+        int attempts = 0;
+    };
+
+    struct Order
+    {
+        int priority;
+        qint64 size;
+        quint64 seq;
+
+        bool operator<(const Order &other) const
+        {
+            if (priority != other.priority)
+                return priority < other.priority;
+            if (size != other.size)
+                return size < other.size;
+            return seq < other.seq;
+        }
+    };
+
+    Limits m_limits;
+    QMap<Order, QString> m_queue;       // порядок запуска ожидающих задач
+    QHash<QString, Task> m_pending;     // ожидающие задачи по ключу
+    QHash<QString, Order> m_pendingOrder;
+    QHash<QString, Task> m_active;
+    QHash<QString, Task> m_rerun;       // поставлены повторно во время передачи
+    int m_activeCount = 0;
+    int m_activeByDirection[2] = { 0, 0 };
+    qint64 m_inFlightBytes = 0;
+    quint64 m_nextSeq = 0;
+    bool m_scheduling = false;
+    bool m_rescheduleNeeded = false;
+
+    static QString taskKey(Direction direction, const QString &key);
+    void addPending(const Task &task);
+    void schedule();
+    bool canStart(const Task &task) const;
+    void start(const Task &task);
+    void finish(const QString &key, Result result);
+};
@@ -0,0 +1,6 @@
+# Бенчмарки собираются отдельно от приложения: qmake bench/bench.pro
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    load \
+    micro
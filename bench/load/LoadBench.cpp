@@ -0,0 +1,376 @@
+#include "LoadBench.h"
+#include "HttpClientRequest.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QUrl>
+#include <algorithm>
+#include <cmath>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+static const quint16 ServerPort = 8080;        // SyncServer слушает фиксированный порт
+static const int PingIntervalMs = 200;
+static const int MaxPingAttempts = 50;
+static const int DrainTimeoutMs = 15000;
+static const int SampleIntervalMs = 1000;
+
+// Тело скачанного файла клиенту не нужно — только его размер
+class NullDevice : public QIODevice
+{
+public:
+    explicit NullDevice(QObject *parent) : QIODevice(parent) { open(QIODevice::WriteOnly); }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *, qint64 size) override { return size; }
+};
+
+LoadBench::LoadBench(const Options &options, QObject *parent)
+    : QObject(parent), m_options(options), m_random(std::random_device()())
+{
+    m_sampleTimer.setInterval(SampleIntervalMs);
+    connect(&m_sampleTimer, &QTimer::timeout, this, &LoadBench::sampleServer);
+}
+
+LoadBench::~LoadBench()
+{
+    if (m_server.state() != QProcess::NotRunning) {
+        m_server.kill();
+        m_server.waitForFinished(3000);
+    }
+}
+
+QString LoadBench::relativePath(int file)
+{
+    return QString("bench/file-%1.bin").arg(file, 6, 10, QChar('0'));
+}
+
+void LoadBench::start()
+{
+    m_clock.start();
+    if (!prepareTree() || !startServer()) {
+        QTimer::singleShot(0, this, [this]() { emit finished(1); });
+        return;
+    }
+    waitForServer();
+}
+
+bool LoadBench::prepareTree()
+{
+    if (!m_home.isValid()) {
+        qWarning() << "Cannot create temporary directory";
+        return false;
+    }
+
+    // Сервер берёт каталоги синхронизации из $HOME/test/serv
+    const QString serverDir = m_home.path() + "/test/serv/fold1/bench";
+    m_clientDir = m_home.path() + "/client";
+    if (!QDir().mkpath(serverDir) || !QDir().mkpath(m_home.path() + "/test/serv/fold2")
+            || !QDir().mkpath(m_clientDir + "/bench")) {
+        qWarning() << "Cannot create benchmark tree in" << m_home.path();
+        return false;
+    }
+
+    std::uniform_real_distribution<double> logSize(std::log(double(m_options.minSize)),
+                                                   std::log(double(m_options.maxSize)));
+    std::uniform_int_distribution<qint64> linearSize(m_options.minSize, m_options.maxSize);
+
+    qint64 total = 0;
+    QByteArray block(64 * 1024, Qt::Uninitialized);
+    m_fileSizes.resize(m_options.files);
+    m_fileVersions.fill(0, m_options.files);
+
+    for (int i = 0; i < m_options.files; ++i) {
+        const qint64 size = m_options.logSizes ? qint64(std::exp(logSize(m_random))) : linearSize(m_random);
+        m_fileSizes[i] = size;
+        total += size;
+
+        // Случайное содержимое: сжатие не делает прогон неправдоподобно быстрым
+        const QString clientPath = m_clientDir + "/" + relativePath(i);
+        QFile file(clientPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        for (qint64 written = 0; written < size; ) {
+            quint32 *words = reinterpret_cast<quint32 *>(block.data());
+            for (int w = 0; w < block.size() / int(sizeof(quint32)); ++w)
+                words[w] = quint32(m_random());
+            const qint64 n = qMin<qint64>(block.size(), size - written);
+            if (file.write(block.constData(), n) != n)
+                return false;
+            written += n;
+        }
+        file.close();
+
+        if (!QFile::copy(clientPath, m_home.path() + "/test/serv/fold1/" + relativePath(i)))
+            return false;
+    }
+
+    qInfo().noquote() << QString("Prepared %1 files, %2 MiB in %3").arg(m_options.files)
+                         .arg(total / (1024.0 * 1024.0), 0, 'f', 1).arg(m_home.path());
+    return true;
+}
+
+bool LoadBench::startServer()
+{
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("HOME", m_home.path());
+    env.insert("XDG_DATA_HOME", m_home.path() + "/data");
+    env.insert("XDG_CONFIG_HOME", m_home.path() + "/config");
+    // Отладочный вывод на каждый запрос измерял бы терминал, а не сервер
+    env.insert("QT_LOGGING_RULES", "*.debug=false");
+    m_server.setProcessEnvironment(env);
+    m_server.setStandardOutputFile(QProcess::nullDevice());
+    m_server.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+    m_server.start(m_options.serverBinary, QStringList() << "--mode" << "server");
+    if (!m_server.waitForStarted(5000)) {
+        qWarning() << "Cannot start" << m_options.serverBinary << ":" << m_server.errorString();
+        return false;
+    }
+    return true;
+}
+
+void LoadBench::waitForServer()
+{
+    HttpClientRequest *request = new HttpClientRequest(QHostAddress::LocalHost, ServerPort, this);
+    request->setPath("/ping");
+
+    connect(request, &HttpClientRequest::finished, this, [this, request](bool ok) {
+        request->deleteLater();
+        if (ok && request->statusCode() == 200) {
+            beginWarmup();
+            return;
+        }
+
+        if (++m_pingAttempts >= MaxPingAttempts || m_server.state() == QProcess::NotRunning) {
+            qWarning() << "Server did not come up on port" << ServerPort;
+            emit finished(1);
+            return;
+        }
+        QTimer::singleShot(PingIntervalMs, this, &LoadBench::waitForServer);
+    });
+
+    request->start();
+}
+
+void LoadBench::beginWarmup()
+{
+    qInfo().noquote() << QString("Server is up, warming up for %1 s with %2 clients")
+                         .arg(m_options.warmupSec).arg(m_options.clients);
+    m_phase = Warmup;
+    for (int client = 0; client < m_options.clients; ++client)
+        issue(client);
+
+    QTimer::singleShot(m_options.warmupSec * 1000, this, [this]() {
+        m_phase = Measuring;
+        m_serverStart = readServerProcess();
+        m_measureStartMs = m_clock.elapsed();
+        m_sampleTimer.start();
+
+        QTimer::singleShot(m_options.durationSec * 1000, this, [this]() {
+            m_measureEndMs = m_clock.elapsed();
+            m_phase = Draining;
+            sampleServer();
+            m_sampleTimer.stop();
+            if (m_outstanding == 0)
+                finish();
+            else
+                QTimer::singleShot(DrainTimeoutMs, this, &LoadBench::finish);
+        });
+    });
+}
+
+void LoadBench::issue(int client)
+{
+    if (m_phase != Warmup && m_phase != Measuring)
+        return;
+
+    std::uniform_int_distribution<int> pickFile(0, m_options.files - 1);
+    std::uniform_real_distribution<double> pickOperation(0, 1);
+    const int file = pickFile(m_random);
+    if (pickOperation(m_random) < m_options.uploadRatio)
+        upload(client, file);
+    else
+        download(client, file);
+}
+
+void LoadBench::upload(int client, int file)
+{
+    // Версия растёт для каждого файла, иначе сервер отвечает 409
+    quint64 &version = m_fileVersions[file];
+    version = qMax(version + 1, quint64(QDateTime::currentMSecsSinceEpoch()));
+
+    HttpClientRequest *request = new HttpClientRequest(QHostAddress::LocalHost, ServerPort, this);
+    request->setMethod("POST");
+    request->setPath("/upload");
+    request->setHeader("X-File-Path", relativePath(file).toUtf8());
+    request->setHeader("X-File-Version", QByteArray::number(version));
+    request->setHeader("X-Version-Unit", "ms");
+    request->setHeader("X-File-Type", "modified");
+    request->setHeader("X-File-Root-Index", "0");
+    request->setHeader("Content-Type", "application/octet-stream");
+    request->setBodyFile(m_clientDir + "/" + relativePath(file), 0, m_fileSizes[file]);
+
+    const qint64 startedMs = m_clock.elapsed();
+    QElapsedTimer *timer = new QElapsedTimer;
+    timer->start();
+    ++m_outstanding;
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
+        const qint64 elapsedUs = timer->nsecsElapsed() / 1000;
+        delete timer;
+        operationDone(client, startedMs, true, ok, request->statusCode(), m_fileSizes[file], elapsedUs);
+    });
+    request->start();
+}
+
+void LoadBench::download(int client, int file)
+{
+    HttpClientRequest *request = new HttpClientRequest(QHostAddress::LocalHost, ServerPort, this);
+    request->setPath("/download?path=" + QUrl::toPercentEncoding(relativePath(file)) + "&rootIndex=0");
+    if (m_options.gzip)
+        request->setHeader("Accept-Encoding", "gzip");
+    request->setResponseDevice(new NullDevice(request));
+
+    const qint64 startedMs = m_clock.elapsed();
+    QElapsedTimer *timer = new QElapsedTimer;
+    timer->start();
+    ++m_outstanding;
+    connect(request, &HttpClientRequest::finished, this, [=](bool ok) {
+        request->deleteLater();
+        const qint64 elapsedUs = timer->nsecsElapsed() / 1000;
+        delete timer;
+        operationDone(client, startedMs, false, ok, request->statusCode(), request->bytesReceived(), elapsedUs);
+    });
+    request->start();
+}
+
+void LoadBench::operationDone(int client, qint64 startedMs, bool upload, bool ok, int status,
+                              qint64 bytes, qint64 elapsedUs)
+{
+    --m_outstanding;
+
+    // Учитываются операции, завершившиеся в окне измерения
+    if (m_phase == Measuring) {
+        if (ok && status == 200) {
+            (upload ? m_uploadLatencyUs : m_downloadLatencyUs).append(elapsedUs);
+            (upload ? m_bytesUp : m_bytesDown) += bytes;
+        } else if (ok && status == 409) {
+            ++m_conflicts;
+        } else {
+            ++m_errors;
+        }
+    }
+
+    if (m_phase == Draining) {
+        if (m_outstanding == 0)
+            finish();
+        return;
+    }
+
+    // Заданный темп: следующая операция не раньше, чем через 1/rate от начала предыдущей
+    int delayMs = 0;
+    if (m_options.clientRate > 0)
+        delayMs = qMax<int>(0, int(1000 / m_options.clientRate - (m_clock.elapsed() - startedMs)));
+    QTimer::singleShot(delayMs, this, [this, client]() { issue(client); });
+}
+
+LoadBench::ProcessSample LoadBench::readServerProcess() const
+{
+    ProcessSample sample;
+#ifdef Q_OS_LINUX
+    const QString proc = "/proc/" + QString::number(m_server.processId());
+
+    // utime и stime — 14-е и 15-е поля; имя процесса в скобках может содержать пробелы
+    QFile stat(proc + "/stat");
+    if (stat.open(QIODevice::ReadOnly)) {
+        const QByteArray line = stat.readAll();
+        const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+        const double ticks = double(sysconf(_SC_CLK_TCK));
+        if (fields.size() > 12 && ticks > 0)
+            sample.cpuSeconds = (fields[11].toLongLong() + fields[12].toLongLong()) / ticks;
+    }
+
+    QFile status(proc + "/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        for (const QByteArray &line : status.readAll().split('\n')) {
+            const QList<QByteArray> parts = line.simplified().split(' ');
+            if (parts.size() < 2)
+                continue;
+            if (parts[0] == "VmRSS:")
+                sample.rssKiB = parts[1].toLongLong();
+            else if (parts[0] == "VmHWM:")
+                sample.peakRssKiB = parts[1].toLongLong();
+        }
+    }
+#endif
+    return sample;
+}
+
+void LoadBench::sampleServer()
+{
+    m_peakRssKiB = qMax(m_peakRssKiB, readServerProcess().rssKiB);
+}
+
+void LoadBench::finish()
+{
+    if (m_phase == Done)
+        return;
+    m_phase = Done;
+
+    report();
+
+    m_server.terminate();
+    if (!m_server.waitForFinished(5000))
+        m_server.kill();
+    emit finished(0);
+}
+
+static QString percentiles(QVector<qint64> values)
+{
+    if (values.isEmpty())
+        return "n/a";
+
+    std::sort(values.begin(), values.end());
+    auto at = [&values](double p) {
+        const int index = qBound(0, int(std::ceil(p * values.size())) - 1, values.size() - 1);
+        return QString::number(values[index] / 1000.0, 'f', 2);
+    };
+    return QString("p50 %1 ms, p99 %2 ms, p999 %3 ms").arg(at(0.5), at(0.99), at(0.999));
+}
+
+void LoadBench::report()
+{
+    const ProcessSample end = readServerProcess();
+    const double seconds = qMax<qint64>(1, m_measureEndMs - m_measureStartMs) / 1000.0;
+    const double mib = 1024.0 * 1024.0;
+
+    QTextStream out(stdout);
+    out << "LoadBench: " << m_options.clients << " clients, " << m_options.files << " files ("
+        << m_options.minSize / 1024 << " KiB.." << m_options.maxSize / 1024 << " KiB, "
+        << (m_options.logSizes ? "log" : "uniform") << "), upload ratio " << m_options.uploadRatio
+        << ", " << seconds << " s measured\n";
+    out << "uploads:   " << m_uploadLatencyUs.size() << " ("
+        << QString::number(m_uploadLatencyUs.size() / seconds, 'f', 1) << "/s, "
+        << QString::number(m_bytesUp / mib / seconds, 'f', 1) << " MiB/s), "
+        << percentiles(m_uploadLatencyUs) << "\n";
+    out << "downloads: " << m_downloadLatencyUs.size() << " ("
+        << QString::number(m_downloadLatencyUs.size() / seconds, 'f', 1) << "/s, "
+        << QString::number(m_bytesDown / mib / seconds, 'f', 1) << " MiB/s), "
+        << percentiles(m_downloadLatencyUs) << "\n";
+    out << "conflicts: " << m_conflicts << ", errors: " << m_errors << "\n";
+#ifdef Q_OS_LINUX
+    out << "server:    CPU " << QString::number(100.0 * (end.cpuSeconds - m_serverStart.cpuSeconds) / seconds, 'f', 1)
+        << "% of one core, RSS " << QString::number(qMax(m_peakRssKiB, end.rssKiB) / 1024.0, 'f', 1)
+        << " MiB during run, peak " << QString::number(end.peakRssKiB / 1024.0, 'f', 1) << " MiB\n";
+#else
+    Q_UNUSED(end);
+    out << "server:    CPU and RSS are only sampled on Linux\n";
+#endif
+    out.flush();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QObject>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <random>
+
+// Нагрузочный прогон: SyncServer запускается отдельным процессом на временном
+// дереве файлов, N имитированных клиентов по loopback загружают и скачивают файлы.
+// В отчёте — операции в секунду, перцентили задержек, CPU и память сервера.
+class LoadBench : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        QString serverBinary = "SyncServer";
+        int clients = 16;
+        int files = 1000;
+        qint64 minSize = 4 * 1024;
+        qint64 maxSize = 1024 * 1024;
+        bool logSizes = true;       // размеры равномерны по логарифму: много мелких, мало крупных
+        double uploadRatio = 0.2;   // доля операций, изменяющих файл
+        double clientRate = 0;      // операций в секунду на клиента; 0 — без пауз
+        int warmupSec = 3;
+        int durationSec = 30;
+        bool gzip = false;          // клиенты принимают ответы со сжатием
+    };
+
+    explicit LoadBench(const Options &options, QObject *parent = nullptr);
+    ~LoadBench();
+
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private:
+    struct ProcessSample
+    {
+        double cpuSeconds = 0;
+        qint64 rssKiB = 0;
+        qint64 peakRssKiB = 0;
+    };
+
+    Options m_options;
+    QTemporaryDir m_home;
+    QString m_clientDir;
+    QProcess m_server;
+    std::mt19937 m_random;
+
+    QVector<qint64> m_fileSizes;
+    QVector<quint64> m_fileVersions;
+
+    enum Phase { Starting, Warmup, Measuring, Draining, Done };
+    Phase m_phase = Starting;
+    int m_outstanding = 0;
+    int m_pingAttempts = 0;
+    QElapsedTimer m_clock;
+    qint64 m_measureStartMs = 0;
+    qint64 m_measureEndMs = 0;
+    QTimer m_sampleTimer;
+    ProcessSample m_serverStart;
+    qint64 m_peakRssKiB = 0;
+
+    QVector<qint64> m_uploadLatencyUs;
+    QVector<qint64> m_downloadLatencyUs;
+    quint64 m_conflicts = 0;
+    quint64 m_errors = 0;
+    qint64 m_bytesUp = 0;
+    qint64 m_bytesDown = 0;
+
+    bool prepareTree();
+    bool startServer();
+    void waitForServer();
+    void beginWarmup();
+    void issue(int client);
+    void upload(int client, int file);
+    void download(int client, int file);
+    void operationDone(int client, qint64 startedMs, bool upload, bool ok, int status, qint64 bytes, qint64 elapsedUs);
+    void sampleServer();
+    ProcessSample readServerProcess() const;
+    void finish();
+    void report();
+    static QString relativePath(int file);
+};
@@ -0,0 +1,29 @@
+QT += core network
+QT -= gui
+
+LIBS += -lz
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+TARGET = LoadBench
+
+# Клиентская часть HTTP берётся из основного проекта
+SYNC_ROOT = $$PWD/../..
+INCLUDEPATH += $$SYNC_ROOT
+
+SOURCES += \
+    main.cpp \
+    LoadBench.cpp \
+    $$SYNC_ROOT/Compression.cpp \
+    $$SYNC_ROOT/FileStreamer.cpp \
+    $$SYNC_ROOT/HttpClientRequest.cpp \
+    $$SYNC_ROOT/HttpConnection.cpp
+
+HEADERS += \
+    LoadBench.h \
+    $$SYNC_ROOT/Compression.h \
+    $$SYNC_ROOT/FileStreamer.h \
+    $$SYNC_ROOT/HttpClientRequest.h \
+    $$SYNC_ROOT/HttpConnection.h
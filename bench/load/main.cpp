@@ -0,0 +1,68 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "LoadBench.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("LoadBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("End-to-end load benchmark: runs SyncServer on a temporary tree "
+                                     "and drives simulated clients over loopback");
+    parser.addHelpOption();
+
+    LoadBench::Options defaults;
+
+    QCommandLineOption serverOption("server", "SyncServer executable to benchmark", "path", defaults.serverBinary);
+    parser.addOption(serverOption);
+    QCommandLineOption clientsOption("clients", "Number of simulated clients", "count",
+                                     QString::number(defaults.clients));
+    parser.addOption(clientsOption);
+    QCommandLineOption filesOption("files", "Number of files in the synced tree", "count",
+                                   QString::number(defaults.files));
+    parser.addOption(filesOption);
+    QCommandLineOption minSizeOption("min-size", "Smallest file size in KiB", "KiB",
+                                     QString::number(defaults.minSize / 1024));
+    parser.addOption(minSizeOption);
+    QCommandLineOption maxSizeOption("max-size", "Largest file size in KiB", "KiB",
+                                     QString::number(defaults.maxSize / 1024));
+    parser.addOption(maxSizeOption);
+    QCommandLineOption sizeDistOption("size-dist", "File size distribution: log or uniform", "dist", "log");
+    parser.addOption(sizeDistOption);
+    QCommandLineOption uploadRatioOption("upload-ratio", "Share of operations that change a file (0..1)", "ratio",
+                                         QString::number(defaults.uploadRatio));
+    parser.addOption(uploadRatioOption);
+    QCommandLineOption rateOption("rate", "Operations per second per client, 0 for back-to-back", "ops",
+                                  QString::number(defaults.clientRate));
+    parser.addOption(rateOption);
+    QCommandLineOption warmupOption("warmup", "Warm-up time in seconds, not measured", "sec",
+                                    QString::number(defaults.warmupSec));
+    parser.addOption(warmupOption);
+    QCommandLineOption durationOption("duration", "Measured time in seconds", "sec",
+                                      QString::number(defaults.durationSec));
+    parser.addOption(durationOption);
+    QCommandLineOption gzipOption("gzip", "Clients accept gzip-compressed downloads");
+    parser.addOption(gzipOption);
+
+    parser.process(a);
+
+    LoadBench::Options options;
+    options.serverBinary = parser.value(serverOption);
+    options.clients = qMax(1, parser.value(clientsOption).toInt());
+    options.files = qMax(1, parser.value(filesOption).toInt());
+    options.minSize = qMax<qint64>(1, parser.value(minSizeOption).toLongLong() * 1024);
+    options.maxSize = qMax(options.minSize, parser.value(maxSizeOption).toLongLong() * 1024);
+    options.logSizes = parser.value(sizeDistOption) != "uniform";
+    options.uploadRatio = qBound(0.0, parser.value(uploadRatioOption).toDouble(), 1.0);
+    options.clientRate = qMax(0.0, parser.value(rateOption).toDouble());
+    options.warmupSec = qMax(0, parser.value(warmupOption).toInt());
+    options.durationSec = qMax(1, parser.value(durationOption).toInt());
+    options.gzip = parser.isSet(gzipOption);
+
+    LoadBench bench(options);
+    QObject::connect(&bench, &LoadBench::finished, &a, [](int code) { QCoreApplication::exit(code); });
+    bench.start();
+
+    return a.exec();
+}
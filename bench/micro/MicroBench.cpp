@@ -0,0 +1,352 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QCryptographicHash>
+#include "FileIndex.h"
+#include "FileMonitor.h"
+#include "FileUtils.h"
+#include "HashCache.h"
+#include "SyncManifest.h"
+
+// Микробенчмарки отдельных этапов синхронизации на синтетических деревьях и списках
+// от 10k до 10M записей: обход диска, сборка хэш-таблиц, вычисление отличий,
+// кодирование списков в JSON и двоичный формат.
+//
+// Результаты в машиночитаемом виде: MicroBench -csv или MicroBench -o results.xml,xml —
+// по строке на функцию и размер (тег строки — число записей).
+// Размеры ограничиваются переменными окружения:
+//   SYNC_BENCH_MAX_ENTRIES — списки в памяти (по умолчанию 1000000, до 10000000);
+//   SYNC_BENCH_MAX_FILES   — деревья на диске (по умолчанию 100000).
+class MicroBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    // SyncService::scanLocalDirectories: обход каталогов и хэши из кэша
+    void scanTree_data() { diskRows(); }
+    void scanTree();
+    void hashLookup_data() { diskRows(); }
+    void hashLookup();
+    // FileMonitor::rescan без изменений на диске
+    void monitorRescan_data() { diskRows(); }
+    void monitorRescan();
+
+    // SyncServer::handleSyncList: карта записей клиента и отличия от индекса
+    void buildClientMap_data() { memoryRows(); }
+    void buildClientMap();
+    void buildIndex_data() { memoryRows(); }
+    void buildIndex();
+    void diff_data() { memoryRows(); }
+    void diff();
+
+    // Тело /sync-list в обоих форматах
+    void encodeJson_data() { memoryRows(); }
+    void encodeJson();
+    void decodeJson_data() { memoryRows(); }
+    void decodeJson();
+    void encodeBinary_data() { memoryRows(); }
+    void encodeBinary();
+    void decodeBinary_data() { memoryRows(); }
+    void decodeBinary();
+
+private:
+    static const int FilesPerDirectory = 1000;
+
+    QTemporaryDir m_work;
+    QMap<int, QString> m_trees;     // число файлов -> корень дерева
+    int m_entriesCount = 0;
+    QList<FileEntry> m_entries;
+
+    static int envLimit(const char *name, int defaultValue);
+    static void addRows(int limit);
+    static void memoryRows();
+    static void diskRows();
+    static bool jsonFits(int count);
+
+    const QList<FileEntry> &entries(int count);
+    QString tree(int count);
+};
+
+int MicroBench::envLimit(const char *name, int defaultValue)
+{
+    bool ok = false;
+    const int value = qgetenv(name).toInt(&ok);
+    return ok && value > 0 ? value : defaultValue;
+}
+
+void MicroBench::addRows(int limit)
+{
+    QTest::addColumn<int>("count");
+
+    // Самая маленькая строка есть всегда, чтобы у каждой функции был результат
+    const int sizes[] = { 10000, 100000, 1000000, 10000000 };
+    for (int size : sizes) {
+        if (size == sizes[0] || size <= limit)
+            QTest::newRow(QByteArray::number(size).constData()) << size;
+    }
+}
+
+void MicroBench::memoryRows()
+{
+    addRows(envLimit("SYNC_BENCH_MAX_ENTRIES", 1000000));
+}
+
+void MicroBench::diskRows()
+{
+    addRows(envLimit("SYNC_BENCH_MAX_FILES", 100000));
+}
+
+bool MicroBench::jsonFits(int count)
+{
+#if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+    // До 5.15 QJsonDocument хранит документ в двоичном виде с пределом около 128 МиБ
+    return count <= 500000;
+#else
+    Q_UNUSED(count);
+    return true;
+#endif
+}
+
+void MicroBench::initTestCase()
+{
+    QVERIFY(m_work.isValid());
+    // Кэш хэшей FileMonitor — во временном каталоге, а не в кэше пользователя (на Linux)
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(m_work.path() + "/cache"));
+}
+
+const QList<FileEntry> &MicroBench::entries(int count)
+{
+    if (m_entriesCount == count)
+        return m_entries;
+
+    m_entries.clear();
+    m_entries.reserve(count);
+
+    // Пути как в реальном дереве: два корня, вложенные каталоги по 1000 файлов
+    const QDateTime base(QDate(2024, 1, 1), QTime(0, 0));
+    const quint64 baseVersion = quint64(base.toMSecsSinceEpoch());
+    for (int i = 0; i < count; ++i) {
+        FileEntry entry;
+        entry.path = QString("d%1/s%2/file%3.dat")
+                .arg(i / (100 * FilesPerDirectory), 3, 10, QLatin1Char('0'))
+                .arg((i / FilesPerDirectory) % 100, 2, 10, QLatin1Char('0'))
+                .arg(i, 8, 10, QLatin1Char('0'));
+        entry.type = "file";
+        entry.version = baseVersion + quint64(i) * 1000;
+        entry.rootIndex = i % 2;
+        entry.hash = QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Md5);
+        m_entries.append(entry);
+    }
+
+    m_entriesCount = count;
+    return m_entries;
+}
+
+QString MicroBench::tree(int count)
+{
+    if (m_trees.contains(count))
+        return m_trees.value(count);
+
+    // Пустые файлы: измеряется обход и работа с метаданными, а не чтение содержимого
+    const QString root = m_work.path() + "/tree-" + QString::number(count);
+    for (int i = 0; i < count; ++i) {
+        const QString dir = root + QString("/d%1").arg(i / FilesPerDirectory, 5, 10, QLatin1Char('0'));
+        if (i % FilesPerDirectory == 0 && !QDir().mkpath(dir))
+            return QString();
+
+        QFile file(dir + QString("/file%1.dat").arg(i, 8, 10, QLatin1Char('0')));
+        if (!file.open(QIODevice::WriteOnly))
+            return QString();
+    }
+
+    m_trees.insert(count, root);
+    return root;
+}
+
+void MicroBench::scanTree()
+{
+    QFETCH(int, count);
+    const QString root = tree(count);
+    QVERIFY(!root.isEmpty());
+
+    // Повторный обход: метаданные уже в кэше страниц, как при периодической сверке
+    QList<FileEntry> files;
+    QBENCHMARK {
+        QStringList fullPaths;
+        files = listFiles(QStringList() << root, &fullPaths);
+    }
+    QCOMPARE(files.size(), count);
+}
+
+void MicroBench::hashLookup()
+{
+    QFETCH(int, count);
+    const QString root = tree(count);
+    QVERIFY(!root.isEmpty());
+
+    QStringList fullPaths;
+    listFiles(QStringList() << root, &fullPaths);
+
+    // Все хэши уже в кэше: остаётся stat() и поиск по ключу для каждого файла
+    HashCache cache(m_work.path() + "/hashcache-" + QString::number(count) + ".bin");
+    cache.hashFiles(fullPaths);
+
+    QVector<QByteArray> hashes;
+    QBENCHMARK {
+        hashes = cache.hashFiles(fullPaths);
+    }
+    QCOMPARE(hashes.size(), count);
+}
+
+void MicroBench::monitorRescan()
+{
+    QFETCH(int, count);
+    const QString root = tree(count);
+    QVERIFY(!root.isEmpty());
+
+    FileMonitor monitor(QStringList() << root);
+    monitor.start();
+    QCOMPARE(monitor.currentFiles().size(), count);
+
+    QBENCHMARK {
+        QMetaObject::invokeMethod(&monitor, "rescan", Qt::DirectConnection);
+    }
+    QCOMPARE(monitor.currentFiles().size(), count);
+}
+
+void MicroBench::buildClientMap()
+{
+    QFETCH(int, count);
+    const QList<FileEntry> &list = entries(count);
+
+    // Как addEntry в handleSyncList, включая освобождение карты в конце запроса
+    int size = 0;
+    QBENCHMARK {
+        QHash<FileIndex::Key, FileEntry> clientEntries;
+        for (const FileEntry &entry : list)
+            clientEntries[qMakePair(entry.rootIndex, entry.path)] = entry;
+        size = clientEntries.size();
+    }
+    QCOMPARE(size, count);
+}
+
+void MicroBench::buildIndex()
+{
+    QFETCH(int, count);
+    const QList<FileEntry> &list = entries(count);
+
+    // Индекс сервера вместе с деревом хэшей, как при загрузке из IndexStore
+    int size = 0;
+    QBENCHMARK {
+        FileIndex index;
+        for (const FileEntry &entry : list)
+            index.insert(entry);
+        size = index.size();
+    }
+    QCOMPARE(size, count);
+}
+
+void MicroBench::diff()
+{
+    QFETCH(int, count);
+    const QList<FileEntry> &list = entries(count);
+
+    // Клиент расходится с сервером примерно на 2%: части файлов у него нет,
+    // часть изменена на той или другой стороне, часть удалена на сервере
+    FileIndex index;
+    QHash<FileIndex::Key, FileEntry> clientEntries;
+    int expected = 0;
+    for (int i = 0; i < list.size(); ++i) {
+        const FileEntry &entry = list[i];
+        index.insert(entry);
+
+        if (i % 200 == 0) {
+            ++expected;             // download: у клиента файла нет
+            continue;
+        }
+
+        FileEntry clientEntry = entry;
+        if (i % 100 == 1) {
+            clientEntry.hash = QCryptographicHash::hash(entry.hash, QCryptographicHash::Md5);
+            clientEntry.version += 1;
+            ++expected;             // upload: клиент новее
+        } else if (i % 100 == 51) {
+            clientEntry.hash = QCryptographicHash::hash(entry.hash, QCryptographicHash::Md5);
+            ++expected;             // download: версии равны, хэши разные
+        }
+        clientEntries.insert(qMakePair(clientEntry.rootIndex, clientEntry.path), clientEntry);
+
+        if (i % 200 == 100) {
+            FileEntry removed = entry;
+            removed.path = "removed/" + entry.path;
+            clientEntries.insert(qMakePair(removed.rootIndex, removed.path), removed);
+            ++expected;             // delete: на сервере файла уже нет
+        }
+    }
+
+    QVector<FileDiff> diffs;
+    QBENCHMARK {
+        diffs = index.diff(clientEntries);
+    }
+    QCOMPARE(diffs.size(), expected);
+}
+
+void MicroBench::encodeJson()
+{
+    QFETCH(int, count);
+    if (!jsonFits(count))
+        QSKIP("List does not fit into QJsonDocument in this Qt version");
+    const QList<FileEntry> &list = entries(count);
+
+    QByteArray data;
+    QBENCHMARK {
+        data = SyncManifest::encodeEntriesJson(list);
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void MicroBench::decodeJson()
+{
+    QFETCH(int, count);
+    if (!jsonFits(count))
+        QSKIP("List does not fit into QJsonDocument in this Qt version");
+    const QByteArray data = SyncManifest::encodeEntriesJson(entries(count));
+
+    int decoded = 0;
+    QBENCHMARK {
+        decoded = 0;
+        QVERIFY(SyncManifest::decodeEntriesJson(data, [&decoded](const FileEntry &) { ++decoded; }));
+    }
+    QCOMPARE(decoded, count);
+}
+
+void MicroBench::encodeBinary()
+{
+    QFETCH(int, count);
+    const QList<FileEntry> &list = entries(count);
+
+    // encodeEntries сортирует копию списка: сортировка входит в измерение, как и на клиенте
+    QByteArray data;
+    QBENCHMARK {
+        data = SyncManifest::encodeEntries(list);
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void MicroBench::decodeBinary()
+{
+    QFETCH(int, count);
+    const QByteArray data = SyncManifest::encodeEntries(entries(count));
+
+    int decoded = 0;
+    QBENCHMARK {
+        decoded = 0;
+        QVERIFY(SyncManifest::decodeEntries(data, [&decoded](const FileEntry &) { ++decoded; }));
+    }
+    QCOMPARE(decoded, count);
+}
+
+QTEST_GUILESS_MAIN(MicroBench)
+
+#include "MicroBench.moc"
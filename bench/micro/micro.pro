@@ -0,0 +1,36 @@
+QT += core concurrent testlib
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+TARGET = MicroBench
+
+# Измеряемый код берётся из основного проекта без изменений
+SYNC_ROOT = $$PWD/../..
+INCLUDEPATH += $$SYNC_ROOT
+
+SOURCES += \
+    MicroBench.cpp \
+    $$SYNC_ROOT/FileIndex.cpp \
+    $$SYNC_ROOT/FileMonitor.cpp \
+    $$SYNC_ROOT/HashCache.cpp \
+    $$SYNC_ROOT/Log.cpp \
+    $$SYNC_ROOT/MerkleTree.cpp \
+    $$SYNC_ROOT/SyncManifest.cpp
+
+HEADERS += \
+    $$SYNC_ROOT/FileEntry.h \
+    $$SYNC_ROOT/FileIndex.h \
+    $$SYNC_ROOT/FileMonitor.h \
+    $$SYNC_ROOT/FileUtils.h \
+    $$SYNC_ROOT/HashCache.h \
+    $$SYNC_ROOT/Log.h \
+    $$SYNC_ROOT/MerkleTree.h \
+    $$SYNC_ROOT/SyncManifest.h
+
+linux {
+    SOURCES += $$SYNC_ROOT/InotifyWatcher.cpp
+    HEADERS += $$SYNC_ROOT/InotifyWatcher.h
+}
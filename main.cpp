@@ -2,10 +2,12 @@
 #include <QCommandLineParser>
 #include <QTcpSocket>
 #include <QDebug>
+#include <QThread>
 #include "SyncServer.h"
 //#include "DiscoveryResponder.h"
 //#include "DiscoveryClient.h"
 #include "SyncService.h"
+#include "Log.h"
 
 int main(int argc, char *argv[])
 {
@@ -23,22 +25,106 @@ int main(int argc, char *argv[])
                                   "mode");
     parser.addOption(modeOption);
 
+    QCommandLineOption logLevelOption("log-level",
+                                      "Lowest message level to log: debug, info, warning or critical",
+                                      "level", "debug");
+    parser.addOption(logLevelOption);
+
+    QCommandLineOption logLengthOption("log-max-length",
+                                       "Longest log message in characters, longer ones are truncated",
+                                       "chars", QString::number(Log::DefaultMaxLength));
+    parser.addOption(logLengthOption);
+
+    QCommandLineOption workersOption(QStringList() << "w" << "workers",
+                                     "Server mode: number of connection worker threads (0 - single event loop)",
+                                     "count",
+                                     QString::number(QThread::idealThreadCount()));
+    parser.addOption(workersOption);
+
+    QCommandLineOption notifyWindowOption("notify-window",
+                                          "Server mode: window in ms for coalescing change notifications",
+                                          "ms", "100");
+    parser.addOption(notifyWindowOption);
+
+    QCommandLineOption notifyBatchOption("notify-batch",
+                                         "Server mode: maximum number of changes in one notification batch",
+                                         "count", "500");
+    parser.addOption(notifyBatchOption);
+
+    QCommandLineOption cacheSizeOption("file-cache",
+                                       "Server mode: memory in MiB for caching recently requested files",
+                                       "MiB", "256");
+    parser.addOption(cacheSizeOption);
+
+    QCommandLineOption traceOption("trace-buffer",
+                                   "Server mode: request trace events kept per thread for GET /trace, 0 to disable",
+                                   "count", "16384");
+    parser.addOption(traceOption);
+
+    QCommandLineOption transfersOption("transfers",
+                                       "Client mode: maximum number of simultaneous file transfers",
+                                       "count", "8");
+    parser.addOption(transfersOption);
+
+    QCommandLineOption downloadsOption("downloads",
+                                       "Client mode: maximum number of simultaneous downloads",
+                                       "count", "6");
+    parser.addOption(downloadsOption);
+
+    QCommandLineOption uploadsOption("uploads",
+                                     "Client mode: maximum number of simultaneous uploads",
+                                     "count", "4");
+    parser.addOption(uploadsOption);
+
+    QCommandLineOption inFlightOption("transfer-memory",
+                                      "Client mode: maximum total bytes in MiB of transfers in progress (server-reported size for downloads)",
+                                      "MiB", "64");
+    parser.addOption(inFlightOption);
+
+    QCommandLineOption streamsOption("download-streams",
+                                     "Client mode: maximum number of parallel streams for one large download",
+                                     "count", "4");
+    parser.addOption(streamsOption);
+
+    QCommandLineOption segmentThresholdOption("segment-threshold",
+                                              "Client mode: minimum file size in MiB for a multi-stream download",
+                                              "MiB", "32");
+    parser.addOption(segmentThresholdOption);
+
     parser.process(a);
 
+    if (!Log::setLevel(parser.value(logLevelOption))) {
+        qCCritical(lcApp) << "Unknown log level:" << parser.value(logLevelOption);
+        return 1;
+    }
+    Log::install(parser.value(logLengthOption).toInt());
+
     QString mode = parser.value(modeOption).toLower();
 
     if (mode == "server") {
-        qDebug() << "Running in SERVER mode";
+        qCDebug(lcServer) << "Running in SERVER mode";
         auto server = new SyncServer(&a);
+        server->setWorkerCount(parser.value(workersOption).toInt());
+        server->setNotifyCoalescing(parser.value(notifyWindowOption).toInt(),
+                                    parser.value(notifyBatchOption).toInt());
+        server->setFileCacheSize(parser.value(cacheSizeOption).toLongLong() * 1024 * 1024);
+        server->setTraceCapacity(parser.value(traceOption).toInt());
         if (!server->listen(QHostAddress::AnyIPv4, 8080)) {
-            qCritical() << "Failed to listen on port 8080";
+            qCCritical(lcApp) << "Failed to listen on port 8080";
             return 1;
         }
     } else if (mode == "client") {
-        qDebug() << "Running in CLIENT mode";
-        SyncService::discoverAndStart(&a);
+        qCDebug(lcClient) << "Running in CLIENT mode";
+        TransferScheduler::Limits limits;
+        limits.maxActive = parser.value(transfersOption).toInt();
+        limits.maxDownloads = parser.value(downloadsOption).toInt();
+        limits.maxUploads = parser.value(uploadsOption).toInt();
+        limits.maxInFlightBytes = parser.value(inFlightOption).toLongLong() * 1024 * 1024;
+        limits.maxStreamsPerDownload = parser.value(streamsOption).toInt();
+        limits.segmentThreshold = parser.value(segmentThresholdOption).toLongLong() * 1024 * 1024;
+        SyncService::discoverAndStart(&a, limits);
     } else {
-        qCritical() << "Specify --mode server or --mode client";
+        qCCritical(lcApp) << "Specify --mode server or --mode client";
         return 1;
     }
 
@@ -9,6 +9,8 @@ Source0:    %{name}-%{version}.tar.bz2
 
 BuildRequires:  pkgconfig(Qt5Core)
 BuildRequires:  pkgconfig(Qt5Network)
+BuildRequires:  pkgconfig(Qt5Concurrent)
+BuildRequires:  pkgconfig(zlib)
 
 %description
 SyncServer is a lightweight synchronization agent for local and remote file sync,
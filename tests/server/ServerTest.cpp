@@ -0,0 +1,112 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include "SyncServer.h"
+#include "HttpClientRequest.h"
+#include "HttpConnection.h"
+
+// Проверки сервера через настоящие соединения по loopback.
+// Каталоги синхронизации, индекс и кэш — во временном HOME.
+class ServerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    // Соединения обслуживают рабочие потоки: поиск состояния соединения
+    // (connectionFor) из них раньше уходил в бесконечную рекурсию
+    void keepAliveOnWorkerThread();
+    // Короткие запросы клиента идут конвейером по одному соединению пула;
+    // ответы должны достаться своим запросам по порядку
+    void pipelinedRequestsOverPool();
+
+private:
+    QTemporaryDir m_home;
+
+    static quint16 freePort();
+};
+
+void ServerTest::initTestCase()
+{
+    QVERIFY(m_home.isValid());
+    qputenv("HOME", QFile::encodeName(m_home.path()));
+    qputenv("XDG_DATA_HOME", QFile::encodeName(m_home.path() + "/data"));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(m_home.path() + "/cache"));
+    QVERIFY(QDir().mkpath(m_home.path() + "/test/serv/fold1"));
+    QVERIFY(QDir().mkpath(m_home.path() + "/test/serv/fold2"));
+}
+
+quint16 ServerTest::freePort()
+{
+    QTcpServer probe;
+    if (!probe.listen(QHostAddress::LocalHost, 0))
+        return 0;
+    return probe.serverPort();
+}
+
+void ServerTest::keepAliveOnWorkerThread()
+{
+    const quint16 port = freePort();
+    QVERIFY(port != 0);
+
+    SyncServer server;
+    server.setWorkerCount(2);
+    QVERIFY(server.listen(QHostAddress::LocalHost, port));
+
+    QTcpSocket socket;
+    QByteArray response;
+    connect(&socket, &QTcpSocket::readyRead, [&socket, &response]() { response += socket.readAll(); });
+    socket.connectToHost(QHostAddress::LocalHost, port);
+    QTRY_COMPARE_WITH_TIMEOUT(socket.state(), QAbstractSocket::ConnectedState, 5000);
+
+    // Заголовок keep-alive сервер ставит, только найдя соединение из потока сокета;
+    // второй запрос по тому же сокету проверяет, что состояние соединения не потеряно.
+    // Приём соединения идёт в цикле событий основного потока, поэтому ждём через QTRY
+    for (int i = 0; i < 2; ++i) {
+        response.clear();
+        socket.write("GET /ping HTTP/1.1\r\nHost: syncserver\r\n\r\n");
+        QTRY_VERIFY_WITH_TIMEOUT(response.contains("Pong"), 5000);
+        QVERIFY2(response.startsWith("HTTP/1.1 200"), response.constData());
+        QVERIFY2(response.contains("Connection: keep-alive"), response.constData());
+    }
+
+    QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+}
+
+void ServerTest::pipelinedRequestsOverPool()
+{
+    const quint16 port = freePort();
+    QVERIFY(port != 0);
+
+    SyncServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost, port));
+
+    HttpConnectionPool pool(QHostAddress::LocalHost, port);
+    const QList<QByteArray> paths = QList<QByteArray>() << "/ping" << "/unknown" << "/ping";
+    QList<HttpClientRequest *> requests;
+    int finished = 0;
+    for (const QByteArray &path : paths) {
+        HttpClientRequest *request = new HttpClientRequest(&pool, &pool);
+        request->setPath(path);
+        request->setPipelined(true);
+        connect(request, &HttpClientRequest::finished, [&finished](bool ok) {
+            QVERIFY(ok);
+            ++finished;
+        });
+        requests.append(request);
+        request->start();
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(finished, paths.size(), 5000);
+    QCOMPARE(requests[0]->statusCode(), 200);
+    QCOMPARE(requests[0]->responseBody(), QByteArray("Pong"));
+    QCOMPARE(requests[1]->statusCode(), 404);
+    QCOMPARE(requests[2]->statusCode(), 200);
+    QCOMPARE(requests[2]->responseHeader("connection"), QByteArray("keep-alive"));
+}
+
+QTEST_GUILESS_MAIN(ServerTest)
+
+#include "ServerTest.moc"
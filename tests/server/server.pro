@@ -0,0 +1,58 @@
+QT += core network concurrent testlib
+QT -= gui
+
+LIBS += -lz
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+TEMPLATE = app
+
+TARGET = ServerTest
+
+# Проверяемый код берётся из основного проекта без изменений
+SYNC_ROOT = $$PWD/../..
+INCLUDEPATH += $$SYNC_ROOT
+
+SOURCES += \
+    ServerTest.cpp \
+    $$SYNC_ROOT/Compression.cpp \
+    $$SYNC_ROOT/DeltaSync.cpp \
+    $$SYNC_ROOT/FileIndex.cpp \
+    $$SYNC_ROOT/FileMonitor.cpp \
+    $$SYNC_ROOT/FileStreamer.cpp \
+    $$SYNC_ROOT/HashCache.cpp \
+    $$SYNC_ROOT/HttpClientRequest.cpp \
+    $$SYNC_ROOT/HttpConnection.cpp \
+    $$SYNC_ROOT/HotFileCache.cpp \
+    $$SYNC_ROOT/IndexStore.cpp \
+    $$SYNC_ROOT/Log.cpp \
+    $$SYNC_ROOT/MerkleTree.cpp \
+    $$SYNC_ROOT/RequestTrace.cpp \
+    $$SYNC_ROOT/ServerMetrics.cpp \
+    $$SYNC_ROOT/SyncManifest.cpp \
+    $$SYNC_ROOT/SyncServer.cpp
+
+HEADERS += \
+    $$SYNC_ROOT/Compression.h \
+    $$SYNC_ROOT/DeltaSync.h \
+    $$SYNC_ROOT/FileEntry.h \
+    $$SYNC_ROOT/FileIndex.h \
+    $$SYNC_ROOT/FileMonitor.h \
+    $$SYNC_ROOT/FileStreamer.h \
+    $$SYNC_ROOT/FileUtils.h \
+    $$SYNC_ROOT/HashCache.h \
+    $$SYNC_ROOT/HttpClientRequest.h \
+    $$SYNC_ROOT/HttpConnection.h \
+    $$SYNC_ROOT/HotFileCache.h \
+    $$SYNC_ROOT/IndexStore.h \
+    $$SYNC_ROOT/Log.h \
+    $$SYNC_ROOT/MerkleTree.h \
+    $$SYNC_ROOT/RequestTrace.h \
+    $$SYNC_ROOT/ServerMetrics.h \
+    $$SYNC_ROOT/SyncManifest.h \
+    $$SYNC_ROOT/SyncServer.h
+
+linux {
+    SOURCES += $$SYNC_ROOT/InotifyWatcher.cpp
+    HEADERS += $$SYNC_ROOT/InotifyWatcher.h
+}
@@ -0,0 +1,5 @@
+# Тесты собираются отдельно от приложения: qmake tests/tests.pro && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    server